@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "vt100.h"
+
+#define CHUNK_SIZE 4096
+
+struct corpus {
+    char *buf;
+    size_t len;
+};
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int read_file(const char *path, struct corpus *corpus)
+{
+    FILE *fh;
+    size_t capacity = 65536;
+
+    fh = fopen(path, "rb");
+    if (!fh) {
+        perror(path);
+        return 0;
+    }
+
+    corpus->buf = malloc(capacity);
+    corpus->len = 0;
+    for (;;) {
+        size_t bytes;
+
+        if (corpus->len == capacity) {
+            capacity *= 2;
+            corpus->buf = realloc(corpus->buf, capacity);
+        }
+        bytes = fread(corpus->buf + corpus->len, 1, capacity - corpus->len, fh);
+        if (bytes < 1)
+            break;
+        corpus->len += bytes;
+    }
+    fclose(fh);
+
+    return 1;
+}
+
+/* replays every corpus file into sessions_per_file sessions, interleaving the
+ * feeds the way a pty event loop would */
+static double run(struct corpus *corpora, int ncorpora, int sessions_per_file,
+                  int nthreads)
+{
+    VT100Engine *engine;
+    VT100Session **sessions;
+    int nsessions = ncorpora * sessions_per_file, i;
+    size_t offset, max_len = 0;
+    double start, elapsed;
+
+    engine = vt100_engine_new(nthreads);
+    sessions = calloc(nsessions, sizeof(VT100Session *));
+    for (i = 0; i < nsessions; ++i) {
+        sessions[i] = vt100_engine_add_session(engine, 24, 80, NULL, NULL);
+    }
+    for (i = 0; i < ncorpora; ++i) {
+        if (corpora[i].len > max_len)
+            max_len = corpora[i].len;
+    }
+
+    start = now();
+    for (offset = 0; offset < max_len; offset += CHUNK_SIZE) {
+        for (i = 0; i < nsessions; ++i) {
+            struct corpus *corpus = &corpora[i % ncorpora];
+            size_t len;
+
+            if (offset >= corpus->len)
+                continue;
+            len = corpus->len - offset;
+            if (len > CHUNK_SIZE)
+                len = CHUNK_SIZE;
+            vt100_session_feed(sessions[i], corpus->buf + offset, len);
+        }
+    }
+    vt100_engine_wait(engine);
+    elapsed = now() - start;
+
+    vt100_engine_delete(engine);
+    free(sessions);
+
+    return elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    struct corpus *corpora;
+    int ncorpora = 0, sessions_per_file = 16, max_threads, opt, i;
+    size_t total = 0;
+
+    max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    while ((opt = getopt(argc, argv, "s:t:")) != -1) {
+        switch (opt) {
+        case 's':
+            sessions_per_file = atoi(optarg);
+            break;
+        case 't':
+            max_threads = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-s sessions] [-t threads] file...\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind >= argc) {
+        fprintf(stderr, "usage: %s [-s sessions] [-t threads] file...\n",
+                argv[0]);
+        return 1;
+    }
+
+    corpora = calloc(argc - optind, sizeof(struct corpus));
+    for (i = optind; i < argc; ++i) {
+        if (read_file(argv[i], &corpora[ncorpora])) {
+            total += corpora[ncorpora].len;
+            ncorpora++;
+        }
+    }
+    total *= sessions_per_file;
+
+    printf("%d sessions, %zu bytes\n", ncorpora * sessions_per_file, total);
+    for (i = 1; i <= max_threads; i *= 2) {
+        double elapsed = run(corpora, ncorpora, sessions_per_file, i);
+
+        printf("%3d threads: %8.3fs %8.2f MB/s\n",
+               i, elapsed, total / elapsed / 1e6);
+    }
+
+    for (i = 0; i < ncorpora; ++i) {
+        free(corpora[i].buf);
+    }
+    free(corpora);
+
+    return 0;
+}
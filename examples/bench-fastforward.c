@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "vt100.h"
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* something like a build log or a test run: mostly plain lines, with some
+ * color and the occasional line cleared with EL */
+static char *make_output(size_t size)
+{
+    static const char chars[] = "abcdefghijklmnopqrstuvwxyz0123456789 ./-_";
+    char *buf;
+    size_t len = 0;
+    unsigned int seed = 1;
+
+    buf = malloc(size);
+    while (len < size - 256) {
+        int i, width;
+
+        seed = seed * 1103515245 + 12345;
+        width = 20 + (seed >> 16) % 100;
+        if (seed % 5 == 0) {
+            len += sprintf(buf + len, "\033[3%dm", (seed >> 8) % 8);
+        }
+        for (i = 0; i < width; ++i) {
+            seed = seed * 1103515245 + 12345;
+            buf[len++] = chars[(seed >> 16) % (sizeof(chars) - 1)];
+        }
+        len += sprintf(buf + len, seed % 7 ? "\033[m\r\n" : "\033[K\r\n");
+    }
+    memset(buf + len, ' ', size - len);
+
+    return buf;
+}
+
+static double run(char *buf, size_t len, size_t chunk, int scrollback,
+                  int fast_forward, char **snapshotp, size_t *snapshot_lenp)
+{
+    VT100Screen *vt;
+    size_t offset;
+    double start, elapsed;
+
+    vt = vt100_screen_new(24, 80);
+    vt100_screen_set_scrollback_length(vt, scrollback);
+    vt100_screen_set_fast_forward(vt, fast_forward);
+
+    start = now();
+    for (offset = 0; offset < len; offset += chunk) {
+        vt100_screen_process_string(
+            vt, buf + offset, len - offset < chunk ? len - offset : chunk);
+    }
+    elapsed = now() - start;
+
+    vt100_screen_snapshot(vt, snapshotp, snapshot_lenp);
+    vt100_screen_delete(vt);
+
+    return elapsed;
+}
+
+/* processes the same output with fast forward off and on, in a few buffer
+ * sizes, and checks that it ends up in the same state either way */
+int main(int argc, char *argv[])
+{
+    size_t size = 64 * 1024 * 1024, chunks[] = { 65536, 1048576, 16777216 };
+    int scrollback = 10000, opt, i;
+    char *buf;
+
+    while ((opt = getopt(argc, argv, "m:s:")) != -1) {
+        switch (opt) {
+        case 'm':
+            size = (size_t)atoi(optarg) * 1024 * 1024;
+            break;
+        case 's':
+            scrollback = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-m megabytes] [-s scrollback]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    buf = make_output(size);
+    printf("%zu bytes, %d rows of scrollback\n", size, scrollback);
+    for (i = 0; i < (int)(sizeof(chunks) / sizeof(chunks[0])); ++i) {
+        char *full, *fast;
+        size_t full_len, fast_len;
+        double full_time, fast_time;
+
+        full_time = run(buf, size, chunks[i], scrollback, 0, &full, &full_len);
+        fast_time = run(buf, size, chunks[i], scrollback, 1, &fast, &fast_len);
+        printf("%8zu byte buffers: %8.2f MB/s, fast forward %8.2f MB/s "
+               "(%.2fx)%s\n",
+               chunks[i], size / full_time / 1e6, size / fast_time / 1e6,
+               full_time / fast_time,
+               full_len == fast_len && !memcmp(full, fast, full_len)
+                   ? "" : " MISMATCH");
+        free(full);
+        free(fast);
+    }
+
+    free(buf);
+
+    return 0;
+}
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "vt100.h"
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* resident memory in megabytes, or -1 where /proc isn't available. freed
+ * memory isn't always handed back to the system straight away (glibc only
+ * does it from the top of the heap unless it's asked to), so this can lag
+ * behind what the screens actually have allocated. */
+static double rss(void)
+{
+    FILE *f;
+    long size, pages = -1;
+
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+    f = fopen("/proc/self/statm", "r");
+    if (!f) {
+        return -1;
+    }
+    if (fscanf(f, "%ld %ld", &size, &pages) != 2) {
+        pages = -1;
+    }
+    fclose(f);
+
+    return pages < 0 ? -1 : pages * sysconf(_SC_PAGESIZE) / 1e6;
+}
+
+/* colored lines of varying lengths, like a shell session that's been left
+ * open after running a few things */
+static void fill(VT100Screen *vt, int lines, unsigned int seed)
+{
+    char line[256];
+    int i;
+
+    for (i = 0; i < lines; ++i) {
+        int len, width, j;
+
+        seed = seed * 1103515245 + 12345;
+        width = 10 + (seed >> 16) % 70;
+        len = sprintf(line, "\033[3%dm", (seed >> 8) % 8);
+        for (j = 0; j < width; ++j) {
+            seed = seed * 1103515245 + 12345;
+            line[len++] = 'a' + (seed >> 16) % 26;
+        }
+        len += sprintf(line + len, "\033[m\r\n");
+        vt100_screen_process_string(vt, line, len);
+    }
+}
+
+/* fills a lot of screens with scrollback, hibernates all of them to one
+ * file, and then wakes them all up again, checking that each one comes back
+ * the way it was */
+int main(int argc, char *argv[])
+{
+    int count = 1000, scrollback = 1000, opt, i, mismatches = 0;
+    VT100Screen **screens;
+    char **snapshots;
+    size_t *snapshot_lens, before, after;
+    double start, hibernate_time, wake_time, max_wake = 0;
+    double rss_before, rss_after;
+    FILE *file;
+    int fd;
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+        case 'n':
+            count = atoi(optarg);
+            break;
+        case 's':
+            scrollback = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n screens] [-s scrollback]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    file = tmpfile();
+    fd = fileno(file);
+
+    screens = malloc(count * sizeof(VT100Screen *));
+    snapshots = malloc(count * sizeof(char *));
+    snapshot_lens = malloc(count * sizeof(size_t));
+    for (i = 0; i < count; ++i) {
+        screens[i] = vt100_screen_new(24, 80);
+        vt100_screen_set_scrollback_length(screens[i], scrollback);
+        fill(screens[i], scrollback + 24, i + 1);
+        vt100_screen_snapshot(screens[i], &snapshots[i], &snapshot_lens[i]);
+    }
+    before = vt100_memory_usage();
+    rss_before = rss();
+
+    start = now();
+    for (i = 0; i < count; ++i) {
+        if (!vt100_screen_hibernate(screens[i], fd)) {
+            fprintf(stderr, "couldn't hibernate screen %d\n", i);
+            return 1;
+        }
+    }
+    hibernate_time = now() - start;
+    after = vt100_memory_usage();
+    rss_after = rss();
+
+    printf("%d screens, %d rows of scrollback each\n", count, scrollback);
+    printf("accounted: %10.2fMB awake, %10.2fMB hibernating\n",
+           before / 1e6, after / 1e6);
+    printf("resident:  %10.2fMB awake, %10.2fMB hibernating\n",
+           rss_before, rss_after);
+    printf("file:      %10.2fMB (%.1fkB per screen)\n",
+           lseek(fd, 0, SEEK_CUR) / 1e6,
+           lseek(fd, 0, SEEK_CUR) / 1e3 / count);
+    printf("hibernate: %10.3fms per screen\n",
+           hibernate_time / count * 1e3);
+
+    wake_time = 0;
+    for (i = 0; i < count; ++i) {
+        char *snapshot;
+        size_t snapshot_len;
+        double elapsed;
+
+        start = now();
+        vt100_screen_wake(screens[i]);
+        elapsed = now() - start;
+        wake_time += elapsed;
+        if (elapsed > max_wake) {
+            max_wake = elapsed;
+        }
+
+        vt100_screen_snapshot(screens[i], &snapshot, &snapshot_len);
+        if (snapshot_len != snapshot_lens[i]
+            || memcmp(snapshot, snapshots[i], snapshot_len)) {
+            mismatches++;
+        }
+        free(snapshot);
+    }
+    printf("wake:      %10.3fms per screen (%.3fms at most)%s\n",
+           wake_time / count * 1e3, max_wake * 1e3,
+           mismatches ? " MISMATCH" : "");
+
+    for (i = 0; i < count; ++i) {
+        vt100_screen_delete(screens[i]);
+        free(snapshots[i]);
+    }
+    free(screens);
+    free(snapshots);
+    free(snapshot_lens);
+    fclose(file);
+
+    return mismatches != 0;
+}
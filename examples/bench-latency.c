@@ -0,0 +1,150 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "vt100.h"
+
+#define KEYSTROKES 1000
+#define KEYSTROKE_INTERVAL 1000
+#define FLOOD_CHUNK 4096
+#define FLOOD_SIZE (4 * 1024 * 1024)
+
+struct latency {
+    pthread_mutex_t lock;
+    double sent;
+    double *samples;
+    int nsamples;
+};
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* roughly what a build log or a cat of a big file looks like */
+static char *make_flood(void)
+{
+    static const char chars[] =
+        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789+/";
+    char *buf;
+    size_t len = 0;
+    unsigned int seed = 1;
+
+    buf = malloc(FLOOD_SIZE);
+    while (len < FLOOD_SIZE - 128) {
+        int i;
+
+        len += sprintf(buf + len, "\033[3%dm", seed % 8);
+        for (i = 0; i < 76; ++i) {
+            seed = seed * 1103515245 + 12345;
+            buf[len++] = chars[(seed >> 16) % 64];
+        }
+        len += sprintf(buf + len, "\033[m\r\n");
+    }
+    memset(buf + len, ' ', FLOOD_SIZE - len);
+
+    return buf;
+}
+
+static void interactive_callback(
+    VT100Session *session, VT100Screen *vt, void *data)
+{
+    struct latency *latency = data;
+
+    (void)session;
+    (void)vt;
+
+    pthread_mutex_lock(&latency->lock);
+    if (latency->sent) {
+        latency->samples[latency->nsamples++] = now() - latency->sent;
+        latency->sent = 0;
+    }
+    pthread_mutex_unlock(&latency->lock);
+}
+
+/* types into an interactive session once a millisecond while another
+ * session on the same worker is kept busy with a flood of output, and
+ * reports how long each keystroke takes to show up */
+static void run(const char *name, char *flood, size_t budget_bytes,
+                long budget_usec)
+{
+    VT100Engine *engine;
+    VT100Session *flooding, *interactive;
+    struct latency latency;
+    size_t flooded = 0;
+    double start, elapsed;
+    int i;
+
+    pthread_mutex_init(&latency.lock, NULL);
+    latency.sent = 0;
+    latency.samples = calloc(KEYSTROKES, sizeof(double));
+    latency.nsamples = 0;
+
+    engine = vt100_engine_new(1);
+    vt100_engine_set_session_budget(engine, budget_bytes, budget_usec);
+    flooding = vt100_engine_add_session(engine, 24, 80, NULL, NULL);
+    interactive = vt100_engine_add_session(
+        engine, 24, 80, interactive_callback, &latency);
+
+    start = now();
+    for (i = 0; i < KEYSTROKES; ++i) {
+        if (vt100_session_is_idle(flooding)) {
+            size_t offset;
+
+            for (offset = 0; offset < FLOOD_SIZE; offset += FLOOD_CHUNK) {
+                vt100_session_feed(flooding, flood + offset, FLOOD_CHUNK);
+            }
+            flooded += FLOOD_SIZE;
+        }
+
+        pthread_mutex_lock(&latency.lock);
+        if (!latency.sent) {
+            latency.sent = now();
+        }
+        pthread_mutex_unlock(&latency.lock);
+        vt100_session_feed(interactive, "x", 1);
+
+        usleep(KEYSTROKE_INTERVAL);
+    }
+    vt100_engine_wait(engine);
+    elapsed = now() - start;
+
+    qsort(latency.samples, latency.nsamples, sizeof(double),
+          compare_doubles);
+    printf("%-10s %4d keystrokes: p50 %8.3fms p99 %8.3fms max %8.3fms, "
+           "flood %8.2f MB/s\n",
+           name, latency.nsamples,
+           latency.samples[latency.nsamples / 2] * 1e3,
+           latency.samples[latency.nsamples * 99 / 100] * 1e3,
+           latency.samples[latency.nsamples - 1] * 1e3,
+           flooded / elapsed / 1e6);
+
+    vt100_engine_delete(engine);
+    free(latency.samples);
+    pthread_mutex_destroy(&latency.lock);
+}
+
+int main(void)
+{
+    char *flood = make_flood();
+
+    run("unbudgeted", flood, 0, 0);
+    run("budgeted", flood, 64 * 1024, 1000);
+
+    free(flood);
+
+    return 0;
+}
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "vt100.h"
+
+#define CHUNK_SIZE 4096
+
+struct corpus {
+    char *buf;
+    size_t len;
+};
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int read_file(const char *path, struct corpus *corpus)
+{
+    FILE *fh;
+    size_t capacity = 65536;
+
+    fh = fopen(path, "rb");
+    if (!fh) {
+        perror(path);
+        return 0;
+    }
+
+    corpus->buf = malloc(capacity);
+    corpus->len = 0;
+    for (;;) {
+        size_t bytes;
+
+        if (corpus->len == capacity) {
+            capacity *= 2;
+            corpus->buf = realloc(corpus->buf, capacity);
+        }
+        bytes = fread(corpus->buf + corpus->len, 1, capacity - corpus->len, fh);
+        if (bytes < 1)
+            break;
+        corpus->len += bytes;
+    }
+    fclose(fh);
+
+    return 1;
+}
+
+/* feeds the recording through the parser the way a pty reader would, with
+ * any partial sequence at the end of a chunk carried over to the next */
+static void process(VT100Screen *vt, struct corpus *corpus)
+{
+    char buf[CHUNK_SIZE * 2];
+    size_t offset = 0, carry = 0;
+
+    while (offset < corpus->len) {
+        size_t len = corpus->len - offset, parsed;
+
+        if (len > CHUNK_SIZE)
+            len = CHUNK_SIZE;
+        memcpy(buf + carry, corpus->buf + offset, len);
+        offset += len;
+        len += carry;
+
+        parsed = vt100_screen_process_string(vt, buf, len);
+        carry = len - parsed;
+        memmove(buf, buf + parsed, carry);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct corpus corpus;
+    struct vt100_bytecode *bytecode;
+    VT100Screen *vt;
+    int iterations = 20, max_threads, opt, i, j;
+    double start, lex_time, file_time, replay_time;
+
+    max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    while ((opt = getopt(argc, argv, "n:t:")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        case 't':
+            max_threads = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n iterations] [-t threads] file\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-n iterations] [-t threads] file\n",
+                argv[0]);
+        return 1;
+    }
+
+    if (!read_file(argv[optind], &corpus))
+        return 1;
+
+    bytecode = vt100_bytecode_new();
+    vt = vt100_screen_new(24, 80);
+    vt100_screen_compile_to(vt, bytecode);
+    process(vt, &corpus);
+    vt100_screen_delete(vt);
+
+    start = now();
+    for (i = 0; i < iterations; ++i) {
+        vt = vt100_screen_new(24, 80);
+        process(vt, &corpus);
+        vt100_screen_delete(vt);
+    }
+    lex_time = now() - start;
+
+    /* the same again, but straight from the file */
+    start = now();
+    for (i = 0; i < iterations; ++i) {
+        vt = vt100_screen_new(24, 80);
+        vt100_screen_process_file(vt, argv[optind]);
+        vt100_screen_delete(vt);
+    }
+    file_time = now() - start;
+
+    start = now();
+    for (i = 0; i < iterations; ++i) {
+        vt = vt100_screen_new(24, 80);
+        vt100_screen_replay(vt, bytecode->buf, bytecode->len);
+        vt100_screen_delete(vt);
+    }
+    replay_time = now() - start;
+
+    printf("%zu bytes, %zu bytes of bytecode\n", corpus.len, bytecode->len);
+    printf("process_string: %8.3fs %8.2f MB/s\n",
+           lex_time, corpus.len * iterations / lex_time / 1e6);
+    printf("process_file:   %8.3fs %8.2f MB/s\n",
+           file_time, corpus.len * iterations / file_time / 1e6);
+    printf("replay:         %8.3fs %8.2f MB/s (%.2fx)\n",
+           replay_time, corpus.len * iterations / replay_time / 1e6,
+           lex_time / replay_time);
+
+    for (i = 1; i <= max_threads; i *= 2) {
+        double elapsed;
+
+        start = now();
+        for (j = 0; j < iterations; ++j) {
+            vt = vt100_screen_new(24, 80);
+            vt100_screen_process_parallel(vt, corpus.buf, corpus.len, i);
+            vt100_screen_delete(vt);
+        }
+        elapsed = now() - start;
+
+        printf("parallel, %3d threads: %8.3fs %8.2f MB/s\n",
+               i, elapsed, corpus.len * iterations / elapsed / 1e6);
+    }
+
+    vt100_bytecode_delete(bytecode);
+    free(corpus.buf);
+
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "vt100.h"
+
+#define RESIZES 1000
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* fills `history` rows of scrollback with full lines and then resizes the
+ * window back and forth between two widths, so the resize latency can be
+ * compared across scrollback lengths */
+static void run(int history)
+{
+    VT100Screen *vt;
+    char line[82];
+    double start, resize_time;
+    int i;
+
+    memset(line, 'x', 80);
+    line[80] = '\r';
+    line[81] = '\n';
+
+    vt = vt100_screen_new(24, 80);
+    vt100_screen_set_scrollback_length(vt, history);
+    for (i = 0; i < history + 24; ++i) {
+        vt100_screen_process_string(vt, line, sizeof(line));
+    }
+
+    start = now();
+    for (i = 0; i < RESIZES; ++i) {
+        vt100_screen_set_window_size(vt, 24, i % 2 ? 80 : 100);
+    }
+    resize_time = now() - start;
+
+    printf("%8d rows of scrollback: %8.3fus per resize\n",
+           vt->grid->row_count - vt->grid->max.row,
+           resize_time / RESIZES * 1e6);
+
+    vt100_screen_delete(vt);
+}
+
+int main(int argc, char *argv[])
+{
+    int max_history = 1000000, opt, i;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+        case 'n':
+            max_history = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n max_history]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    for (i = 1000; i <= max_history; i *= 10) {
+        run(i);
+    }
+
+    return 0;
+}
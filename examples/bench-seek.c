@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "vt100.h"
+
+#define SEEKS 100
+
+struct corpus {
+    char *buf;
+    size_t len;
+};
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int read_file(const char *path, struct corpus *corpus)
+{
+    FILE *fh;
+    size_t capacity = 65536;
+
+    fh = fopen(path, "rb");
+    if (!fh) {
+        perror(path);
+        return 0;
+    }
+
+    corpus->buf = malloc(capacity);
+    corpus->len = 0;
+    for (;;) {
+        size_t bytes;
+
+        if (corpus->len == capacity) {
+            capacity *= 2;
+            corpus->buf = realloc(corpus->buf, capacity);
+        }
+        bytes = fread(corpus->buf + corpus->len, 1, capacity - corpus->len, fh);
+        if (bytes < 1)
+            break;
+        corpus->len += bytes;
+    }
+    fclose(fh);
+
+    return 1;
+}
+
+/* seeks to random points in the recording repeated `repeat` times, so the
+ * seek latency can be compared across recording lengths */
+static void run(struct corpus *corpus, int repeat, size_t interval)
+{
+    struct vt100_index *index;
+    VT100Screen *vt;
+    char *buf;
+    size_t len = corpus->len * repeat;
+    double start, build_time, seek_time;
+    unsigned int seed = 1;
+    int i;
+
+    buf = malloc(len);
+    for (i = 0; i < repeat; ++i) {
+        memcpy(buf + corpus->len * i, corpus->buf, corpus->len);
+    }
+
+    index = vt100_index_new();
+    vt = vt100_screen_new(24, 80);
+    start = now();
+    vt100_index_build(index, vt, buf, len, interval);
+    build_time = now() - start;
+    vt100_screen_delete(vt);
+
+    vt = vt100_screen_new(24, 80);
+    start = now();
+    for (i = 0; i < SEEKS; ++i) {
+        seed = seed * 1103515245 + 12345;
+        vt100_index_seek(index, vt, buf, len, (size_t)seed % len);
+    }
+    seek_time = now() - start;
+    vt100_screen_delete(vt);
+
+    printf("%12zu bytes: %5d keyframes, built in %8.3fs, "
+           "%8.3fms per seek\n",
+           len, index->nkeyframes, build_time, seek_time / SEEKS * 1e3);
+
+    vt100_index_delete(index);
+    free(buf);
+}
+
+int main(int argc, char *argv[])
+{
+    struct corpus corpus;
+    size_t interval = 65536;
+    int max_repeat = 64, opt, i;
+
+    while ((opt = getopt(argc, argv, "i:r:")) != -1) {
+        switch (opt) {
+        case 'i':
+            interval = atol(optarg);
+            break;
+        case 'r':
+            max_repeat = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-i interval] [-r repeat] file\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-i interval] [-r repeat] file\n",
+                argv[0]);
+        return 1;
+    }
+
+    if (!read_file(argv[optind], &corpus))
+        return 1;
+
+    for (i = 1; i <= max_repeat; i *= 4) {
+        run(&corpus, i, interval);
+    }
+
+    free(corpus.buf);
+
+    return 0;
+}
@@ -0,0 +1,51 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "vt100.h"
+
+/* switches to the alternate screen and back the way a full screen editor
+ * does (clearing it first, then drawing more lines than fit), and checks
+ * that once the alternate grid's rows exist, switching again doesn't
+ * allocate any more of them */
+int main(void)
+{
+    VT100Screen *vt;
+    unsigned long allocated = 0;
+    int i, j, failed = 0;
+
+    vt = vt100_screen_new(24, 80);
+    vt100_screen_process_string(vt, "$ vi file.c\r\n", 13);
+
+    for (i = 0; i < 100; ++i) {
+        char line[64];
+        int len;
+
+        vt100_screen_process_string(vt, "\033[?1049h\033[H\033[2J", 16);
+        for (j = 0; j < 49; ++j) {
+            len = sprintf(line, "\033[3%dmline %d of pass %d\033[m\r\n",
+                          j % 8, j, i);
+            vt100_screen_process_string(vt, line, len);
+        }
+        vt100_screen_process_string(vt, "\033[?1049l", 8);
+
+        if (i == 0) {
+            allocated = vt->stats.rows_allocated;
+        }
+        else if (vt->stats.rows_allocated != allocated) {
+            fprintf(stderr, "pass %d allocated %lu rows\n",
+                    i, vt->stats.rows_allocated - allocated);
+            failed = 1;
+            break;
+        }
+    }
+
+    if (memcmp(vt->grid->rows[vt->grid->row_top].cells[0].contents, "$", 1)) {
+        fprintf(stderr, "the normal screen wasn't restored\n");
+        failed = 1;
+    }
+
+    vt100_screen_delete(vt);
+    printf("%s\n", failed ? "FAIL" : "ok");
+
+    return failed;
+}
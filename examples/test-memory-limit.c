@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "vt100.h"
+
+#define LIMIT (4 * 1000 * 1000)
+
+static void fill(VT100Screen *vt, int lines)
+{
+    char line[128];
+    int i, len;
+
+    for (i = 0; i < lines; ++i) {
+        len = sprintf(line, "line %d, with enough text on it to fill the row "
+                      "out a bit further\r\n", i);
+        vt100_screen_process_string(vt, line, len);
+    }
+}
+
+static int check(int ok, const char *what)
+{
+    if (!ok) {
+        fprintf(stderr, "%s (total %zu, limit %d)\n",
+                what, vt100_memory_usage(), LIMIT);
+    }
+
+    return ok;
+}
+
+/* two screens under one process-wide limit: the one that's growing pays
+ * for going over it, and the idle one is left alone until it's checked
+ * itself */
+int main(void)
+{
+    VT100Screen *idle, *busy;
+    unsigned long evicted;
+    int failed = 0;
+
+    vt100_set_memory_limit(LIMIT);
+
+    /* on its own, the first screen trims its own scrollback */
+    idle = vt100_screen_new(24, 80);
+    vt100_screen_set_scrollback_length(idle, 100000);
+    fill(idle, 5000);
+    failed |= !check(vt100_memory_usage() <= LIMIT,
+                     "a single screen went over the limit");
+    failed |= !check(idle->stats.rows_evicted > 0,
+                     "a single screen didn't evict anything");
+    evicted = idle->stats.rows_evicted;
+
+    /* then the second one pays for its own growth, and the first one
+     * isn't touched while it's idle */
+    busy = vt100_screen_new(24, 80);
+    vt100_screen_set_scrollback_length(busy, 100000);
+    fill(busy, 5000);
+    failed |= !check(vt100_memory_usage() <= LIMIT,
+                     "two screens went over the limit");
+    failed |= !check(busy->stats.rows_evicted > 0,
+                     "the busy screen didn't evict anything");
+    failed |= !check(idle->stats.rows_evicted == evicted,
+                     "the idle screen was evicted from");
+
+    /* a screen with no scrollback to give up can't get the total back
+     * under the limit, which stays over it (it's only best effort) until
+     * the idle screen is checked too */
+    vt100_screen_delete(busy);
+    vt100_set_memory_limit(LIMIT / 2);
+    busy = vt100_screen_new(24, 80);
+    fill(busy, 100);
+    failed |= !check(vt100_memory_usage() > LIMIT / 2,
+                     "a screen got under a limit it couldn't reach");
+    failed |= !check(idle->stats.rows_evicted == evicted,
+                     "the idle screen was evicted from");
+    vt100_screen_check_memory(idle);
+    failed |= !check(vt100_memory_usage() <= LIMIT / 2,
+                     "checking the idle screen didn't get under the limit");
+
+    vt100_screen_delete(busy);
+    vt100_screen_delete(idle);
+    failed |= !check(vt100_memory_usage() == 0,
+                     "deleted screens are still counted");
+    printf("%s\n", failed ? "FAIL" : "ok");
+
+    return failed;
+}
@@ -34,13 +34,13 @@ int main(int argc, char *argv[])
     }
 
     skip = 0;
-    for (i = vt->grid->row_top; i < vt->grid->row_top + vt->grid->max.row; ++i) {
+    for (i = 0; i < vt->grid->max.row; ++i) {
         for (j = 0; j < vt->grid->max.col; ++j) {
             if (skip) {
                 skip = 0;
                 continue;
             }
-            struct vt100_cell *cell = &vt->grid->rows[i].cells[j];
+            struct vt100_cell *cell = vt100_screen_cell_at(vt, i, j);
             printf("%*s", (int)cell->len, cell->contents);
             if (cell->is_wide)
                 skip = 1;
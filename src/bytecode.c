@@ -0,0 +1,371 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vt100.h"
+
+static void vt100_bytecode_ensure_capacity(
+    struct vt100_bytecode *bytecode, size_t size);
+static int vt100_bytecode_read_uint(
+    const char **posp, const char *end, unsigned long *valp);
+static int vt100_bytecode_read_string(
+    const char **posp, const char *end, const char **strp, size_t *lenp);
+static void vt100_bytecode_read_color(
+    const char *buf, struct vt100_color *color);
+
+struct vt100_bytecode *vt100_bytecode_new(void)
+{
+    return calloc(1, sizeof(struct vt100_bytecode));
+}
+
+void vt100_bytecode_delete(struct vt100_bytecode *bytecode)
+{
+    free(bytecode->buf);
+    free(bytecode);
+}
+
+void vt100_screen_compile_to(VT100Screen *vt, struct vt100_bytecode *bytecode)
+{
+    vt->bytecode = bytecode;
+    if (bytecode) {
+        bytecode->attrs = vt->attrs;
+        bytecode->last_move = 0;
+    }
+}
+
+size_t vt100_screen_replay(VT100Screen *vt, const char *buf, size_t len)
+{
+    size_t replayed;
+
+    if (vt->hibernating && !vt100_screen_wake(vt)) {
+        return 0;
+    }
+    vt100_screen_wait_pipeline(vt);
+
+    replayed = vt100_bytecode_replay(vt, buf, len);
+
+    vt100_screen_check_memory(vt);
+    vt100_screen_update_frame(vt);
+    if (vt->events) {
+        vt100_screen_flush_events(vt);
+    }
+
+    return replayed;
+}
+
+/* the replay itself, without publishing anything afterwards, for callers
+ * (like vt100_screen_process_parallel) that replay several pieces at once */
+size_t vt100_bytecode_replay(VT100Screen *vt, const char *buf, size_t len)
+{
+    const char *pos = buf, *end = buf + len;
+
+    while (pos < end) {
+        const char *op = pos++, *str;
+        unsigned long a, b;
+        size_t str_len;
+        int complete = 1;
+
+        switch (*op) {
+        case VT100_OP_PRINT_ASCII:
+            if ((complete = vt100_bytecode_read_string(
+                    &pos, end, &str, &str_len))) {
+                vt100_screen_show_string_ascii(vt, (char *)str, str_len);
+            }
+            break;
+        case VT100_OP_PRINT_UTF8:
+            if ((complete = vt100_bytecode_read_string(
+                    &pos, end, &str, &str_len))) {
+                vt100_screen_show_string_utf8(vt, (char *)str, str_len);
+            }
+            break;
+        case VT100_OP_MOVE_TO:
+            if ((complete = vt100_bytecode_read_uint(&pos, end, &a)
+                         && vt100_bytecode_read_uint(&pos, end, &b))) {
+                /* clamped like CUP, except that positions are absolute and
+                 * the cursor can be left waiting to wrap past the last
+                 * column */
+                vt->grid->cur.row = a >= (unsigned long)vt->grid->max.row
+                    ? vt->grid->max.row - 1 : (int)a;
+                vt->grid->cur.col = b > (unsigned long)vt->grid->max.col
+                    ? vt->grid->max.col : (int)b;
+                vt->grid->cur_from_text = 0;
+            }
+            break;
+        case VT100_OP_LF:
+            vt100_screen_move_down_or_scroll(vt);
+            break;
+        case VT100_OP_RI:
+            vt100_screen_move_up_or_scroll(vt);
+            break;
+        case VT100_OP_ATTRS:
+            if ((complete = end - pos >= 9)) {
+                memset(&vt->attrs, 0, sizeof(struct vt100_cell_attrs));
+                vt100_bytecode_read_color(pos, &vt->attrs.fgcolor);
+                vt100_bytecode_read_color(pos + 4, &vt->attrs.bgcolor);
+                vt->attrs.attrs = pos[8];
+                pos += 9;
+            }
+            break;
+        case VT100_OP_ERASE:
+            if ((complete = vt100_bytecode_read_uint(&pos, end, &a))) {
+                switch (a) {
+                case VT100_ERASE_SCREEN_FORWARD:
+                    vt100_screen_clear_screen_forward(vt);
+                    break;
+                case VT100_ERASE_SCREEN_BACKWARD:
+                    vt100_screen_clear_screen_backward(vt);
+                    break;
+                case VT100_ERASE_SCREEN:
+                    vt100_screen_clear_screen(vt);
+                    break;
+                case VT100_ERASE_LINE_FORWARD:
+                    vt100_screen_kill_line_forward(vt);
+                    break;
+                case VT100_ERASE_LINE_BACKWARD:
+                    vt100_screen_kill_line_backward(vt);
+                    break;
+                case VT100_ERASE_LINE:
+                    vt100_screen_kill_line(vt);
+                    break;
+                }
+            }
+            break;
+        case VT100_OP_INSERT_CHARS:
+        case VT100_OP_DELETE_CHARS:
+        case VT100_OP_ERASE_CHARS:
+        case VT100_OP_INSERT_LINES:
+        case VT100_OP_DELETE_LINES:
+        case VT100_OP_SCROLL_UP:
+        case VT100_OP_SCROLL_DOWN: {
+            int count;
+
+            if (!(complete = vt100_bytecode_read_uint(&pos, end, &a))) {
+                break;
+            }
+            /* the parser never produces a count that doesn't fit in an
+             * int, so this isn't something we compiled */
+            if (a > INT_MAX) {
+                return op - buf;
+            }
+
+            count = (int)a;
+            switch (*op) {
+            case VT100_OP_INSERT_CHARS:
+                vt100_screen_insert_characters(vt, count);
+                break;
+            case VT100_OP_DELETE_CHARS:
+                vt100_screen_delete_characters(vt, count);
+                break;
+            case VT100_OP_ERASE_CHARS:
+                vt100_screen_erase_characters(vt, count);
+                break;
+            case VT100_OP_INSERT_LINES:
+                vt100_screen_insert_lines(vt, count);
+                break;
+            case VT100_OP_DELETE_LINES:
+                vt100_screen_delete_lines(vt, count);
+                break;
+            case VT100_OP_SCROLL_UP:
+                vt100_screen_scroll_up(vt, count);
+                break;
+            case VT100_OP_SCROLL_DOWN:
+                vt100_screen_scroll_down(vt, count);
+                break;
+            }
+            break;
+        }
+        case VT100_OP_TITLE:
+            if ((complete = vt100_bytecode_read_string(
+                    &pos, end, &str, &str_len))) {
+                vt100_screen_set_window_title(vt, (char *)str, str_len);
+            }
+            break;
+        case VT100_OP_ICON_NAME:
+            if ((complete = vt100_bytecode_read_string(
+                    &pos, end, &str, &str_len))) {
+                vt100_screen_set_icon_name(vt, (char *)str, str_len);
+            }
+            break;
+        case VT100_OP_TOKEN:
+            if ((complete = vt100_bytecode_read_uint(&pos, end, &a)
+                         && vt100_bytecode_read_string(
+                                &pos, end, &str, &str_len))) {
+                vt100_parser_apply_token(vt, a, (char *)str, str_len);
+            }
+            break;
+        default:
+            /* not something we know how to interpret, so there's no way to
+             * tell where the next operation starts */
+            return op - buf;
+        }
+
+        if (!complete) {
+            return op - buf;
+        }
+    }
+
+    return len;
+}
+
+void vt100_bytecode_push_op(struct vt100_bytecode *bytecode, int op)
+{
+    vt100_bytecode_ensure_capacity(bytecode, bytecode->len + 1);
+    bytecode->buf[bytecode->len++] = op;
+    bytecode->last_move = 0;
+}
+
+void vt100_bytecode_push_uint(
+    struct vt100_bytecode *bytecode, unsigned long val)
+{
+    vt100_bytecode_ensure_capacity(bytecode, bytecode->len + 10);
+    while (val >= 0x80) {
+        bytecode->buf[bytecode->len++] = (val & 0x7f) | 0x80;
+        val >>= 7;
+    }
+    bytecode->buf[bytecode->len++] = val;
+}
+
+void vt100_bytecode_push_string(
+    struct vt100_bytecode *bytecode, const char *buf, size_t len)
+{
+    vt100_bytecode_push_uint(bytecode, len);
+    vt100_bytecode_ensure_capacity(bytecode, bytecode->len + len);
+    memcpy(bytecode->buf + bytecode->len, buf, len);
+    bytecode->len += len;
+}
+
+void vt100_bytecode_push_move_to(
+    struct vt100_bytecode *bytecode, struct vt100_loc loc)
+{
+    size_t start;
+
+    /* only the last of several cursor movements in a row matters */
+    if (bytecode->last_move) {
+        bytecode->len = bytecode->last_move - 1;
+    }
+
+    start = bytecode->len;
+    vt100_bytecode_push_op(bytecode, VT100_OP_MOVE_TO);
+    vt100_bytecode_push_uint(bytecode, loc.row);
+    vt100_bytecode_push_uint(bytecode, loc.col);
+    bytecode->last_move = start + 1;
+}
+
+void vt100_bytecode_push_attrs(
+    struct vt100_bytecode *bytecode, struct vt100_cell_attrs *attrs)
+{
+    struct vt100_color *colors[2] = { &attrs->fgcolor, &attrs->bgcolor };
+    int i;
+
+    if (!memcmp(&bytecode->attrs, attrs, sizeof(struct vt100_cell_attrs))) {
+        return;
+    }
+    bytecode->attrs = *attrs;
+
+    vt100_bytecode_push_op(bytecode, VT100_OP_ATTRS);
+    vt100_bytecode_ensure_capacity(bytecode, bytecode->len + 9);
+    for (i = 0; i < 2; ++i) {
+        bytecode->buf[bytecode->len++] = colors[i]->r;
+        bytecode->buf[bytecode->len++] = colors[i]->g;
+        bytecode->buf[bytecode->len++] = colors[i]->b;
+        bytecode->buf[bytecode->len++] = colors[i]->type;
+    }
+    bytecode->buf[bytecode->len++] = attrs->attrs;
+}
+
+/* records a token without resolving it against any screen state, so this is
+ * usable from something that's only tokenizing */
+void vt100_bytecode_push_token(
+    struct vt100_bytecode *bytecode, int type, const char *buf, size_t len)
+{
+    switch (type) {
+    case VT100_TOKEN_ASCII:
+        vt100_bytecode_push_op(bytecode, VT100_OP_PRINT_ASCII);
+        vt100_bytecode_push_string(bytecode, buf, len);
+        break;
+    case VT100_TOKEN_TEXT:
+        vt100_bytecode_push_op(bytecode, VT100_OP_PRINT_UTF8);
+        vt100_bytecode_push_string(bytecode, buf, len);
+        break;
+    case VT100_TOKEN_LF:
+        vt100_bytecode_push_op(bytecode, VT100_OP_LF);
+        break;
+    case VT100_TOKEN_RI:
+        vt100_bytecode_push_op(bytecode, VT100_OP_RI);
+        break;
+    default:
+        vt100_bytecode_push_op(bytecode, VT100_OP_TOKEN);
+        vt100_bytecode_push_uint(bytecode, type);
+        vt100_bytecode_push_string(bytecode, buf, len);
+        break;
+    }
+}
+
+static void vt100_bytecode_ensure_capacity(
+    struct vt100_bytecode *bytecode, size_t size)
+{
+    if (bytecode->capacity >= size) {
+        return;
+    }
+
+    if (bytecode->capacity == 0) {
+        bytecode->capacity = 4096;
+    }
+
+    while (bytecode->capacity < size) {
+        bytecode->capacity *= 1.5;
+    }
+
+    bytecode->buf = realloc(bytecode->buf, bytecode->capacity);
+}
+
+static int vt100_bytecode_read_uint(
+    const char **posp, const char *end, unsigned long *valp)
+{
+    const char *pos = *posp;
+    unsigned long val = 0;
+    int shift = 0;
+
+    while (pos < end && shift < 64) {
+        unsigned char byte = *pos++;
+
+        val |= (unsigned long)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *posp = pos;
+            *valp = val;
+            return 1;
+        }
+        shift += 7;
+    }
+
+    return 0;
+}
+
+static int vt100_bytecode_read_string(
+    const char **posp, const char *end, const char **strp, size_t *lenp)
+{
+    const char *pos = *posp;
+    unsigned long len;
+
+    if (!vt100_bytecode_read_uint(&pos, end, &len)) {
+        return 0;
+    }
+    if ((unsigned long)(end - pos) < len) {
+        return 0;
+    }
+
+    *strp = pos;
+    *lenp = len;
+    *posp = pos + len;
+
+    return 1;
+}
+
+static void vt100_bytecode_read_color(
+    const char *buf, struct vt100_color *color)
+{
+    color->r = buf[0];
+    color->g = buf[1];
+    color->b = buf[2];
+    color->type = buf[3];
+}
@@ -0,0 +1,101 @@
+#ifndef _VT100_BYTECODE_H
+#define _VT100_BYTECODE_H
+
+#include <stddef.h>
+
+/* a compiled form of a terminal recording, which can be replayed onto a
+ * screen without going through the lexer again. it records the effect of
+ * each sequence after its parameters have been parsed and resolved against
+ * the screen state at the time, so it only reproduces the original output
+ * when replayed onto a screen in the same state (usually a fresh one of the
+ * same size) as the one that compiled it.
+ *
+ * the format is a flat sequence of operations, each a single opcode byte
+ * followed by its arguments. integers are unsigned LEB128 (seven bits per
+ * byte, least significant group first, high bit set on every byte but the
+ * last), and strings are an integer length followed by that many bytes.
+ *
+ *   PRINT_ASCII  str        print a run of ascii text
+ *   PRINT_UTF8   str        print a run of utf8 text
+ *   MOVE_TO      row col    put the cursor at an absolute position
+ *   LF                      move down a line, scrolling if necessary
+ *   RI                      move up a line, scrolling if necessary
+ *   ATTRS        fg[4] bg[4] flags[1]
+ *                           replace the current text attributes. colors are
+ *                           the r, g, b (or idx) and type bytes of a
+ *                           struct vt100_color, flags the attrs byte of a
+ *                           struct vt100_cell_attrs
+ *   ERASE        kind       0-2: clear the screen forward, backward or
+ *                           entirely, 3-5: the same for the current line
+ *   INSERT_CHARS count
+ *   DELETE_CHARS count
+ *   ERASE_CHARS  count
+ *   INSERT_LINES count
+ *   DELETE_LINES count
+ *   SCROLL_UP    count
+ *   SCROLL_DOWN  count
+ *   TITLE        str        set the window title
+ *   ICON_NAME    str        set the icon name
+ *   TOKEN        type str   anything else: the raw sequence, along with its
+ *                           enum VT100TokenType, to be interpreted as usual
+ */
+enum VT100OpcodeType {
+    VT100_OP_PRINT_ASCII = 1,
+    VT100_OP_PRINT_UTF8,
+    VT100_OP_MOVE_TO,
+    VT100_OP_LF,
+    VT100_OP_RI,
+    VT100_OP_ATTRS,
+    VT100_OP_ERASE,
+    VT100_OP_INSERT_CHARS,
+    VT100_OP_DELETE_CHARS,
+    VT100_OP_ERASE_CHARS,
+    VT100_OP_INSERT_LINES,
+    VT100_OP_DELETE_LINES,
+    VT100_OP_SCROLL_UP,
+    VT100_OP_SCROLL_DOWN,
+    VT100_OP_TITLE,
+    VT100_OP_ICON_NAME,
+    VT100_OP_TOKEN
+};
+
+enum VT100EraseType {
+    VT100_ERASE_SCREEN_FORWARD,
+    VT100_ERASE_SCREEN_BACKWARD,
+    VT100_ERASE_SCREEN,
+    VT100_ERASE_LINE_FORWARD,
+    VT100_ERASE_LINE_BACKWARD,
+    VT100_ERASE_LINE
+};
+
+struct vt100_bytecode {
+    char *buf;
+    size_t len;
+    size_t capacity;
+
+    /* what a replay will have as its current attributes at this point, so
+     * that sgr sequences which don't change anything can be left out */
+    struct vt100_cell_attrs attrs;
+    /* where the last operation started, if it was a MOVE_TO (plus one), so
+     * that a run of cursor movements only needs the final position */
+    size_t last_move;
+};
+
+struct vt100_bytecode *vt100_bytecode_new(void);
+void vt100_bytecode_delete(struct vt100_bytecode *bytecode);
+void vt100_screen_compile_to(VT100Screen *vt, struct vt100_bytecode *bytecode);
+size_t vt100_screen_replay(VT100Screen *vt, const char *buf, size_t len);
+size_t vt100_bytecode_replay(VT100Screen *vt, const char *buf, size_t len);
+void vt100_bytecode_push_op(struct vt100_bytecode *bytecode, int op);
+void vt100_bytecode_push_uint(
+    struct vt100_bytecode *bytecode, unsigned long val);
+void vt100_bytecode_push_string(
+    struct vt100_bytecode *bytecode, const char *buf, size_t len);
+void vt100_bytecode_push_move_to(
+    struct vt100_bytecode *bytecode, struct vt100_loc loc);
+void vt100_bytecode_push_attrs(
+    struct vt100_bytecode *bytecode, struct vt100_cell_attrs *attrs);
+void vt100_bytecode_push_token(
+    struct vt100_bytecode *bytecode, int type, const char *buf, size_t len);
+
+#endif
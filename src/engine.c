@@ -0,0 +1,369 @@
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vt100.h"
+#include "pool.h"
+
+/* how much a session gets to process each time it's run before it has to
+ * let the other sessions on its worker have a turn */
+#define VT100_SESSION_BUDGET_BYTES (64 * 1024)
+#define VT100_SESSION_BUDGET_USEC 1000
+
+struct vt100_session_input {
+    struct vt100_session_input *next;
+    size_t len;
+    /* how much of buf was already processed by an earlier turn */
+    size_t start;
+    char buf[];
+};
+
+struct vt100_session {
+    VT100Engine *engine;
+    VT100Screen *vt;
+
+    struct vt100_session *prev;
+    struct vt100_session *next;
+
+    pthread_mutex_t lock;
+    pthread_cond_t idle;
+
+    struct vt100_session_input *head;
+    struct vt100_session_input *tail;
+
+    /* unparsed bytes from the end of the previous input (a partial escape
+     * sequence or utf8 character), which get prepended to the next one */
+    char *carry;
+    size_t carry_len;
+    size_t carry_capacity;
+
+    vt100_session_callback_t callback;
+    void *callback_data;
+
+    unsigned int scheduled: 1;
+};
+
+struct vt100_engine {
+    struct vt100_pool *pool;
+    struct vt100_budget session_budget;
+
+    pthread_mutex_t lock;
+    struct vt100_session *sessions;
+};
+
+static void vt100_session_run(void *data);
+static int vt100_session_process(
+    VT100Session *session, struct vt100_session_input *input,
+    struct vt100_budget *budget);
+static void vt100_session_ensure_carry_capacity(
+    VT100Session *session, size_t size);
+
+VT100Engine *vt100_engine_new(int nthreads)
+{
+    VT100Engine *engine;
+
+    engine = calloc(1, sizeof(VT100Engine));
+    engine->pool = vt100_pool_new(nthreads);
+    pthread_mutex_init(&engine->lock, NULL);
+    vt100_engine_set_session_budget(
+        engine, VT100_SESSION_BUDGET_BYTES, VT100_SESSION_BUDGET_USEC);
+
+    return engine;
+}
+
+int vt100_engine_thread_count(VT100Engine *engine)
+{
+    return vt100_pool_thread_count(engine->pool);
+}
+
+VT100Session *vt100_engine_add_session(
+    VT100Engine *engine, int rows, int cols,
+    vt100_session_callback_t callback, void *data)
+{
+    return vt100_engine_add_session_with_allocator(
+        engine, rows, cols, callback, data, NULL);
+}
+
+VT100Session *vt100_engine_add_session_with_allocator(
+    VT100Engine *engine, int rows, int cols,
+    vt100_session_callback_t callback, void *data,
+    struct vt100_allocator *allocator)
+{
+    VT100Session *session;
+
+    session = calloc(1, sizeof(VT100Session));
+    session->engine = engine;
+    session->vt = vt100_screen_new_with_allocator(rows, cols, allocator);
+    session->callback = callback;
+    session->callback_data = data;
+    pthread_mutex_init(&session->lock, NULL);
+    pthread_cond_init(&session->idle, NULL);
+
+    pthread_mutex_lock(&engine->lock);
+    session->next = engine->sessions;
+    if (engine->sessions) {
+        engine->sessions->prev = session;
+    }
+    engine->sessions = session;
+    pthread_mutex_unlock(&engine->lock);
+
+    return session;
+}
+
+void vt100_engine_remove_session(VT100Engine *engine, VT100Session *session)
+{
+    vt100_session_wait(session);
+
+    pthread_mutex_lock(&engine->lock);
+    if (session->prev) {
+        session->prev->next = session->next;
+    }
+    else {
+        engine->sessions = session->next;
+    }
+    if (session->next) {
+        session->next->prev = session->prev;
+    }
+    pthread_mutex_unlock(&engine->lock);
+
+    vt100_screen_delete(session->vt);
+    pthread_cond_destroy(&session->idle);
+    pthread_mutex_destroy(&session->lock);
+    free(session->carry);
+    free(session);
+}
+
+/* sets how much input (in bytes and in time) a session may process in one
+ * turn, after which it goes to the back of its worker's queue. a session
+ * that's flooded with output can otherwise keep an interactive one on the
+ * same worker waiting until it has caught up. 0 means no limit. this isn't
+ * synchronized with the workers, so it should be set before any input is
+ * fed to the sessions. */
+void vt100_engine_set_session_budget(
+    VT100Engine *engine, size_t bytes, long usec)
+{
+    engine->session_budget.bytes = bytes ? bytes : SIZE_MAX;
+    engine->session_budget.usec = usec ? usec : LONG_MAX;
+}
+
+void vt100_engine_wait(VT100Engine *engine)
+{
+    VT100Session *session;
+
+    pthread_mutex_lock(&engine->lock);
+    for (session = engine->sessions; session; session = session->next) {
+        vt100_session_wait(session);
+    }
+    pthread_mutex_unlock(&engine->lock);
+}
+
+void vt100_engine_delete(VT100Engine *engine)
+{
+    while (engine->sessions) {
+        vt100_engine_remove_session(engine, engine->sessions);
+    }
+
+    vt100_pool_delete(engine->pool);
+    pthread_mutex_destroy(&engine->lock);
+    free(engine);
+}
+
+VT100Screen *vt100_session_screen(VT100Session *session)
+{
+    return session->vt;
+}
+
+void vt100_session_feed(VT100Session *session, const char *buf, size_t len)
+{
+    struct vt100_session_input *input;
+    int schedule = 0;
+
+    if (!len) {
+        return;
+    }
+
+    input = malloc(sizeof(struct vt100_session_input) + len);
+    input->next = NULL;
+    input->len = len;
+    input->start = 0;
+    memcpy(input->buf, buf, len);
+
+    pthread_mutex_lock(&session->lock);
+    if (session->tail) {
+        session->tail->next = input;
+    }
+    else {
+        session->head = input;
+    }
+    session->tail = input;
+
+    /* a session is only ever queued on the pool once, which is what keeps
+     * its input in order no matter which worker ends up running it */
+    if (!session->scheduled) {
+        session->scheduled = 1;
+        schedule = 1;
+    }
+    pthread_mutex_unlock(&session->lock);
+
+    if (schedule) {
+        vt100_pool_submit(session->engine->pool, vt100_session_run, session);
+    }
+}
+
+int vt100_session_is_idle(VT100Session *session)
+{
+    int idle;
+
+    pthread_mutex_lock(&session->lock);
+    idle = !session->scheduled;
+    pthread_mutex_unlock(&session->lock);
+
+    return idle;
+}
+
+void vt100_session_wait(VT100Session *session)
+{
+    pthread_mutex_lock(&session->lock);
+    while (session->scheduled) {
+        pthread_cond_wait(&session->idle, &session->lock);
+    }
+    pthread_mutex_unlock(&session->lock);
+}
+
+int vt100_session_hibernate(VT100Session *session, int fd)
+{
+    int hibernated = 0;
+
+    /* nothing runs the session while it isn't scheduled, and holding the
+     * lock keeps it from being scheduled until this is done */
+    pthread_mutex_lock(&session->lock);
+    if (!session->scheduled) {
+        hibernated = vt100_screen_hibernate(session->vt, fd);
+    }
+    if (hibernated && !session->carry_len) {
+        free(session->carry);
+        session->carry = NULL;
+        session->carry_capacity = 0;
+    }
+    pthread_mutex_unlock(&session->lock);
+
+    return hibernated;
+}
+
+static void vt100_session_run(void *data)
+{
+    VT100Session *session = data;
+    struct vt100_budget budget = session->engine->session_budget;
+    struct vt100_session_input *input;
+
+    pthread_mutex_lock(&session->lock);
+    input = session->head;
+    session->head = NULL;
+    session->tail = NULL;
+    pthread_mutex_unlock(&session->lock);
+
+    while (input && !vt100_budget_is_spent(&budget)) {
+        struct vt100_session_input *next = input->next;
+
+        if (!vt100_session_process(session, input, &budget)) {
+            break;
+        }
+        free(input);
+        input = next;
+    }
+
+    if (session->callback) {
+        session->callback(session, session->vt, session->callback_data);
+    }
+
+    /* whatever the budget didn't cover goes back in front of anything fed
+     * while we were busy, and the session goes to the back of the queue
+     * rather than being processed again here, so that one noisy session
+     * can't hold on to a worker forever */
+    pthread_mutex_lock(&session->lock);
+    if (input) {
+        struct vt100_session_input *last = input;
+
+        while (last->next) {
+            last = last->next;
+        }
+        last->next = session->head;
+        if (!session->head) {
+            session->tail = last;
+        }
+        session->head = input;
+    }
+    if (session->head) {
+        pthread_mutex_unlock(&session->lock);
+        vt100_pool_yield(session->engine->pool, vt100_session_run, session);
+        return;
+    }
+    session->scheduled = 0;
+    pthread_cond_broadcast(&session->idle);
+    pthread_mutex_unlock(&session->lock);
+}
+
+/* returns 0 if the budget ran out before the end of the input, in which
+ * case input->start is moved past what did get processed */
+static int vt100_session_process(
+    VT100Session *session, struct vt100_session_input *input,
+    struct vt100_budget *budget)
+{
+    char *buf = input->buf + input->start;
+    size_t len = input->len - input->start, carried = session->carry_len;
+    size_t parsed;
+
+    if (carried) {
+        vt100_session_ensure_carry_capacity(session, carried + len);
+        memcpy(session->carry + carried, buf, len);
+        session->carry_len += len;
+        buf = session->carry;
+        len = session->carry_len;
+    }
+
+    parsed = vt100_screen_process_string_budgeted(
+        session->vt, buf, len, budget);
+
+    /* (nothing being parsed at all means it's all one partial escape
+     * sequence, which is a carry no matter what the budget says) */
+    if (parsed && parsed < len && vt100_budget_is_spent(budget)) {
+        if (parsed < carried) {
+            session->carry_len = carried - parsed;
+            memmove(session->carry, session->carry + parsed,
+                    session->carry_len);
+        }
+        else {
+            input->start += parsed - carried;
+            session->carry_len = 0;
+        }
+        return 0;
+    }
+
+    session->carry_len = len - parsed;
+    if (session->carry_len) {
+        vt100_session_ensure_carry_capacity(session, session->carry_len);
+        memmove(session->carry, buf + parsed, session->carry_len);
+    }
+
+    return 1;
+}
+
+static void vt100_session_ensure_carry_capacity(
+    VT100Session *session, size_t size)
+{
+    if (session->carry_capacity >= size) {
+        return;
+    }
+
+    if (session->carry_capacity == 0) {
+        session->carry_capacity = 64;
+    }
+
+    while (session->carry_capacity < size) {
+        session->carry_capacity *= 1.5;
+    }
+
+    session->carry = realloc(session->carry, session->carry_capacity);
+}
@@ -0,0 +1,36 @@
+#ifndef _VT100_ENGINE_H
+#define _VT100_ENGINE_H
+
+#include <stddef.h>
+
+typedef void (*vt100_session_callback_t)(
+    VT100Session *session, VT100Screen *vt, void *data);
+
+VT100Engine *vt100_engine_new(int nthreads);
+int vt100_engine_thread_count(VT100Engine *engine);
+VT100Session *vt100_engine_add_session(
+    VT100Engine *engine, int rows, int cols,
+    vt100_session_callback_t callback, void *data);
+/* the session's screen is created with vt100_screen_new_with_allocator. it's
+ * only ever processed by one of the engine's threads at a time, but not
+ * always the same one. */
+VT100Session *vt100_engine_add_session_with_allocator(
+    VT100Engine *engine, int rows, int cols,
+    vt100_session_callback_t callback, void *data,
+    struct vt100_allocator *allocator);
+void vt100_engine_remove_session(VT100Engine *engine, VT100Session *session);
+void vt100_engine_set_session_budget(
+    VT100Engine *engine, size_t bytes, long usec);
+void vt100_engine_wait(VT100Engine *engine);
+void vt100_engine_delete(VT100Engine *engine);
+
+VT100Screen *vt100_session_screen(VT100Session *session);
+void vt100_session_feed(VT100Session *session, const char *buf, size_t len);
+int vt100_session_is_idle(VT100Session *session);
+void vt100_session_wait(VT100Session *session);
+/* hibernates the session's screen (see vt100_screen_hibernate), unless it
+ * still has input to process, in which case this returns 0. feeding it
+ * more input wakes it up again. */
+int vt100_session_hibernate(VT100Session *session, int fd);
+
+#endif
@@ -0,0 +1,181 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vt100.h"
+
+struct vt100_event_batch {
+    struct vt100_event_batch *next;
+    struct vt100_event *events;
+    size_t nevents;
+    size_t capacity;
+};
+
+/* batches are pushed onto a list that the dispatcher takes all at once, so
+ * neither side ever waits for the other */
+struct vt100_event_queue {
+    _Atomic(struct vt100_event_batch *) head;
+};
+
+static struct vt100_event *vt100_screen_new_event(VT100Screen *vt, int type);
+static void vt100_event_batch_free(struct vt100_event_batch *batch);
+
+struct vt100_event_queue *vt100_event_queue_new(void)
+{
+    struct vt100_event_queue *queue;
+
+    queue = calloc(1, sizeof(struct vt100_event_queue));
+    atomic_init(&queue->head, NULL);
+
+    return queue;
+}
+
+size_t vt100_event_queue_drain(
+    struct vt100_event_queue *queue, vt100_event_callback_t callback,
+    void *data)
+{
+    struct vt100_event_batch *batch, *batches = NULL;
+    size_t count = 0;
+
+    /* the list is newest first, so turn it around */
+    batch = atomic_exchange(&queue->head, NULL);
+    while (batch) {
+        struct vt100_event_batch *next = batch->next;
+
+        batch->next = batches;
+        batches = batch;
+        batch = next;
+    }
+
+    while (batches) {
+        struct vt100_event_batch *next = batches->next;
+        size_t i;
+
+        for (i = 0; i < batches->nevents; ++i) {
+            callback(&batches->events[i], data);
+        }
+        count += batches->nevents;
+        vt100_event_batch_free(batches);
+        batches = next;
+    }
+
+    return count;
+}
+
+void vt100_event_queue_delete(struct vt100_event_queue *queue)
+{
+    struct vt100_event_batch *batch;
+
+    batch = atomic_exchange(&queue->head, NULL);
+    while (batch) {
+        struct vt100_event_batch *next = batch->next;
+
+        vt100_event_batch_free(batch);
+        batch = next;
+    }
+    free(queue);
+}
+
+void vt100_screen_set_event_queue(
+    VT100Screen *vt, struct vt100_event_queue *queue)
+{
+    if (vt->events) {
+        vt100_screen_flush_events(vt);
+    }
+    vt->events = queue;
+}
+
+void vt100_screen_push_event(VT100Screen *vt, int type, int set)
+{
+    vt100_screen_new_event(vt, type)->set = set;
+}
+
+void vt100_screen_push_mode_event(
+    VT100Screen *vt, char prefix, int mode, int set)
+{
+    struct vt100_event *event;
+
+    event = vt100_screen_new_event(vt, VT100_EVENT_MODE);
+    event->prefix = prefix;
+    event->mode = mode;
+    event->set = set;
+}
+
+void vt100_screen_push_string_event(
+    VT100Screen *vt, int type, char *buf, size_t len)
+{
+    struct vt100_event *event;
+
+    event = vt100_screen_new_event(vt, type);
+    event->str = malloc(len);
+    memcpy(event->str, buf, len);
+    event->len = len;
+}
+
+void vt100_screen_flush_events(VT100Screen *vt)
+{
+    struct vt100_event_batch *batch;
+
+    if (vt->dirty) {
+        vt100_screen_push_event(vt, VT100_EVENT_DAMAGE, 0);
+    }
+    vt->audible_bell = 0;
+    vt->visual_bell = 0;
+    vt->update_title = 0;
+    vt->update_icon_name = 0;
+    vt->dirty = 0;
+
+    batch = vt->event_batch;
+    if (!batch) {
+        return;
+    }
+    vt->event_batch = NULL;
+
+    batch->next = atomic_load(&vt->events->head);
+    while (!atomic_compare_exchange_weak(
+               &vt->events->head, &batch->next, batch)) {
+        ;
+    }
+}
+
+void vt100_screen_discard_events(VT100Screen *vt)
+{
+    if (vt->event_batch) {
+        vt100_event_batch_free(vt->event_batch);
+        vt->event_batch = NULL;
+    }
+}
+
+static struct vt100_event *vt100_screen_new_event(VT100Screen *vt, int type)
+{
+    struct vt100_event_batch *batch = vt->event_batch;
+    struct vt100_event *event;
+
+    if (!batch) {
+        batch = calloc(1, sizeof(struct vt100_event_batch));
+        vt->event_batch = batch;
+    }
+    if (batch->nevents == batch->capacity) {
+        batch->capacity = batch->capacity ? batch->capacity * 2 : 8;
+        batch->events = realloc(
+            batch->events, batch->capacity * sizeof(struct vt100_event));
+    }
+
+    event = &batch->events[batch->nevents++];
+    memset(event, 0, sizeof(struct vt100_event));
+    event->vt = vt;
+    event->type = type;
+
+    return event;
+}
+
+static void vt100_event_batch_free(struct vt100_event_batch *batch)
+{
+    size_t i;
+
+    for (i = 0; i < batch->nevents; ++i) {
+        free(batch->events[i].str);
+    }
+    free(batch->events);
+    free(batch);
+}
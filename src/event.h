@@ -0,0 +1,64 @@
+#ifndef _VT100_EVENT_H
+#define _VT100_EVENT_H
+
+#include <stddef.h>
+
+enum vt100_event_type {
+    VT100_EVENT_AUDIBLE_BELL,
+    VT100_EVENT_VISUAL_BELL,
+    VT100_EVENT_TITLE,
+    VT100_EVENT_ICON_NAME,
+    VT100_EVENT_MODE,
+    VT100_EVENT_ALTERNATE_SCREEN,
+    VT100_EVENT_DAMAGE
+};
+
+struct vt100_event {
+    VT100Screen *vt;
+    enum vt100_event_type type;
+    /* for VT100_EVENT_MODE, the mode that was set or reset by SM or RM, and
+     * its prefix ('?' for the private modes, 0 for the ansi ones). set is
+     * also used by VT100_EVENT_ALTERNATE_SCREEN, for which way it went. */
+    int mode;
+    char prefix;
+    int set;
+    /* the new title or icon name, which is only valid during the drain */
+    char *str;
+    size_t len;
+};
+
+typedef void (*vt100_event_callback_t)(struct vt100_event *event, void *data);
+
+struct vt100_event_queue;
+
+/* any number of screens can share an event queue, so one dispatcher can
+ * find out what happened on all of them without polling every screen. each
+ * screen collects its events while it processes a buffer and adds them to
+ * the queue as one batch when it's done (at the same point a frame would be
+ * published), and pushing a batch or draining the queue never blocks.
+ * events from one screen are drained in the order they happened.
+ *
+ * while a screen has an event queue, the flags these events replace
+ * (audible_bell, visual_bell, update_title, update_icon_name and dirty) are
+ * reset each time its events are added to the queue. any batches still in
+ * the queue when a screen is deleted keep its (now dangling) pointer, so
+ * drain the queue first. */
+struct vt100_event_queue *vt100_event_queue_new(void);
+size_t vt100_event_queue_drain(
+    struct vt100_event_queue *queue, vt100_event_callback_t callback,
+    void *data);
+void vt100_event_queue_delete(struct vt100_event_queue *queue);
+void vt100_screen_set_event_queue(
+    VT100Screen *vt, struct vt100_event_queue *queue);
+
+/* these are called by the screen functions and the parser when something
+ * happens, and once the screen has finished with a buffer */
+void vt100_screen_push_event(VT100Screen *vt, int type, int set);
+void vt100_screen_push_mode_event(
+    VT100Screen *vt, char prefix, int mode, int set);
+void vt100_screen_push_string_event(
+    VT100Screen *vt, int type, char *buf, size_t len);
+void vt100_screen_flush_events(VT100Screen *vt);
+void vt100_screen_discard_events(VT100Screen *vt);
+
+#endif
@@ -0,0 +1,145 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "vt100.h"
+
+/* how much of the input is passed to vt100_screen_process_string at once.
+ * the scanner copies each window before scanning it, so this is small
+ * enough for that copy to stay in cache (and for the screen to keep it
+ * around from one window to the next). */
+#define VT100_FILE_WINDOW (256 * 1024)
+
+static ssize_t vt100_file_process_mapped(
+    VT100Screen *vt, int fd, off_t offset, off_t size);
+static ssize_t vt100_file_process_read(VT100Screen *vt, int fd);
+
+ssize_t vt100_screen_process_fd(VT100Screen *vt, int fd)
+{
+    struct stat st;
+    off_t offset;
+    ssize_t left;
+
+    /* files in /proc and /sys say they're empty, but aren't, so those are
+     * read until read says they've ended */
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0
+        && (uintmax_t)st.st_size <= SIZE_MAX
+        && (offset = lseek(fd, 0, SEEK_CUR)) >= 0) {
+        if (offset >= st.st_size) {
+            return 0;
+        }
+        left = vt100_file_process_mapped(vt, fd, offset, st.st_size);
+        if (left >= 0) {
+            return left;
+        }
+    }
+
+    return vt100_file_process_read(vt, fd);
+}
+
+ssize_t vt100_screen_process_file(VT100Screen *vt, const char *path)
+{
+    int fd, saved_errno;
+    ssize_t left;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    left = vt100_screen_process_fd(vt, fd);
+    saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+
+    return left;
+}
+
+/* returns -1 if the file couldn't be mapped, in which case nothing has been
+ * processed yet */
+static ssize_t vt100_file_process_mapped(
+    VT100Screen *vt, int fd, off_t offset, off_t size)
+{
+    size_t pos = offset, len = size, window = VT100_FILE_WINDOW;
+    char *map;
+
+    map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    posix_madvise(map, len, POSIX_MADV_SEQUENTIAL);
+
+    /* the whole file is there to be read, so an escape sequence that runs
+     * off the end of a window is just passed in again as the start of the
+     * next one */
+    while (pos < len) {
+        size_t n = len - pos < window ? len - pos : window, done;
+
+        done = vt100_screen_process_string(vt, map + pos, n);
+        if (!done) {
+            if (pos + n == len) {
+                break;
+            }
+            window *= 2;
+            continue;
+        }
+        window = VT100_FILE_WINDOW;
+        pos += done;
+    }
+
+    munmap(map, len);
+    lseek(fd, pos, SEEK_SET);
+
+    return len - pos;
+}
+
+static ssize_t vt100_file_process_read(VT100Screen *vt, int fd)
+{
+    size_t capacity = VT100_FILE_WINDOW, len = 0;
+    char *buf;
+    ssize_t left;
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    buf = malloc(capacity);
+    for (;;) {
+        ssize_t n;
+        size_t done;
+
+        /* only an escape sequence longer than the whole buffer fills it */
+        if (len == capacity) {
+            capacity *= 2;
+            buf = realloc(buf, capacity);
+        }
+
+        n = read(fd, buf + len, capacity - len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            left = -1;
+            break;
+        }
+        if (n == 0) {
+            /* this fails on a pipe, whose leftovers can't be put back */
+            if (len) {
+                lseek(fd, -(off_t)len, SEEK_CUR);
+            }
+            left = len;
+            break;
+        }
+        len += n;
+
+        done = vt100_screen_process_string(vt, buf, len);
+        memmove(buf, buf + done, len - done);
+        len -= done;
+    }
+    free(buf);
+
+    return left;
+}
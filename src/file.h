@@ -0,0 +1,23 @@
+#ifndef _VT100_FILE_H
+#define _VT100_FILE_H
+
+#include <sys/types.h>
+
+/* processes everything from fd's current offset to the end of the file, a
+ * window at a time. regular files are mapped rather than read, so the only
+ * copy that's made of the input is the scanner's own copy of each window.
+ * anything else (a pipe, say) is read into a buffer instead. either way the
+ * kernel is told it's going to be read sequentially.
+ *
+ * a partial escape sequence at the very end can't be processed yet, so this
+ * returns how many bytes were left over like that (0 if there weren't
+ * any). if fd can seek (a regular file can), its offset is left at the
+ * first of them, so the rest can be processed from there once more has
+ * been written. from a pipe they've already been read, and are lost.
+ * returns -1 if reading failed (with errno set), by which time everything
+ * before that has been processed. */
+ssize_t vt100_screen_process_fd(VT100Screen *vt, int fd);
+/* the same, for the file at path */
+ssize_t vt100_screen_process_file(VT100Screen *vt, const char *path);
+
+#endif
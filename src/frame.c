@@ -0,0 +1,210 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vt100.h"
+
+/* frames are reclaimed without the writer ever waiting for readers: a
+ * reader announces itself in `acquiring` for the short window between
+ * loading `current` and taking its reference, and the writer only drops
+ * its reference to a replaced frame once it has seen that window empty.
+ * until then replaced frames sit on the writer-private retired list. */
+struct vt100_frame_state {
+    _Atomic(struct vt100_frame *) current;
+    atomic_int acquiring;
+
+    struct vt100_frame *retired;
+    unsigned long serial;
+};
+
+static struct vt100_frame *vt100_frame_new(
+    VT100Screen *vt, struct vt100_frame *prev);
+static struct vt100_frame_row *vt100_frame_row_new(
+    struct vt100_row *row, int cols, struct vt100_frame_row *prev);
+static int vt100_frame_row_is_blank(struct vt100_frame_row *row, int cols);
+static void vt100_frame_reclaim(struct vt100_frame_state *state);
+
+void vt100_screen_publish_frame(VT100Screen *vt)
+{
+    struct vt100_frame_state *state = vt->frames;
+    struct vt100_frame *frame, *old;
+
+    old = atomic_load(&state->current);
+    frame = vt100_frame_new(vt, old);
+    frame->serial = ++state->serial;
+
+    old = atomic_exchange(&state->current, frame);
+    if (old) {
+        old->retired_next = state->retired;
+        state->retired = old;
+    }
+
+    vt100_frame_reclaim(state);
+}
+
+/* publishes a new frame if anybody has been reading them, unless that would
+ * show a synchronized update that's still being drawn */
+void vt100_screen_update_frame(VT100Screen *vt)
+{
+    if (!vt100_screen_frames_published(vt)
+        || !vt100_screen_frame_is_complete(vt)) {
+        return;
+    }
+
+    vt100_screen_publish_frame(vt);
+}
+
+struct vt100_frame *vt100_screen_acquire_frame(VT100Screen *vt)
+{
+    struct vt100_frame_state *state = vt->frames;
+    struct vt100_frame *frame;
+
+    atomic_fetch_add(&state->acquiring, 1);
+    frame = atomic_load(&state->current);
+    if (frame) {
+        atomic_fetch_add(&frame->refcount, 1);
+    }
+    atomic_fetch_sub(&state->acquiring, 1);
+
+    return frame;
+}
+
+void vt100_frame_release(struct vt100_frame *frame)
+{
+    int i;
+
+    if (atomic_fetch_sub(&frame->refcount, 1) != 1) {
+        return;
+    }
+
+    for (i = 0; i < frame->max.row; ++i) {
+        struct vt100_frame_row *row = frame->rows[i];
+
+        if (atomic_fetch_sub(&row->refcount, 1) == 1) {
+            free(row);
+        }
+    }
+    free(frame->rows);
+    free(frame);
+}
+
+struct vt100_cell *vt100_frame_cell_at(
+    struct vt100_frame *frame, int row, int col)
+{
+    return &frame->rows[row]->cells[col];
+}
+
+struct vt100_frame_state *vt100_screen_frames_new(void)
+{
+    return calloc(1, sizeof(struct vt100_frame_state));
+}
+
+int vt100_screen_frames_published(VT100Screen *vt)
+{
+    return vt->frames->serial != 0;
+}
+
+void vt100_screen_frames_delete(VT100Screen *vt)
+{
+    struct vt100_frame_state *state = vt->frames;
+    struct vt100_frame *frame;
+
+    /* the screen is going away, so there can't be anybody left in the
+     * middle of acquiring a frame */
+    frame = atomic_load(&state->current);
+    if (frame) {
+        frame->retired_next = state->retired;
+        state->retired = frame;
+    }
+    while ((frame = state->retired)) {
+        state->retired = frame->retired_next;
+        vt100_frame_release(frame);
+    }
+
+    free(state);
+}
+
+static struct vt100_frame *vt100_frame_new(
+    VT100Screen *vt, struct vt100_frame *prev)
+{
+    struct vt100_frame *frame;
+    int i;
+
+    frame = calloc(1, sizeof(struct vt100_frame));
+    atomic_init(&frame->refcount, 1);
+    frame->cur = vt->grid->cur;
+    frame->max = vt->grid->max;
+    frame->hide_cursor = vt->hide_cursor;
+    frame->alternate = vt->alternate != NULL;
+    frame->complete = !vt->synchronized_output;
+
+    /* rows that haven't changed since the previous frame are shared with
+     * it rather than copied */
+    if (prev && (prev->max.row != frame->max.row
+                 || prev->max.col != frame->max.col)) {
+        prev = NULL;
+    }
+
+    frame->rows = malloc(frame->max.row * sizeof(struct vt100_frame_row *));
+    for (i = 0; i < frame->max.row; ++i) {
+        frame->rows[i] = vt100_frame_row_new(
+            &vt->grid->rows[vt->grid->row_top + i], frame->max.col,
+            prev ? prev->rows[i] : NULL);
+    }
+
+    return frame;
+}
+
+static struct vt100_frame_row *vt100_frame_row_new(
+    struct vt100_row *row, int cols, struct vt100_frame_row *prev)
+{
+    struct vt100_frame_row *frame_row;
+    size_t size = cols * sizeof(struct vt100_cell);
+
+    if (prev && prev->wrapped == row->wrapped
+        && (row->cells ? !memcmp(prev->cells, row->cells, size)
+                       : vt100_frame_row_is_blank(prev, cols))) {
+        atomic_fetch_add(&prev->refcount, 1);
+        return prev;
+    }
+
+    frame_row = malloc(sizeof(struct vt100_frame_row) + size);
+    atomic_init(&frame_row->refcount, 1);
+    frame_row->wrapped = row->wrapped;
+    if (row->cells) {
+        memcpy(frame_row->cells, row->cells, size);
+    }
+    else {
+        memset(frame_row->cells, 0, size);
+    }
+
+    return frame_row;
+}
+
+static int vt100_frame_row_is_blank(struct vt100_frame_row *row, int cols)
+{
+    static const struct vt100_cell blank;
+    int i;
+
+    for (i = 0; i < cols; ++i) {
+        if (memcmp(&row->cells[i], &blank, sizeof(struct vt100_cell))) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static void vt100_frame_reclaim(struct vt100_frame_state *state)
+{
+    struct vt100_frame *frame;
+
+    if (atomic_load(&state->acquiring)) {
+        return;
+    }
+
+    while ((frame = state->retired)) {
+        state->retired = frame->retired_next;
+        vt100_frame_release(frame);
+    }
+}
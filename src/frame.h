@@ -0,0 +1,43 @@
+#ifndef _VT100_FRAME_H
+#define _VT100_FRAME_H
+
+#include <stdatomic.h>
+
+struct vt100_frame_row {
+    atomic_int refcount;
+    unsigned int wrapped: 1;
+    struct vt100_cell cells[];
+};
+
+/* a read-only copy of the visible screen. frames are immutable once they
+ * have been published, so any number of threads can read one without
+ * synchronizing with the thread that is feeding the screen. */
+struct vt100_frame {
+    atomic_int refcount;
+    unsigned long serial;
+
+    struct vt100_loc cur;
+    struct vt100_loc max;
+
+    unsigned int hide_cursor: 1;
+    unsigned int alternate: 1;
+    /* unset if this was published partway through a synchronized update,
+     * because the update took too long to finish */
+    unsigned int complete: 1;
+
+    struct vt100_frame_row **rows;
+
+    struct vt100_frame *retired_next;
+};
+
+void vt100_screen_publish_frame(VT100Screen *vt);
+void vt100_screen_update_frame(VT100Screen *vt);
+struct vt100_frame *vt100_screen_acquire_frame(VT100Screen *vt);
+void vt100_frame_release(struct vt100_frame *frame);
+struct vt100_cell *vt100_frame_cell_at(
+    struct vt100_frame *frame, int row, int col);
+struct vt100_frame_state *vt100_screen_frames_new(void);
+int vt100_screen_frames_published(VT100Screen *vt);
+void vt100_screen_frames_delete(VT100Screen *vt);
+
+#endif
@@ -0,0 +1,342 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "vt100.h"
+
+#define VT100_INDEX_MAGIC "VT100IDX"
+#define VT100_INDEX_MAGIC_LEN 8
+#define VT100_INDEX_VERSION 1
+
+static struct vt100_keyframe *vt100_index_push(struct vt100_index *index);
+static int vt100_index_write_all(int fd, const void *buf, size_t len);
+static int vt100_index_read_all(int fd, void *buf, size_t len);
+static char *vt100_index_read_state(int fd, uint64_t len);
+static int vt100_index_write_u64(int fd, uint64_t val);
+static int vt100_index_read_u64(int fd, uint64_t *valp);
+
+struct vt100_index *vt100_index_new(void)
+{
+    return calloc(1, sizeof(struct vt100_index));
+}
+
+void vt100_index_add_keyframe(
+    struct vt100_index *index, VT100Screen *vt, size_t offset, uint64_t time)
+{
+    struct vt100_keyframe *keyframe;
+
+    keyframe = vt100_index_push(index);
+    keyframe->offset = offset;
+    keyframe->time = time;
+    vt100_screen_snapshot(vt, &keyframe->state, &keyframe->state_len);
+}
+
+/* processes the whole recording on vt (which should be in whatever state
+ * playback starts from), taking a keyframe about every `interval` bytes */
+void vt100_index_build(
+    struct vt100_index *index, VT100Screen *vt, char *buf, size_t len,
+    size_t interval)
+{
+    size_t pos = 0;
+
+    vt100_index_add_keyframe(index, vt, 0, 0);
+    while (pos < len) {
+        size_t chunk = interval, parsed;
+
+        /* keyframes have to fall between sequences, so if there isn't a
+         * complete one in this chunk, try a bigger one */
+        for (;;) {
+            if (chunk > len - pos) {
+                chunk = len - pos;
+            }
+            parsed = vt100_screen_process_string(vt, buf + pos, chunk);
+            if (parsed || chunk == len - pos) {
+                break;
+            }
+            chunk *= 2;
+        }
+
+        if (!parsed) {
+            break;
+        }
+        pos += parsed;
+        vt100_index_add_keyframe(index, vt, pos, 0);
+    }
+}
+
+struct vt100_keyframe *vt100_index_find_offset(
+    struct vt100_index *index, size_t offset)
+{
+    int lo = 0, hi = index->nkeyframes;
+
+    /* the last keyframe at or before offset */
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+
+        if (index->keyframes[mid].offset <= offset) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    return lo ? &index->keyframes[lo - 1] : NULL;
+}
+
+struct vt100_keyframe *vt100_index_find_time(
+    struct vt100_index *index, uint64_t time)
+{
+    int lo = 0, hi = index->nkeyframes;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+
+        if (index->keyframes[mid].time <= time) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    return lo ? &index->keyframes[lo - 1] : NULL;
+}
+
+/* puts vt into the state it would be in after processing the first
+ * `offset` bytes of the recording, and returns how far it actually got
+ * (which can be a little short if offset is in the middle of a sequence) */
+size_t vt100_index_seek(
+    struct vt100_index *index, VT100Screen *vt, char *buf, size_t len,
+    size_t offset)
+{
+    struct vt100_keyframe *keyframe;
+
+    if (offset > len) {
+        offset = len;
+    }
+
+    keyframe = vt100_index_find_offset(index, offset);
+    if (!keyframe || !vt100_screen_restore(
+            vt, keyframe->state, keyframe->state_len)) {
+        return 0;
+    }
+
+    return keyframe->offset + vt100_screen_process_string(
+        vt, buf + keyframe->offset, offset - keyframe->offset);
+}
+
+int vt100_index_write(struct vt100_index *index, int fd)
+{
+    int i;
+
+    if (!vt100_index_write_all(fd, VT100_INDEX_MAGIC, VT100_INDEX_MAGIC_LEN)
+        || !vt100_index_write_u64(fd, VT100_INDEX_VERSION)
+        || !vt100_index_write_u64(fd, index->nkeyframes)) {
+        return 0;
+    }
+
+    for (i = 0; i < index->nkeyframes; ++i) {
+        struct vt100_keyframe *keyframe = &index->keyframes[i];
+
+        if (!vt100_index_write_u64(fd, keyframe->offset)
+            || !vt100_index_write_u64(fd, keyframe->time)
+            || !vt100_index_write_u64(fd, keyframe->state_len)
+            || !vt100_index_write_all(
+                fd, keyframe->state, keyframe->state_len)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+struct vt100_index *vt100_index_read(int fd)
+{
+    struct vt100_index *index;
+    char magic[VT100_INDEX_MAGIC_LEN];
+    uint64_t version, count, i;
+
+    if (!vt100_index_read_all(fd, magic, VT100_INDEX_MAGIC_LEN)
+        || memcmp(magic, VT100_INDEX_MAGIC, VT100_INDEX_MAGIC_LEN)
+        || !vt100_index_read_u64(fd, &version)
+        || version != VT100_INDEX_VERSION
+        || !vt100_index_read_u64(fd, &count)) {
+        return NULL;
+    }
+
+    index = vt100_index_new();
+    for (i = 0; i < count; ++i) {
+        struct vt100_keyframe *keyframe = vt100_index_push(index);
+        uint64_t offset, time, state_len;
+
+        if (!vt100_index_read_u64(fd, &offset)
+            || !vt100_index_read_u64(fd, &time)
+            || !vt100_index_read_u64(fd, &state_len)) {
+            vt100_index_delete(index);
+            return NULL;
+        }
+
+        keyframe->offset = offset;
+        keyframe->time = time;
+        keyframe->state_len = state_len;
+        keyframe->state = vt100_index_read_state(fd, state_len);
+        if (!keyframe->state) {
+            vt100_index_delete(index);
+            return NULL;
+        }
+    }
+
+    return index;
+}
+
+void vt100_index_delete(struct vt100_index *index)
+{
+    int i;
+
+    for (i = 0; i < index->nkeyframes; ++i) {
+        free(index->keyframes[i].state);
+    }
+    free(index->keyframes);
+    free(index);
+}
+
+static struct vt100_keyframe *vt100_index_push(struct vt100_index *index)
+{
+    struct vt100_keyframe *keyframe;
+
+    if (index->nkeyframes == index->capacity) {
+        index->capacity = index->capacity ? index->capacity * 2 : 16;
+        index->keyframes = realloc(
+            index->keyframes,
+            index->capacity * sizeof(struct vt100_keyframe));
+    }
+
+    keyframe = &index->keyframes[index->nkeyframes++];
+    memset(keyframe, 0, sizeof(struct vt100_keyframe));
+
+    return keyframe;
+}
+
+static int vt100_index_write_all(int fd, const void *buf, size_t len)
+{
+    const char *pos = buf;
+
+    while (len) {
+        ssize_t bytes = write(fd, pos, len);
+
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        pos += bytes;
+        len -= bytes;
+    }
+
+    return 1;
+}
+
+static int vt100_index_read_all(int fd, void *buf, size_t len)
+{
+    char *pos = buf;
+
+    while (len) {
+        ssize_t bytes = read(fd, pos, len);
+
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        if (bytes == 0) {
+            return 0;
+        }
+        pos += bytes;
+        len -= bytes;
+    }
+
+    return 1;
+}
+
+/* the length comes from the file, so it isn't trusted with an allocation
+ * until it's known that there's that much left to read. when that can't be
+ * known up front (on a pipe, say), the buffer only grows as the data
+ * actually arrives. */
+static char *vt100_index_read_state(int fd, uint64_t len)
+{
+    struct stat st;
+    off_t pos;
+    size_t capacity, done = 0;
+    char *buf;
+
+    if (len > SIZE_MAX) {
+        return NULL;
+    }
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+        && (pos = lseek(fd, 0, SEEK_CUR)) >= 0) {
+        if (pos > st.st_size || len > (uint64_t)(st.st_size - pos)) {
+            return NULL;
+        }
+        buf = malloc(len);
+        if (!vt100_index_read_all(fd, buf, len)) {
+            free(buf);
+            return NULL;
+        }
+        return buf;
+    }
+
+    capacity = len < 65536 ? len : 65536;
+    buf = malloc(capacity);
+    while (done < len) {
+        size_t chunk;
+
+        if (done == capacity) {
+            capacity = len - capacity < capacity ? len : capacity * 2;
+            buf = realloc(buf, capacity);
+        }
+        chunk = capacity - done;
+        if (!vt100_index_read_all(fd, buf + done, chunk)) {
+            free(buf);
+            return NULL;
+        }
+        done += chunk;
+    }
+
+    return buf;
+}
+
+/* fixed width and little endian, so index files are portable */
+static int vt100_index_write_u64(int fd, uint64_t val)
+{
+    unsigned char buf[8];
+    int i;
+
+    for (i = 0; i < 8; ++i) {
+        buf[i] = val >> (i * 8);
+    }
+
+    return vt100_index_write_all(fd, buf, sizeof(buf));
+}
+
+static int vt100_index_read_u64(int fd, uint64_t *valp)
+{
+    unsigned char buf[8];
+    int i;
+
+    if (!vt100_index_read_all(fd, buf, sizeof(buf))) {
+        return 0;
+    }
+
+    *valp = 0;
+    for (i = 0; i < 8; ++i) {
+        *valp |= (uint64_t)buf[i] << (i * 8);
+    }
+
+    return 1;
+}
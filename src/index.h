@@ -0,0 +1,42 @@
+#ifndef _VT100_INDEX_H
+#define _VT100_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* a keyframe is a snapshot of the screen after processing exactly `offset`
+ * bytes of a recording. `time` is whatever the recording uses for
+ * timestamps (or zero if it doesn't have any), and has to be
+ * nondecreasing along with the offsets. */
+struct vt100_keyframe {
+    size_t offset;
+    uint64_t time;
+
+    char *state;
+    size_t state_len;
+};
+
+struct vt100_index {
+    struct vt100_keyframe *keyframes;
+    int nkeyframes;
+    int capacity;
+};
+
+struct vt100_index *vt100_index_new(void);
+void vt100_index_add_keyframe(
+    struct vt100_index *index, VT100Screen *vt, size_t offset, uint64_t time);
+void vt100_index_build(
+    struct vt100_index *index, VT100Screen *vt, char *buf, size_t len,
+    size_t interval);
+struct vt100_keyframe *vt100_index_find_offset(
+    struct vt100_index *index, size_t offset);
+struct vt100_keyframe *vt100_index_find_time(
+    struct vt100_index *index, uint64_t time);
+size_t vt100_index_seek(
+    struct vt100_index *index, VT100Screen *vt, char *buf, size_t len,
+    size_t offset);
+int vt100_index_write(struct vt100_index *index, int fd);
+struct vt100_index *vt100_index_read(int fd);
+void vt100_index_delete(struct vt100_index *index);
+
+#endif
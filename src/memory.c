@@ -0,0 +1,258 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vt100.h"
+#include "probes.h"
+
+/* what every screen last reported, added up */
+static atomic_size_t vt100_memory_total;
+static atomic_size_t vt100_memory_limit;
+
+static size_t vt100_memory_report(VT100Screen *vt);
+static size_t vt100_memory_screen(VT100Screen *vt);
+static size_t vt100_memory_grid(struct vt100_grid *grid);
+static void vt100_memory_evict(VT100Screen *vt, size_t excess);
+static void vt100_memory_count_grid(struct vt100_grid *grid);
+
+size_t vt100_screen_memory_usage(VT100Screen *vt, struct vt100_memory *memory)
+{
+    struct vt100_memory unused;
+    struct vt100_grid *grid;
+    int i;
+
+    vt100_screen_wait_pipeline(vt);
+
+    if (!memory) {
+        memory = &unused;
+    }
+
+    /* only the rows on the screen are walked, since the scrollback is
+     * everything else. a hibernating screen has no grids at all. */
+    grid = vt->grid;
+    memory->grid = vt100_memory_grid(grid);
+    for (i = 0; grid && i < grid->row_top; ++i) {
+        memory->grid -= sizeof(struct vt100_row);
+        if (grid->rows[i].cells) {
+            memory->grid -= grid->rows[i].ncells * sizeof(struct vt100_cell);
+        }
+    }
+    memory->scrollback = vt100_memory_grid(grid) - memory->grid;
+
+    memory->screen = vt100_memory_screen(vt);
+    memory->alternate = vt100_memory_grid(vt->alternate)
+        + vt100_memory_grid(vt->spare);
+    memory->undo = vt100_undo_memory_usage(vt);
+    memory->total = memory->screen + memory->grid + memory->scrollback
+        + memory->alternate + memory->undo;
+
+    vt100_memory_report(vt);
+
+    return memory->total;
+}
+
+void vt100_screen_set_memory_limit(VT100Screen *vt, size_t limit)
+{
+    vt100_screen_wait_pipeline(vt);
+    vt->memory_limit = limit;
+}
+
+void vt100_set_memory_limit(size_t limit)
+{
+    atomic_store(&vt100_memory_limit, limit);
+}
+
+size_t vt100_memory_usage(void)
+{
+    return atomic_load(&vt100_memory_total);
+}
+
+/* calloc and realloc from the C library are used directly when there's no
+ * allocator, rather than through wrappers, since rows are allocated (and
+ * zeroed) a lot */
+void *vt100_screen_malloc(VT100Screen *vt, size_t size)
+{
+    if (!vt->allocator.malloc) {
+        return malloc(size);
+    }
+
+    return vt->allocator.malloc(size, vt->allocator.data);
+}
+
+void *vt100_screen_calloc(VT100Screen *vt, size_t nmemb, size_t size)
+{
+    void *ptr;
+
+    if (!vt->allocator.malloc) {
+        return calloc(nmemb, size);
+    }
+
+    ptr = vt->allocator.malloc(nmemb * size, vt->allocator.data);
+    memset(ptr, 0, nmemb * size);
+
+    return ptr;
+}
+
+void *vt100_screen_realloc(VT100Screen *vt, void *ptr, size_t size)
+{
+    if (!vt->allocator.malloc) {
+        return realloc(ptr, size);
+    }
+
+    return vt->allocator.realloc(ptr, size, vt->allocator.data);
+}
+
+void vt100_screen_free(VT100Screen *vt, void *ptr)
+{
+    if (!vt->allocator.malloc) {
+        free(ptr);
+        return;
+    }
+
+    vt->allocator.free(ptr, vt->allocator.data);
+}
+
+void vt100_screen_check_memory(VT100Screen *vt)
+{
+    size_t limit = atomic_load(&vt100_memory_limit), total, excess = 0;
+
+    total = vt100_memory_report(vt);
+
+    /* a tenth more than is needed is thrown away, so that a screen that's
+     * steadily scrolling doesn't have to do this after every buffer */
+    if (vt->memory_limit && vt->memory_reported > vt->memory_limit) {
+        excess = vt->memory_reported - vt->memory_limit
+            + vt->memory_limit / 10;
+    }
+    if (limit && total > limit
+        && total - limit + vt->memory_reported / 10 > excess) {
+        excess = total - limit + vt->memory_reported / 10;
+    }
+    if (!excess) {
+        return;
+    }
+
+    vt100_memory_evict(vt, excess);
+    vt100_memory_report(vt);
+}
+
+void vt100_screen_forget_memory(VT100Screen *vt)
+{
+    atomic_fetch_sub(&vt100_memory_total, vt->memory_reported);
+    vt->memory_reported = 0;
+}
+
+void vt100_screen_count_cells(VT100Screen *vt)
+{
+    vt100_memory_count_grid(vt->grid);
+    vt100_memory_count_grid(vt->alternate);
+    vt100_memory_count_grid(vt->spare);
+}
+
+/* updates the process-wide total with what the screen is using now, and
+ * returns the new total. this only uses what's already been counted, so
+ * it's cheap enough to do after every buffer. */
+static size_t vt100_memory_report(VT100Screen *vt)
+{
+    size_t usage, delta;
+
+    usage = vt100_memory_screen(vt)
+        + vt100_memory_grid(vt->grid)
+        + vt100_memory_grid(vt->alternate)
+        + vt100_memory_grid(vt->spare)
+        + vt100_undo_memory_usage(vt);
+
+    /* this wraps around if the screen is using less than it was, which
+     * takes the difference off the total just the same */
+    delta = usage - vt->memory_reported;
+    vt->memory_reported = usage;
+
+    return atomic_fetch_add(&vt100_memory_total, delta) + delta;
+}
+
+static size_t vt100_memory_screen(VT100Screen *vt)
+{
+    return sizeof(VT100Screen)
+        + vt100_screen_parser_memory_usage(vt)
+        + vt->title_len
+        + vt->icon_name_len;
+}
+
+static size_t vt100_memory_grid(struct vt100_grid *grid)
+{
+    if (!grid) {
+        return 0;
+    }
+
+    return sizeof(struct vt100_grid)
+        + grid->row_capacity * sizeof(struct vt100_row)
+        + grid->cell_count * sizeof(struct vt100_cell);
+}
+
+/* throws away the oldest rows of the normal screen's scrollback, until
+ * their cells add up to at least excess bytes or there are none left. the
+ * row array itself is left the size it is, since scrolling would only grow
+ * it again. */
+static void vt100_memory_evict(VT100Screen *vt, size_t excess)
+{
+    struct vt100_grid *grid = vt->alternate ? vt->alternate : vt->grid;
+    size_t freed = 0;
+    int count = 0, i;
+
+    /* the undo log can only put back rows trimmed from the grid that's
+     * being shown, and only as part of a step */
+    if (vt->undo && (vt->alternate || !vt100_screen_undo_steps(vt))) {
+        return;
+    }
+
+    while (count < grid->row_top && freed < excess) {
+        struct vt100_row *row = &grid->rows[count++];
+
+        if (row->cells) {
+            freed += row->ncells * sizeof(struct vt100_cell);
+        }
+    }
+    if (!count) {
+        return;
+    }
+
+    if (vt->undo) {
+        vt100_undo_trim(vt, count, 0);
+    }
+    for (i = 0; i < count; ++i) {
+        if (grid->rows[i].cells) {
+            grid->cell_count -= grid->rows[i].ncells;
+            vt100_screen_free(vt, grid->rows[i].cells);
+            vt->stats.rows_freed++;
+        }
+    }
+    VT100_PROBE2(row__free, vt, count);
+    memmove(
+        &grid->rows[0], &grid->rows[count],
+        (grid->row_count - count) * sizeof(struct vt100_row));
+    memset(
+        &grid->rows[grid->row_count - count], 0,
+        count * sizeof(struct vt100_row));
+
+    grid->row_count -= count;
+    grid->row_top -= count;
+    grid->reflow_pending = grid->reflow_pending > count
+        ? grid->reflow_pending - count : 0;
+    vt->stats.rows_evicted += count;
+}
+
+static void vt100_memory_count_grid(struct vt100_grid *grid)
+{
+    int i;
+
+    if (!grid) {
+        return;
+    }
+
+    grid->cell_count = 0;
+    for (i = 0; i < grid->row_count; ++i) {
+        if (grid->rows[i].cells) {
+            grid->cell_count += grid->rows[i].ncells;
+        }
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef _VT100_MEMORY_H
+#define _VT100_MEMORY_H
+
+#include <stddef.h>
+
+/* where a screen gets its memory from: its grids and their rows, the
+ * title and icon name, the undo log, the scanner's buffers, and the strings
+ * from vt100_screen_get_string_formatted and _plaintext (so free those with
+ * it too). frames, events and a pipeline's tokens can outlive the screen or
+ * be freed on another thread, so they still come from malloc. each function
+ * is passed data. with a pipeline running, the scanner's buffers are
+ * allocated on the calling thread while the pipeline thread is allocating
+ * rows, so the allocator has to be safe to use from both at once. */
+struct vt100_allocator {
+    void *(*malloc)(size_t size, void *data);
+    void *(*realloc)(void *ptr, size_t size, void *data);
+    void (*free)(void *ptr, void *data);
+    void *data;
+};
+
+/* how much a screen has allocated, in bytes. published frames belong to
+ * whoever is reading them, so they aren't counted, and neither are events
+ * waiting in a queue or tokens waiting in a pipeline. */
+struct vt100_memory {
+    /* the screen itself, its scanner, and its title and icon name */
+    size_t screen;
+    /* the rows on the screen, and the ones above it */
+    size_t grid;
+    size_t scrollback;
+    /* the grid that isn't being shown: the normal screen while the
+     * alternate screen is active, and the alternate screen (which is kept
+     * to be switched back to) while it isn't */
+    size_t alternate;
+    size_t undo;
+    size_t total;
+};
+
+/* a NULL allocator is the same as vt100_screen_new, which uses malloc */
+VT100Screen *vt100_screen_new_with_allocator(
+    int rows, int cols, struct vt100_allocator *allocator);
+
+/* returns the total, and fills in memory with where it went if it isn't
+ * NULL */
+size_t vt100_screen_memory_usage(VT100Screen *vt, struct vt100_memory *memory);
+/* once a screen has finished with a buffer (or with a pipeline, whenever
+ * the pipeline thread catches up) and is using more than limit bytes, the
+ * oldest rows in its normal screen's scrollback are thrown away until it's
+ * using a tenth less than that (so this doesn't happen again on the very
+ * next buffer). it can go over the limit by as much as one buffer adds
+ * before then, and the scrollback is all that gets thrown away, so leave
+ * room for the rest (including the undo log's max_bytes, if there is one).
+ * with an undo log running, nothing is thrown away while the alternate
+ * screen is active. 0, the default, means no limit. */
+void vt100_screen_set_memory_limit(VT100Screen *vt, size_t limit);
+/* the same, but for all of the screens in the process together. each
+ * screen adds what it's using to the total once it has finished with a
+ * buffer, and if that takes the total over the limit, that screen throws
+ * away scrollback until the total is back under it (or it has none left),
+ * so the screens that are growing are the ones that pay for it.
+ *
+ * this is only best effort: a screen never touches another screen's rows
+ * (which could be in use on another thread), so idle screens keep all of
+ * their scrollback. if the screen that takes the total over has nothing it
+ * can throw away (no scrollback, or an undo log on the alternate screen),
+ * the total stays over the limit until some other screen processes more
+ * output. to make an idle screen give back its share, call
+ * vt100_screen_check_memory on it from the thread that owns it. */
+void vt100_set_memory_limit(size_t limit);
+size_t vt100_memory_usage(void);
+
+void *vt100_screen_malloc(VT100Screen *vt, size_t size);
+void *vt100_screen_calloc(VT100Screen *vt, size_t nmemb, size_t size);
+void *vt100_screen_realloc(VT100Screen *vt, void *ptr, size_t size);
+void vt100_screen_free(VT100Screen *vt, void *ptr);
+
+/* these are called when a screen has finished with a buffer, and when it's
+ * deleted. vt100_screen_check_memory can also be called on a screen that
+ * isn't processing anything, to hold it to the limits above. */
+void vt100_screen_check_memory(VT100Screen *vt);
+void vt100_screen_forget_memory(VT100Screen *vt);
+/* counts the cells in all of the screen's grids again, after something
+ * changed them without keeping count */
+void vt100_screen_count_cells(VT100Screen *vt);
+size_t vt100_screen_parser_memory_usage(VT100Screen *vt);
+void vt100_screen_free_scan_buffer(VT100Screen *vt);
+size_t vt100_parser_memory_usage(void *scanner);
+
+#endif
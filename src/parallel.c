@@ -0,0 +1,209 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vt100.h"
+#include "parser.h"
+#include "pool.h"
+
+#define VT100_PARALLEL_MIN_CHUNK (1 << 16)
+#define VT100_PARALLEL_MAX_CHUNK (1 << 24)
+/* CSI parameters longer than this are treated as though they might still be
+ * part of an escape sequence, just to bound how far back we look */
+#define VT100_PARALLEL_MAX_LOOKBEHIND 256
+
+struct vt100_parallel_chunk {
+    struct vt100_parallel *parallel;
+
+    const char *buf;
+    size_t len;
+
+    struct vt100_bytecode *tokens;
+    /* the tokens and diagnostics counted on the stand-in screen */
+    struct vt100_stats stats;
+    size_t remaining;
+    int done;
+};
+
+struct vt100_parallel {
+    VT100Screen *vt;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+};
+
+static size_t vt100_parallel_next_resync(
+    const char *buf, size_t len, size_t pos);
+static int vt100_parallel_is_resync(const char *buf, size_t pos);
+static void vt100_parallel_tokenize(void *data);
+
+/* the scanner has no state between tokens, so input can be split anywhere
+ * that a token is guaranteed to start. each piece is tokenized on its own
+ * worker, and the resulting token streams are then applied to the screen
+ * in order as they become available, which gives exactly the same result
+ * as processing everything in one go. */
+size_t vt100_screen_process_parallel(
+    VT100Screen *vt, const char *buf, size_t len, int nthreads)
+{
+    struct vt100_parallel parallel;
+    struct vt100_parallel_chunk *chunks = NULL;
+    struct vt100_pool *pool;
+    size_t chunk_size, pos, consumed = 0;
+    int nchunks = 0, chunks_capacity = 0, submitted, window, stopped = 0, i;
+    unsigned long start = vt->timing ? vt100_stats_clock() : 0;
+
+    if (vt->hibernating && !vt100_screen_wake(vt)) {
+        return 0;
+    }
+    vt100_screen_wait_pipeline(vt);
+
+    pool = vt100_pool_new(nthreads);
+    nthreads = vt100_pool_thread_count(pool);
+    parallel.vt = vt;
+    pthread_mutex_init(&parallel.lock, NULL);
+    pthread_cond_init(&parallel.done, NULL);
+
+    chunk_size = len / (nthreads * 4);
+    if (chunk_size < VT100_PARALLEL_MIN_CHUNK) {
+        chunk_size = VT100_PARALLEL_MIN_CHUNK;
+    }
+    if (chunk_size > VT100_PARALLEL_MAX_CHUNK) {
+        chunk_size = VT100_PARALLEL_MAX_CHUNK;
+    }
+
+    for (pos = 0; pos < len; ) {
+        size_t end = pos + chunk_size < len
+            ? vt100_parallel_next_resync(buf, len, pos + chunk_size) : len;
+
+        if (nchunks == chunks_capacity) {
+            chunks_capacity = chunks_capacity ? chunks_capacity * 2 : 16;
+            chunks = realloc(
+                chunks, chunks_capacity * sizeof(struct vt100_parallel_chunk));
+        }
+        memset(&chunks[nchunks], 0, sizeof(struct vt100_parallel_chunk));
+        chunks[nchunks].parallel = &parallel;
+        chunks[nchunks].buf = buf + pos;
+        chunks[nchunks].len = end - pos;
+        nchunks++;
+        pos = end;
+    }
+
+    /* only keep a few chunks ahead of the one being applied, so that the
+     * token streams for a huge input don't all have to exist at once */
+    window = nthreads * 2;
+    for (submitted = 0; submitted < nchunks && submitted < window; ++submitted) {
+        vt100_pool_submit(pool, vt100_parallel_tokenize, &chunks[submitted]);
+    }
+
+    for (i = 0; i < submitted; ++i) {
+        struct vt100_parallel_chunk *chunk = &chunks[i];
+
+        pthread_mutex_lock(&parallel.lock);
+        while (!chunk->done) {
+            pthread_cond_wait(&parallel.done, &parallel.lock);
+        }
+        pthread_mutex_unlock(&parallel.lock);
+
+        /* the scanner gives up early on some malformed input, and anything
+         * after that point wouldn't have been processed either */
+        if (!stopped) {
+            vt100_stats_add(&vt->stats, &chunk->stats);
+            vt100_bytecode_replay(vt, chunk->tokens->buf, chunk->tokens->len);
+            consumed += chunk->len - chunk->remaining;
+            if (chunk->remaining) {
+                stopped = 1;
+            }
+        }
+        vt100_bytecode_delete(chunk->tokens);
+
+        if (!stopped && submitted < nchunks) {
+            vt100_pool_submit(
+                pool, vt100_parallel_tokenize, &chunks[submitted++]);
+        }
+    }
+
+    vt100_pool_delete(pool);
+    pthread_cond_destroy(&parallel.done);
+    pthread_mutex_destroy(&parallel.lock);
+    free(chunks);
+
+    vt->stats.bytes += consumed;
+    if (consumed < len) {
+        vt->stats.carryovers++;
+    }
+    if (vt->timing) {
+        vt100_stats_add_time(&vt->stats.process, start);
+    }
+
+    vt100_screen_check_memory(vt);
+    vt100_screen_update_frame(vt);
+    if (vt->events) {
+        vt100_screen_flush_events(vt);
+    }
+
+    return consumed;
+}
+
+static size_t vt100_parallel_next_resync(
+    const char *buf, size_t len, size_t pos)
+{
+    while (pos < len) {
+        const char *lf;
+
+        lf = memchr(buf + pos, '\n', len - pos);
+        if (!lf) {
+            break;
+        }
+
+        pos = lf - buf + 1;
+        if (vt100_parallel_is_resync(buf, pos)) {
+            return pos;
+        }
+    }
+
+    return len;
+}
+
+/* pos is just after a newline, which is always a token of its own unless
+ * it's terminating an escape sequence (like \e\n or \e[12\n) */
+static int vt100_parallel_is_resync(const char *buf, size_t pos)
+{
+    size_t i = pos - 1;
+
+    while (i > 0 && buf[i - 1] && strchr("0123456789;<=?[", buf[i - 1])) {
+        if (pos - i > VT100_PARALLEL_MAX_LOOKBEHIND) {
+            return 0;
+        }
+        i--;
+    }
+
+    return i == 0 || buf[i - 1] != '\033';
+}
+
+static void vt100_parallel_tokenize(void *data)
+{
+    struct vt100_parallel_chunk *chunk = data;
+    struct vt100_parallel *parallel = chunk->parallel;
+    VT100Screen shadow;
+    yyscan_t scanner;
+    YY_BUFFER_STATE state;
+
+    /* the scanner needs a screen to hand its tokens to, but this one just
+     * records them. its diagnostics go to the real screen's callback (the
+     * sink does its own locking), although not necessarily in order. */
+    memset(&shadow, 0, sizeof(VT100Screen));
+    shadow.deferred = chunk->tokens = vt100_bytecode_new();
+    shadow.diagnostics = parallel->vt->diagnostics;
+    shadow.owner = parallel->vt;
+
+    vt100_parser_yylex_init_extra(&shadow, &scanner);
+    state = vt100_parser_yy_scan_bytes(chunk->buf, chunk->len, scanner);
+    chunk->remaining = vt100_parser_yylex(scanner);
+    chunk->stats = shadow.stats;
+    vt100_parser_yy_delete_buffer(state, scanner);
+    vt100_parser_yylex_destroy(scanner);
+
+    pthread_mutex_lock(&parallel->lock);
+    chunk->done = 1;
+    pthread_cond_broadcast(&parallel->done);
+    pthread_mutex_unlock(&parallel->lock);
+}
@@ -0,0 +1,9 @@
+#ifndef _VT100_PARALLEL_H
+#define _VT100_PARALLEL_H
+
+#include <stddef.h>
+
+size_t vt100_screen_process_parallel(
+    VT100Screen *vt, const char *buf, size_t len, int nthreads);
+
+#endif
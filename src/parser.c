@@ -854,18 +854,24 @@ static const flex_int16_t yy_chk[775] =
 #define YY_RESTORE_YY_MORE_OFFSET
 #line 1 "src/parser.l"
 #line 2 "src/parser.l"
+#include <limits.h>
 #include <string.h>
 
 #include "vt100.h"
+#include "probes.h"
 
 #define UNUSED(x) ((void)x)
 
 #define VT100_PARSER_CSI_MAX_PARAMS 256
 
 #define YY_EXIT_FAILURE (UNUSED(yyscanner), 2)
-#line 866 "src/parser.c"
+#line 868 "src/parser.c"
 #define YY_NO_INPUT 1
-#line 93 "src/parser.l"
+#line 95 "src/parser.l"
+static void vt100_parser_dispatch(
+    VT100Screen *vt, int type, char *buf, size_t len);
+static void vt100_parser_compile_token(
+    VT100Screen *vt, int type, char *buf, size_t len);
 static void vt100_parser_handle_bel(VT100Screen *vt);
 static void vt100_parser_handle_bs(VT100Screen *vt);
 static void vt100_parser_handle_tab(VT100Screen *vt);
@@ -879,9 +885,11 @@ static void vt100_parser_handle_vb(VT100Screen *vt);
 static void vt100_parser_handle_decsc(VT100Screen *vt);
 static void vt100_parser_handle_decrc(VT100Screen *vt);
 static void vt100_parser_extract_csi_params(
-    char *buf, size_t len, int *params, int *nparams);
+    VT100Screen *vt, const char *buf, size_t len, int *params, int *nparams);
 static void vt100_parser_extract_sm_params(
-    char *buf, size_t len, char *modes, int *params, int *nparams);
+    VT100Screen *vt, const char *buf, size_t len, char *modes, int *params,
+    int *nparams);
+static int vt100_parser_atoi(const char *pos, const char *end);
 static void vt100_parser_handle_ich(VT100Screen *vt, char *buf, size_t len);
 static void vt100_parser_handle_cuu(VT100Screen *vt, char *buf, size_t len);
 static void vt100_parser_handle_cud(VT100Screen *vt, char *buf, size_t len);
@@ -902,6 +910,7 @@ static void vt100_parser_handle_sm(VT100Screen *vt, char *buf, size_t len);
 static void vt100_parser_handle_rm(VT100Screen *vt, char *buf, size_t len);
 static void vt100_parser_handle_sgr(VT100Screen *vt, char *buf, size_t len);
 static void vt100_parser_handle_csr(VT100Screen *vt, char *buf, size_t len);
+static void vt100_parser_handle_decslrm(VT100Screen *vt, char *buf, size_t len);
 static void vt100_parser_handle_decsed(VT100Screen *vt, char *buf, size_t len);
 static void vt100_parser_handle_decsel(VT100Screen *vt, char *buf, size_t len);
 static void vt100_parser_handle_osc0(VT100Screen *vt, char *buf, size_t len);
@@ -909,8 +918,8 @@ static void vt100_parser_handle_osc1(VT100Screen *vt, char *buf, size_t len);
 static void vt100_parser_handle_osc2(VT100Screen *vt, char *buf, size_t len);
 static void vt100_parser_handle_ascii(VT100Screen *vt, char *text, size_t len);
 static void vt100_parser_handle_text(VT100Screen *vt, char *text, size_t len);
-#line 912 "src/parser.c"
-#line 913 "src/parser.c"
+#line 921 "src/parser.c"
+#line 922 "src/parser.c"
 
 #define INITIAL 0
 
@@ -1166,10 +1175,10 @@ YY_DECL
 		}
 
 	{
-#line 138 "src/parser.l"
+#line 147 "src/parser.l"
 
 
-#line 1172 "src/parser.c"
+#line 1181 "src/parser.c"
 
 	while ( /*CONSTCOND*/1 )		/* loops until end-of-file is reached */
 		{
@@ -1224,269 +1233,279 @@ do_action:	/* This label is used only to access EOF actions. */
 
 case 1:
 YY_RULE_SETUP
-#line 140 "src/parser.l"
-vt100_parser_handle_bel(yyextra);
+#line 149 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_BEL, yytext, yyleng);
 	YY_BREAK
 case 2:
 YY_RULE_SETUP
-#line 141 "src/parser.l"
-vt100_parser_handle_bs(yyextra);
+#line 150 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_BS, yytext, yyleng);
 	YY_BREAK
 case 3:
 YY_RULE_SETUP
-#line 142 "src/parser.l"
-vt100_parser_handle_tab(yyextra);
+#line 151 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_TAB, yytext, yyleng);
 	YY_BREAK
 case 4:
 /* rule 4 can match eol */
-#line 144 "src/parser.l"
+#line 153 "src/parser.l"
 case 5:
 /* rule 5 can match eol */
-#line 145 "src/parser.l"
+#line 154 "src/parser.l"
 case 6:
 /* rule 6 can match eol */
 YY_RULE_SETUP
-#line 145 "src/parser.l"
-vt100_parser_handle_lf(yyextra);
+#line 154 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_LF, yytext, yyleng);
 	YY_BREAK
 case 7:
 YY_RULE_SETUP
-#line 146 "src/parser.l"
-vt100_parser_handle_cr(yyextra);
+#line 155 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_CR, yytext, yyleng);
 	YY_BREAK
 case 8:
 YY_RULE_SETUP
-#line 147 "src/parser.l"
+#line 156 "src/parser.l"
 /* ignored */
 	YY_BREAK
 case 9:
 YY_RULE_SETUP
-#line 149 "src/parser.l"
-vt100_parser_handle_deckpam(yyextra);
+#line 158 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_DECKPAM, yytext, yyleng);
 	YY_BREAK
 case 10:
 YY_RULE_SETUP
-#line 150 "src/parser.l"
-vt100_parser_handle_deckpnm(yyextra);
+#line 159 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_DECKPNM, yytext, yyleng);
 	YY_BREAK
 case 11:
 YY_RULE_SETUP
-#line 151 "src/parser.l"
-vt100_parser_handle_ri(yyextra);
+#line 160 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_RI, yytext, yyleng);
 	YY_BREAK
 case 12:
 YY_RULE_SETUP
-#line 152 "src/parser.l"
-vt100_parser_handle_ris(yyextra);
+#line 161 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_RIS, yytext, yyleng);
 	YY_BREAK
 case 13:
 YY_RULE_SETUP
-#line 153 "src/parser.l"
-vt100_parser_handle_vb(yyextra);
+#line 162 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_VB, yytext, yyleng);
 	YY_BREAK
 case 14:
 YY_RULE_SETUP
-#line 154 "src/parser.l"
-vt100_parser_handle_decsc(yyextra);
+#line 163 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_DECSC, yytext, yyleng);
 	YY_BREAK
 case 15:
 YY_RULE_SETUP
-#line 155 "src/parser.l"
-vt100_parser_handle_decrc(yyextra);
+#line 164 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_DECRC, yytext, yyleng);
 	YY_BREAK
 case 16:
 YY_RULE_SETUP
-#line 157 "src/parser.l"
-vt100_parser_handle_ich(yyextra, yytext, yyleng);
+#line 166 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_ICH, yytext, yyleng);
 	YY_BREAK
 case 17:
 YY_RULE_SETUP
-#line 158 "src/parser.l"
-vt100_parser_handle_cuu(yyextra, yytext, yyleng);
+#line 167 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_CUU, yytext, yyleng);
 	YY_BREAK
 case 18:
 YY_RULE_SETUP
-#line 159 "src/parser.l"
-vt100_parser_handle_cud(yyextra, yytext, yyleng);
+#line 168 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_CUD, yytext, yyleng);
 	YY_BREAK
 case 19:
 YY_RULE_SETUP
-#line 160 "src/parser.l"
-vt100_parser_handle_cuf(yyextra, yytext, yyleng);
+#line 169 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_CUF, yytext, yyleng);
 	YY_BREAK
 case 20:
 YY_RULE_SETUP
-#line 161 "src/parser.l"
-vt100_parser_handle_cub(yyextra, yytext, yyleng);
+#line 170 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_CUB, yytext, yyleng);
 	YY_BREAK
 case 21:
 YY_RULE_SETUP
-#line 162 "src/parser.l"
-vt100_parser_handle_cha(yyextra, yytext, yyleng);
+#line 171 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_CHA, yytext, yyleng);
 	YY_BREAK
 case 22:
 YY_RULE_SETUP
-#line 163 "src/parser.l"
-vt100_parser_handle_cup(yyextra, yytext, yyleng);
+#line 172 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_CUP, yytext, yyleng);
 	YY_BREAK
 case 23:
 YY_RULE_SETUP
-#line 164 "src/parser.l"
-vt100_parser_handle_ed(yyextra, yytext, yyleng);
+#line 173 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_ED, yytext, yyleng);
 	YY_BREAK
 case 24:
 YY_RULE_SETUP
-#line 165 "src/parser.l"
-vt100_parser_handle_el(yyextra, yytext, yyleng);
+#line 174 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_EL, yytext, yyleng);
 	YY_BREAK
 case 25:
 YY_RULE_SETUP
-#line 166 "src/parser.l"
-vt100_parser_handle_il(yyextra, yytext, yyleng);
+#line 175 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_IL, yytext, yyleng);
 	YY_BREAK
 case 26:
 YY_RULE_SETUP
-#line 167 "src/parser.l"
-vt100_parser_handle_dl(yyextra, yytext, yyleng);
+#line 176 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_DL, yytext, yyleng);
 	YY_BREAK
 case 27:
 YY_RULE_SETUP
-#line 168 "src/parser.l"
-vt100_parser_handle_dch(yyextra, yytext, yyleng);
+#line 177 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_DCH, yytext, yyleng);
 	YY_BREAK
 case 28:
 YY_RULE_SETUP
-#line 169 "src/parser.l"
-vt100_parser_handle_su(yyextra, yytext, yyleng);
+#line 178 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_SU, yytext, yyleng);
 	YY_BREAK
 case 29:
 YY_RULE_SETUP
-#line 170 "src/parser.l"
-vt100_parser_handle_sd(yyextra, yytext, yyleng);
+#line 179 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_SD, yytext, yyleng);
 	YY_BREAK
 case 30:
 YY_RULE_SETUP
-#line 171 "src/parser.l"
-vt100_parser_handle_ech(yyextra, yytext, yyleng);
+#line 180 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_ECH, yytext, yyleng);
 	YY_BREAK
 case 31:
 YY_RULE_SETUP
-#line 172 "src/parser.l"
-vt100_parser_handle_vpa(yyextra, yytext, yyleng);
+#line 181 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_VPA, yytext, yyleng);
 	YY_BREAK
 case 32:
 YY_RULE_SETUP
-#line 173 "src/parser.l"
-vt100_parser_handle_sm(yyextra, yytext, yyleng);
+#line 182 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_SM, yytext, yyleng);
 	YY_BREAK
 case 33:
 YY_RULE_SETUP
-#line 174 "src/parser.l"
-vt100_parser_handle_rm(yyextra, yytext, yyleng);
+#line 183 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_RM, yytext, yyleng);
 	YY_BREAK
 case 34:
 YY_RULE_SETUP
-#line 175 "src/parser.l"
-vt100_parser_handle_sgr(yyextra, yytext, yyleng);
+#line 184 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_SGR, yytext, yyleng);
 	YY_BREAK
 case 35:
 YY_RULE_SETUP
-#line 176 "src/parser.l"
-vt100_parser_handle_csr(yyextra, yytext, yyleng);
+#line 185 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_CSR, yytext, yyleng);
 	YY_BREAK
 case 36:
 YY_RULE_SETUP
-#line 178 "src/parser.l"
-vt100_parser_handle_decsed(yyextra, yytext, yyleng);
+#line 187 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_DECSED, yytext, yyleng);
 	YY_BREAK
 case 37:
 YY_RULE_SETUP
-#line 179 "src/parser.l"
-vt100_parser_handle_decsel(yyextra, yytext, yyleng);
+#line 188 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_DECSEL, yytext, yyleng);
 	YY_BREAK
 case 38:
 YY_RULE_SETUP
-#line 181 "src/parser.l"
-vt100_parser_handle_osc0(yyextra, yytext, yyleng);
+#line 190 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_OSC0, yytext, yyleng);
 	YY_BREAK
 case 39:
 YY_RULE_SETUP
-#line 182 "src/parser.l"
-vt100_parser_handle_osc1(yyextra, yytext, yyleng);
+#line 191 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_OSC1, yytext, yyleng);
 	YY_BREAK
 case 40:
 YY_RULE_SETUP
-#line 183 "src/parser.l"
-vt100_parser_handle_osc2(yyextra, yytext, yyleng);
+#line 192 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_OSC2, yytext, yyleng);
 	YY_BREAK
 case 41:
-#line 186 "src/parser.l"
+#line 195 "src/parser.l"
 case 42:
-#line 187 "src/parser.l"
+#line 196 "src/parser.l"
 case 43:
-#line 188 "src/parser.l"
+#line 197 "src/parser.l"
 case 44:
 YY_RULE_SETUP
-#line 188 "src/parser.l"
+#line 197 "src/parser.l"
 /* ignored - not interested in implementing character sets, unicode
              should be sufficient */
 	YY_BREAK
 case 45:
-#line 192 "src/parser.l"
+#line 201 "src/parser.l"
 case 46:
 YY_RULE_SETUP
-#line 192 "src/parser.l"
+#line 201 "src/parser.l"
 /* ignored - not interested in escapes that generate responses */
 	YY_BREAK
 case 47:
 YY_RULE_SETUP
-#line 194 "src/parser.l"
-vt100_parser_handle_ascii(yyextra, yytext, yyleng);
+#line 203 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_ASCII, yytext, yyleng);
 	YY_BREAK
 case 48:
 YY_RULE_SETUP
-#line 195 "src/parser.l"
-vt100_parser_handle_text(yyextra, yytext, yyleng);
+#line 204 "src/parser.l"
+vt100_parser_dispatch(yyextra, VT100_TOKEN_TEXT, yytext, yyleng);
 	YY_BREAK
 case 49:
-#line 198 "src/parser.l"
+#line 207 "src/parser.l"
 case 50:
-#line 199 "src/parser.l"
+#line 208 "src/parser.l"
 case 51:
-#line 200 "src/parser.l"
+#line 209 "src/parser.l"
 case 52:
-#line 201 "src/parser.l"
+#line 210 "src/parser.l"
 case 53:
-#line 202 "src/parser.l"
+#line 211 "src/parser.l"
 case 54:
 YY_RULE_SETUP
-#line 202 "src/parser.l"
+#line 211 "src/parser.l"
 return yyleng;
 	YY_BREAK
 case YY_STATE_EOF(INITIAL):
-#line 204 "src/parser.l"
+#line 213 "src/parser.l"
 return 0;
 	YY_BREAK
 case 55:
 /* rule 55 can match eol */
 YY_RULE_SETUP
-#line 206 "src/parser.l"
+#line 215 "src/parser.l"
 {
-    fprintf(stderr,
-        "unhandled CSI sequence: \\033%s\\%03hho\n",
-        yytext + 1, yytext[yyleng - 1]);
+    vt100_screen_diagnostic(
+        yyextra, VT100_DIAGNOSTIC_UNHANDLED_CSI,
+        "unhandled CSI sequence: \\033%.*s\\%03hho",
+        (int)yyleng - 2, yytext + 1, yytext[yyleng - 1]);
 }
 	YY_BREAK
 case 56:
 YY_RULE_SETUP
-#line 212 "src/parser.l"
+#line 222 "src/parser.l"
 {
-    fprintf(stderr, "unhandled CSI sequence: \\033%s\n", yytext + 1);
+    /* CSI s is DECSLRM or SCOSC depending on DECLRMM, which
+     * vt100_parser_handle_decslrm sorts out */
+    if (yytext[yyleng - 1] == 's' && !strchr("<=?", yytext[2])) {
+        vt100_parser_dispatch(yyextra, VT100_TOKEN_DECSLRM, yytext, yyleng);
+    }
+    else {
+        vt100_screen_diagnostic(
+            yyextra, VT100_DIAGNOSTIC_UNHANDLED_CSI,
+            "unhandled CSI sequence: \\033%s", yytext + 1);
+    }
 }
 	YY_BREAK
 case 57:
 YY_RULE_SETUP
-#line 216 "src/parser.l"
+#line 235 "src/parser.l"
 {
     if (!strncmp(yytext, "\033]50;", 5)) { // osx terminal.app private stuff
         // not interested in non-portable extensions
@@ -1495,30 +1514,34 @@ YY_RULE_SETUP
         // this isn't intended to be interpreted
     }
     else {
-        yytext[yyleng - 1] = '\0';
-        fprintf(stderr,
-            "unhandled OSC sequence: \\033%s\\007\n",
-            yytext + 1);
+        vt100_screen_diagnostic(
+            yyextra, VT100_DIAGNOSTIC_UNHANDLED_OSC,
+            "unhandled OSC sequence: \\033%.*s\\007",
+            (int)yyleng - 2, yytext + 1);
     }
 }
 	YY_BREAK
 case 58:
 /* rule 58 can match eol */
 YY_RULE_SETUP
-#line 231 "src/parser.l"
+#line 250 "src/parser.l"
 {
-    fprintf(stderr, "unhandled escape sequence: \\%03hho\n", yytext[1]);
+    vt100_screen_diagnostic(
+        yyextra, VT100_DIAGNOSTIC_UNHANDLED_ESCAPE,
+        "unhandled escape sequence: \\%03hho", yytext[1]);
 }
 	YY_BREAK
 case 59:
 YY_RULE_SETUP
-#line 235 "src/parser.l"
+#line 256 "src/parser.l"
 {
     switch (yytext[1]) {
     case '(': // character sets - there should be some trailing bytes
         return yyleng;
     default:
-        fprintf(stderr, "unhandled escape sequence: %s\n", yytext + 1);
+        vt100_screen_diagnostic(
+            yyextra, VT100_DIAGNOSTIC_UNHANDLED_ESCAPE,
+            "unhandled escape sequence: %s", yytext + 1);
         break;
     }
 }
@@ -1526,24 +1549,28 @@ YY_RULE_SETUP
 case 60:
 /* rule 60 can match eol */
 YY_RULE_SETUP
-#line 245 "src/parser.l"
+#line 268 "src/parser.l"
 {
-    fprintf(stderr, "unhandled control character: \\%03hho\n", yytext[0]);
+    vt100_screen_diagnostic(
+        yyextra, VT100_DIAGNOSTIC_UNHANDLED_CONTROL,
+        "unhandled control character: \\%03hho", yytext[0]);
 }
 	YY_BREAK
 case 61:
 YY_RULE_SETUP
-#line 249 "src/parser.l"
+#line 274 "src/parser.l"
 {
-    fprintf(stderr, "invalid utf8 byte: \\%03hho\n", yytext[0]);
+    vt100_screen_diagnostic(
+        yyextra, VT100_DIAGNOSTIC_INVALID_UTF8,
+        "invalid utf8 byte: \\%03hho", yytext[0]);
 }
 	YY_BREAK
 case 62:
 YY_RULE_SETUP
-#line 253 "src/parser.l"
+#line 280 "src/parser.l"
 YY_FATAL_ERROR( "flex scanner jammed" );
 	YY_BREAK
-#line 1546 "src/parser.c"
+#line 1573 "src/parser.c"
 
 	case YY_END_OF_BUFFER:
 		{
@@ -2644,7 +2671,7 @@ static int yy_flex_strlen (const char * s , yyscan_t yyscanner)
 
 #define YYTABLES_NAME "yytables"
 
-#line 253 "src/parser.l"
+#line 280 "src/parser.l"
 
 
 #ifdef VT100_DEBUG_TRACE
@@ -2652,16 +2679,284 @@ static int yy_flex_strlen (const char * s , yyscan_t yyscanner)
     fputs(x"\n", stderr); \
 } while (0)
 #define DEBUG_TRACE3(x, x2, x2len) do { \
-    char old = (x2)[(x2len)]; \
-    (x2)[(x2len)] = '\0'; \
-    fprintf(stderr, x" %s\n", (x2)); \
-    (x2)[(x2len)] = old; \
+    fprintf(stderr, x" %.*s\n", (int)(x2len), (x2)); \
 } while (0)
 #else
 #define DEBUG_TRACE1(x)
 #define DEBUG_TRACE3(x, x2, x2len)
 #endif
 
+static void vt100_parser_dispatch(
+    VT100Screen *vt, int type, char *buf, size_t len)
+{
+    vt->stats.tokens[type]++;
+    if (type == VT100_TOKEN_ASCII || type == VT100_TOKEN_TEXT) {
+        vt->stats.text_bytes += len;
+    }
+    VT100_PROBE4(token, vt, type, buf, len);
+
+    if (vt->pipeline) {
+        vt100_pipeline_push(vt->pipeline, type, buf, len);
+    }
+    else if (vt->deferred) {
+        vt100_bytecode_push_token(vt->deferred, type, buf, len);
+    }
+    else {
+        vt100_parser_apply_token(vt, type, buf, len);
+    }
+}
+
+void vt100_parser_apply_token(VT100Screen *vt, int type, char *buf, size_t len)
+{
+    switch (type) {
+    case VT100_TOKEN_BEL:
+        vt100_parser_handle_bel(vt);
+        break;
+    case VT100_TOKEN_BS:
+        vt100_parser_handle_bs(vt);
+        break;
+    case VT100_TOKEN_TAB:
+        vt100_parser_handle_tab(vt);
+        break;
+    case VT100_TOKEN_LF:
+        vt100_parser_handle_lf(vt);
+        break;
+    case VT100_TOKEN_CR:
+        vt100_parser_handle_cr(vt);
+        break;
+    case VT100_TOKEN_DECKPAM:
+        vt100_parser_handle_deckpam(vt);
+        break;
+    case VT100_TOKEN_DECKPNM:
+        vt100_parser_handle_deckpnm(vt);
+        break;
+    case VT100_TOKEN_RI:
+        vt100_parser_handle_ri(vt);
+        break;
+    case VT100_TOKEN_RIS:
+        vt100_parser_handle_ris(vt);
+        break;
+    case VT100_TOKEN_VB:
+        vt100_parser_handle_vb(vt);
+        break;
+    case VT100_TOKEN_DECSC:
+        vt100_parser_handle_decsc(vt);
+        break;
+    case VT100_TOKEN_DECRC:
+        vt100_parser_handle_decrc(vt);
+        break;
+    case VT100_TOKEN_ICH:
+        vt100_parser_handle_ich(vt, buf, len);
+        break;
+    case VT100_TOKEN_CUU:
+        vt100_parser_handle_cuu(vt, buf, len);
+        break;
+    case VT100_TOKEN_CUD:
+        vt100_parser_handle_cud(vt, buf, len);
+        break;
+    case VT100_TOKEN_CUF:
+        vt100_parser_handle_cuf(vt, buf, len);
+        break;
+    case VT100_TOKEN_CUB:
+        vt100_parser_handle_cub(vt, buf, len);
+        break;
+    case VT100_TOKEN_CHA:
+        vt100_parser_handle_cha(vt, buf, len);
+        break;
+    case VT100_TOKEN_CUP:
+        vt100_parser_handle_cup(vt, buf, len);
+        break;
+    case VT100_TOKEN_ED:
+        vt100_parser_handle_ed(vt, buf, len);
+        break;
+    case VT100_TOKEN_EL:
+        vt100_parser_handle_el(vt, buf, len);
+        break;
+    case VT100_TOKEN_IL:
+        vt100_parser_handle_il(vt, buf, len);
+        break;
+    case VT100_TOKEN_DL:
+        vt100_parser_handle_dl(vt, buf, len);
+        break;
+    case VT100_TOKEN_DCH:
+        vt100_parser_handle_dch(vt, buf, len);
+        break;
+    case VT100_TOKEN_SU:
+        vt100_parser_handle_su(vt, buf, len);
+        break;
+    case VT100_TOKEN_SD:
+        vt100_parser_handle_sd(vt, buf, len);
+        break;
+    case VT100_TOKEN_ECH:
+        vt100_parser_handle_ech(vt, buf, len);
+        break;
+    case VT100_TOKEN_VPA:
+        vt100_parser_handle_vpa(vt, buf, len);
+        break;
+    case VT100_TOKEN_SM:
+        vt100_parser_handle_sm(vt, buf, len);
+        break;
+    case VT100_TOKEN_RM:
+        vt100_parser_handle_rm(vt, buf, len);
+        break;
+    case VT100_TOKEN_SGR:
+        vt100_parser_handle_sgr(vt, buf, len);
+        break;
+    case VT100_TOKEN_CSR:
+        vt100_parser_handle_csr(vt, buf, len);
+        break;
+    case VT100_TOKEN_DECSLRM:
+        vt100_parser_handle_decslrm(vt, buf, len);
+        break;
+    case VT100_TOKEN_DECSED:
+        vt100_parser_handle_decsed(vt, buf, len);
+        break;
+    case VT100_TOKEN_DECSEL:
+        vt100_parser_handle_decsel(vt, buf, len);
+        break;
+    case VT100_TOKEN_OSC0:
+        vt100_parser_handle_osc0(vt, buf, len);
+        break;
+    case VT100_TOKEN_OSC1:
+        vt100_parser_handle_osc1(vt, buf, len);
+        break;
+    case VT100_TOKEN_OSC2:
+        vt100_parser_handle_osc2(vt, buf, len);
+        break;
+    case VT100_TOKEN_ASCII:
+        vt100_parser_handle_ascii(vt, buf, len);
+        break;
+    case VT100_TOKEN_TEXT:
+        vt100_parser_handle_text(vt, buf, len);
+        break;
+    default:
+        break;
+    }
+
+    if (vt->bytecode) {
+        vt100_parser_compile_token(vt, type, buf, len);
+    }
+}
+
+static void vt100_parser_compile_token(
+    VT100Screen *vt, int type, char *buf, size_t len)
+{
+    struct vt100_bytecode *bytecode = vt->bytecode;
+    int params[VT100_PARSER_CSI_MAX_PARAMS] = { 1 }, nparams, op;
+
+    switch (type) {
+    case VT100_TOKEN_ASCII:
+        vt100_bytecode_push_op(bytecode, VT100_OP_PRINT_ASCII);
+        vt100_bytecode_push_string(bytecode, buf, len);
+        break;
+    case VT100_TOKEN_TEXT:
+        vt100_bytecode_push_op(bytecode, VT100_OP_PRINT_UTF8);
+        vt100_bytecode_push_string(bytecode, buf, len);
+        break;
+    case VT100_TOKEN_BS:
+    case VT100_TOKEN_TAB:
+    case VT100_TOKEN_CR:
+    case VT100_TOKEN_CUU:
+    case VT100_TOKEN_CUD:
+    case VT100_TOKEN_CUF:
+    case VT100_TOKEN_CUB:
+    case VT100_TOKEN_CHA:
+    case VT100_TOKEN_CUP:
+    case VT100_TOKEN_VPA:
+        vt100_bytecode_push_move_to(bytecode, vt->grid->cur);
+        break;
+    case VT100_TOKEN_LF:
+        vt100_bytecode_push_op(bytecode, VT100_OP_LF);
+        break;
+    case VT100_TOKEN_RI:
+        vt100_bytecode_push_op(bytecode, VT100_OP_RI);
+        break;
+    case VT100_TOKEN_SGR:
+        vt100_bytecode_push_attrs(bytecode, &vt->attrs);
+        break;
+    case VT100_TOKEN_ED:
+    case VT100_TOKEN_EL:
+    case VT100_TOKEN_DECSED:
+    case VT100_TOKEN_DECSEL: {
+        int erase;
+
+        buf += 2;
+        len -= 3;
+        if (*buf == '?') {
+            buf++;
+            len--;
+        }
+        params[0] = 0;
+        vt100_parser_extract_csi_params(NULL, buf, len, params, &nparams);
+        if (params[0] < 0 || params[0] > 2) {
+            break;
+        }
+
+        erase = type == VT100_TOKEN_ED || type == VT100_TOKEN_DECSED
+            ? VT100_ERASE_SCREEN_FORWARD : VT100_ERASE_LINE_FORWARD;
+        vt100_bytecode_push_op(bytecode, VT100_OP_ERASE);
+        vt100_bytecode_push_uint(bytecode, erase + params[0]);
+        break;
+    }
+    case VT100_TOKEN_ICH:
+    case VT100_TOKEN_DCH:
+    case VT100_TOKEN_ECH:
+    case VT100_TOKEN_IL:
+    case VT100_TOKEN_DL:
+    case VT100_TOKEN_SU:
+    case VT100_TOKEN_SD:
+        vt100_parser_extract_csi_params(
+            NULL, buf + 2, len - 3, params, &nparams);
+        switch (type) {
+        case VT100_TOKEN_ICH:
+            op = VT100_OP_INSERT_CHARS;
+            break;
+        case VT100_TOKEN_DCH:
+            op = VT100_OP_DELETE_CHARS;
+            break;
+        case VT100_TOKEN_ECH:
+            op = VT100_OP_ERASE_CHARS;
+            break;
+        case VT100_TOKEN_IL:
+            op = VT100_OP_INSERT_LINES;
+            break;
+        case VT100_TOKEN_DL:
+            op = VT100_OP_DELETE_LINES;
+            break;
+        case VT100_TOKEN_SU:
+            op = VT100_OP_SCROLL_UP;
+            break;
+        default:
+            op = VT100_OP_SCROLL_DOWN;
+            break;
+        }
+        if ((type == VT100_TOKEN_SU || type == VT100_TOKEN_SD)
+            && params[0] == 0) {
+            params[0] = 1;
+        }
+        vt100_bytecode_push_op(bytecode, op);
+        vt100_bytecode_push_uint(bytecode, (unsigned int)params[0]);
+        break;
+    case VT100_TOKEN_OSC0:
+    case VT100_TOKEN_OSC1:
+    case VT100_TOKEN_OSC2:
+        if (type != VT100_TOKEN_OSC2) {
+            vt100_bytecode_push_op(bytecode, VT100_OP_ICON_NAME);
+            vt100_bytecode_push_string(bytecode, buf + 4, len - 5);
+        }
+        if (type != VT100_TOKEN_OSC1) {
+            vt100_bytecode_push_op(bytecode, VT100_OP_TITLE);
+            vt100_bytecode_push_string(bytecode, buf + 4, len - 5);
+        }
+        break;
+    default:
+        vt100_bytecode_push_token(bytecode, type, buf, len);
+        /* things like RIS can reset the attributes too */
+        bytecode->attrs = vt->attrs;
+        break;
+    }
+}
+
 static void vt100_parser_handle_bel(VT100Screen *vt)
 {
     DEBUG_TRACE1("BEL");
@@ -2690,8 +2985,16 @@ static void vt100_parser_handle_lf(VT100Screen *vt)
 
 static void vt100_parser_handle_cr(VT100Screen *vt)
 {
+    int col = 0;
+
     DEBUG_TRACE1("CR");
-    vt100_screen_move_to(vt, vt->grid->cur.row, 0);
+    /* a cursor inside the left margin goes back to it rather than to the
+     * start of the line */
+    if (vt->left_right_margin_mode
+        && vt->grid->cur.col >= vt->grid->scroll_left) {
+        col = vt->grid->scroll_left;
+    }
+    vt100_screen_move_to(vt, vt->grid->cur.row, col);
 }
 
 static void vt100_parser_handle_deckpam(VT100Screen *vt)
@@ -2732,6 +3035,8 @@ static void vt100_parser_handle_ris(VT100Screen *vt)
     vt100_screen_reset_mouse_reporting_any_motion(vt);
     vt100_screen_reset_bracketed_paste(vt);
     vt100_screen_reset_origin_mode(vt);
+    vt100_screen_reset_left_right_margin_mode(vt);
+    vt100_screen_reset_synchronized_output(vt);
 }
 
 static void vt100_parser_handle_vb(VT100Screen *vt)
@@ -2753,31 +3058,36 @@ static void vt100_parser_handle_decrc(VT100Screen *vt)
 }
 
 static void vt100_parser_extract_csi_params(
-    char *buf, size_t len, int *params, int *nparams)
+    VT100Screen *vt, const char *buf, size_t len, int *params, int *nparams)
 {
-    vt100_parser_extract_sm_params(buf, len, NULL, params, nparams);
+    vt100_parser_extract_sm_params(vt, buf, len, NULL, params, nparams);
 }
 
+/* vt is only used for diagnostics, and can be NULL when there's no screen to
+ * report them to */
 static void vt100_parser_extract_sm_params(
-    char *buf, size_t len, char *modes, int *params, int *nparams)
+    VT100Screen *vt, const char *buf, size_t len, char *modes, int *params,
+    int *nparams)
 {
-    char *pos = buf;
+    const char *pos = buf, *end = buf + len;
 
     /* this assumes that it will only ever be called on a fully matched CSI
-     * sequence: accessing one character beyond the end is safe because CSI
-     * sequences always have one character after the parameters (to determine
-     * the type of sequence), and the parameters can only ever be digits,
-     * separated by semicolons. */
-    buf[len] = '\0';
+     * sequence, where the parameters can only ever be digits separated by
+     * semicolons (each maybe with a mode character in front), so nothing
+     * here looks past len, and buf is never written to */
     *nparams = 0;
-    while ((size_t)(pos - buf) < len) {
+    while (pos < end) {
         if (*nparams >= VT100_PARSER_CSI_MAX_PARAMS) {
-            fprintf(stderr, "max CSI parameter length exceeded\n");
+            if (vt) {
+                vt100_screen_diagnostic(
+                    vt, VT100_DIAGNOSTIC_UNKNOWN_PARAMETER,
+                    "max CSI parameter length exceeded");
+            }
             break;
         }
 
-        if (modes && (size_t)(pos - buf) < len) {
-            if (strspn(pos, "0123456789")) {
+        if (modes) {
+            if (*pos >= '0' && *pos <= '9') {
                 modes[*nparams] = '\0';
             }
             else {
@@ -2785,9 +3095,9 @@ static void vt100_parser_extract_sm_params(
             }
         }
 
-        params[(*nparams)++] = atoi(pos);
+        params[(*nparams)++] = vt100_parser_atoi(pos, end);
 
-        pos = strchr(pos, ';');
+        pos = memchr(pos, ';', end - pos);
         if (pos) {
             pos++;
         }
@@ -2797,12 +3107,27 @@ static void vt100_parser_extract_sm_params(
     }
 }
 
+/* atoi, but stopping at end. a value too big for a long comes out the same
+ * as it would from atoi, which clamps it to LONG_MAX first */
+static int vt100_parser_atoi(const char *pos, const char *end)
+{
+    long val = 0;
+
+    while (pos < end && *pos >= '0' && *pos <= '9') {
+        int digit = *pos++ - '0';
+
+        val = val > (LONG_MAX - digit) / 10 ? LONG_MAX : val * 10 + digit;
+    }
+
+    return val;
+}
+
 static void vt100_parser_handle_ich(VT100Screen *vt, char *buf, size_t len)
 {
     int params[VT100_PARSER_CSI_MAX_PARAMS] = { 1 }, nparams;
 
     DEBUG_TRACE3("ICH", buf + 2, len - 3);
-    vt100_parser_extract_csi_params(buf + 2, len - 3, params, &nparams);
+    vt100_parser_extract_csi_params(vt, buf + 2, len - 3, params, &nparams);
     vt100_screen_insert_characters(vt, params[0]);
 }
 
@@ -2812,7 +3137,7 @@ static void vt100_parser_handle_cuu(VT100Screen *vt, char *buf, size_t len)
     int row = vt->grid->cur.row, new_row;
 
     DEBUG_TRACE3("CUU", buf + 2, len - 3);
-    vt100_parser_extract_csi_params(buf + 2, len - 3, params, &nparams);
+    vt100_parser_extract_csi_params(vt, buf + 2, len - 3, params, &nparams);
     new_row = row - params[0];
     if (row >= vt->grid->scroll_top && new_row < vt->grid->scroll_top) {
         new_row = vt->grid->scroll_top;
@@ -2826,7 +3151,7 @@ static void vt100_parser_handle_cud(VT100Screen *vt, char *buf, size_t len)
     int row = vt->grid->cur.row, new_row;
 
     DEBUG_TRACE3("CUD", buf + 2, len - 3);
-    vt100_parser_extract_csi_params(buf + 2, len - 3, params, &nparams);
+    vt100_parser_extract_csi_params(vt, buf + 2, len - 3, params, &nparams);
     new_row = row + params[0];
     if (row <= vt->grid->scroll_bottom && new_row > vt->grid->scroll_bottom) {
         new_row = vt->grid->scroll_bottom;
@@ -2839,7 +3164,7 @@ static void vt100_parser_handle_cuf(VT100Screen *vt, char *buf, size_t len)
     int params[VT100_PARSER_CSI_MAX_PARAMS] = { 1 }, nparams;
 
     DEBUG_TRACE3("CUF", buf + 2, len - 3);
-    vt100_parser_extract_csi_params(buf + 2, len - 3, params, &nparams);
+    vt100_parser_extract_csi_params(vt, buf + 2, len - 3, params, &nparams);
     vt100_screen_move_to(vt, vt->grid->cur.row, vt->grid->cur.col + params[0]);
 }
 
@@ -2848,7 +3173,7 @@ static void vt100_parser_handle_cub(VT100Screen *vt, char *buf, size_t len)
     int params[VT100_PARSER_CSI_MAX_PARAMS] = { 1 }, nparams;
 
     DEBUG_TRACE3("CUB", buf + 2, len - 3);
-    vt100_parser_extract_csi_params(buf + 2, len - 3, params, &nparams);
+    vt100_parser_extract_csi_params(vt, buf + 2, len - 3, params, &nparams);
     vt100_screen_move_to(vt, vt->grid->cur.row, vt->grid->cur.col - params[0]);
 }
 
@@ -2857,7 +3182,7 @@ static void vt100_parser_handle_cha(VT100Screen *vt, char *buf, size_t len)
     int params[VT100_PARSER_CSI_MAX_PARAMS] = { 1 }, nparams;
 
     DEBUG_TRACE3("CHA", buf + 2, len - 3);
-    vt100_parser_extract_csi_params(buf + 2, len - 3, params, &nparams);
+    vt100_parser_extract_csi_params(vt, buf + 2, len - 3, params, &nparams);
     vt100_screen_move_to(vt, vt->grid->cur.row, params[0] - 1);
 }
 
@@ -2866,7 +3191,7 @@ static void vt100_parser_handle_cup(VT100Screen *vt, char *buf, size_t len)
     int params[VT100_PARSER_CSI_MAX_PARAMS] = { 0, 0 }, nparams;
 
     DEBUG_TRACE3("CUP", buf + 2, len - 3);
-    vt100_parser_extract_csi_params(buf + 2, len - 3, params, &nparams);
+    vt100_parser_extract_csi_params(vt, buf + 2, len - 3, params, &nparams);
     if (params[0] == 0) {
         params[0] = 1;
     }
@@ -2892,7 +3217,7 @@ static void vt100_parser_handle_ed(VT100Screen *vt, char *buf, size_t len)
     else {
         DEBUG_TRACE3("ED", buf, len);
     }
-    vt100_parser_extract_csi_params(buf, len, params, &nparams);
+    vt100_parser_extract_csi_params(vt, buf, len, params, &nparams);
     switch (params[0]) {
     case 0:
         vt100_screen_clear_screen_forward(vt);
@@ -2904,7 +3229,9 @@ static void vt100_parser_handle_ed(VT100Screen *vt, char *buf, size_t len)
         vt100_screen_clear_screen(vt);
         break;
     default:
-        fprintf(stderr, "unknown ED parameter %d\n", params[0]);
+        vt100_screen_diagnostic(
+            vt, VT100_DIAGNOSTIC_UNKNOWN_PARAMETER,
+            "unknown ED parameter %d", params[0]);
         break;
     }
 }
@@ -2925,7 +3252,7 @@ static void vt100_parser_handle_el(VT100Screen *vt, char *buf, size_t len)
     else {
         DEBUG_TRACE3("EL", buf, len);
     }
-    vt100_parser_extract_csi_params(buf, len, params, &nparams);
+    vt100_parser_extract_csi_params(vt, buf, len, params, &nparams);
     switch (params[0]) {
     case 0:
         vt100_screen_kill_line_forward(vt);
@@ -2937,7 +3264,9 @@ static void vt100_parser_handle_el(VT100Screen *vt, char *buf, size_t len)
         vt100_screen_kill_line(vt);
         break;
     default:
-        fprintf(stderr, "unknown EL parameter %d\n", params[0]);
+        vt100_screen_diagnostic(
+            vt, VT100_DIAGNOSTIC_UNKNOWN_PARAMETER,
+            "unknown EL parameter %d", params[0]);
         break;
     }
 }
@@ -2947,7 +3276,7 @@ static void vt100_parser_handle_il(VT100Screen *vt, char *buf, size_t len)
     int params[VT100_PARSER_CSI_MAX_PARAMS] = { 1 }, nparams;
 
     DEBUG_TRACE3("IL", buf + 2, len - 3);
-    vt100_parser_extract_csi_params(buf + 2, len - 3, params, &nparams);
+    vt100_parser_extract_csi_params(vt, buf + 2, len - 3, params, &nparams);
     vt100_screen_insert_lines(vt, params[0]);
 }
 
@@ -2956,7 +3285,7 @@ static void vt100_parser_handle_dl(VT100Screen *vt, char *buf, size_t len)
     int params[VT100_PARSER_CSI_MAX_PARAMS] = { 1 }, nparams;
 
     DEBUG_TRACE3("DL", buf + 2, len - 3);
-    vt100_parser_extract_csi_params(buf + 2, len - 3, params, &nparams);
+    vt100_parser_extract_csi_params(vt, buf + 2, len - 3, params, &nparams);
     vt100_screen_delete_lines(vt, params[0]);
 }
 
@@ -2965,7 +3294,7 @@ static void vt100_parser_handle_dch(VT100Screen *vt, char *buf, size_t len)
     int params[VT100_PARSER_CSI_MAX_PARAMS] = { 1 }, nparams;
 
     DEBUG_TRACE3("DCH", buf + 2, len - 3);
-    vt100_parser_extract_csi_params(buf + 2, len - 3, params, &nparams);
+    vt100_parser_extract_csi_params(vt, buf + 2, len - 3, params, &nparams);
     vt100_screen_delete_characters(vt, params[0]);
 }
 
@@ -2974,7 +3303,7 @@ static void vt100_parser_handle_su(VT100Screen *vt, char *buf, size_t len)
     int params[VT100_PARSER_CSI_MAX_PARAMS] = { 1 }, nparams;
 
     DEBUG_TRACE3("SU", buf + 2, len - 3);
-    vt100_parser_extract_csi_params(buf + 2, len - 3, params, &nparams);
+    vt100_parser_extract_csi_params(vt, buf + 2, len - 3, params, &nparams);
     if (params[0] == 0) {
         params[0] = 1;
     }
@@ -2986,7 +3315,7 @@ static void vt100_parser_handle_sd(VT100Screen *vt, char *buf, size_t len)
     int params[VT100_PARSER_CSI_MAX_PARAMS] = { 1 }, nparams;
 
     DEBUG_TRACE3("SD", buf + 2, len - 3);
-    vt100_parser_extract_csi_params(buf + 2, len - 3, params, &nparams);
+    vt100_parser_extract_csi_params(vt, buf + 2, len - 3, params, &nparams);
     if (params[0] == 0) {
         params[0] = 1;
     }
@@ -2998,7 +3327,7 @@ static void vt100_parser_handle_ech(VT100Screen *vt, char *buf, size_t len)
     int params[VT100_PARSER_CSI_MAX_PARAMS] = { 1 }, nparams;
 
     DEBUG_TRACE3("ECH", buf + 2, len - 3);
-    vt100_parser_extract_csi_params(buf + 2, len - 3, params, &nparams);
+    vt100_parser_extract_csi_params(vt, buf + 2, len - 3, params, &nparams);
     vt100_screen_erase_characters(vt, params[0]);
 }
 
@@ -3007,7 +3336,7 @@ static void vt100_parser_handle_vpa(VT100Screen *vt, char *buf, size_t len)
     int params[VT100_PARSER_CSI_MAX_PARAMS] = { 1 }, nparams;
 
     DEBUG_TRACE3("VPA", buf + 2, len - 3);
-    vt100_parser_extract_csi_params(buf + 2, len - 3, params, &nparams);
+    vt100_parser_extract_csi_params(vt, buf + 2, len - 3, params, &nparams);
     vt100_screen_move_to(vt, params[0] - 1, vt->grid->cur.col);
 }
 
@@ -3017,8 +3346,12 @@ static void vt100_parser_handle_sm(VT100Screen *vt, char *buf, size_t len)
     char modes[VT100_PARSER_CSI_MAX_PARAMS] = { 0 };
 
     DEBUG_TRACE3("SM", buf + 2, len - 3);
-    vt100_parser_extract_sm_params(buf + 2, len - 3, modes, params, &nparams);
+    vt100_parser_extract_sm_params(
+        vt, buf + 2, len - 3, modes, params, &nparams);
     for (i = 0; i < nparams; ++i) {
+        if (vt->events) {
+            vt100_screen_push_mode_event(vt, modes[i], params[i], 1);
+        }
         switch (modes[i]) {
         case 0:
             switch (params[i]) {
@@ -3026,7 +3359,9 @@ static void vt100_parser_handle_sm(VT100Screen *vt, char *buf, size_t len)
                     /* do nothing, no idea what this is even for */
                     break;
                 default:
-                    fprintf(stderr, "unknown SM parameter: %d\n", params[i]);
+                    vt100_screen_diagnostic(
+                        vt, VT100_DIAGNOSTIC_UNKNOWN_MODE,
+                        "unknown SM parameter: %d", params[i]);
                     break;
             }
             break;
@@ -3039,6 +3374,9 @@ static void vt100_parser_handle_sm(VT100Screen *vt, char *buf, size_t len)
                 vt100_screen_set_origin_mode(vt);
                 vt100_screen_move_to(vt, 0, 0);
                 break;
+            case 69:
+                vt100_screen_set_left_right_margin_mode(vt);
+                break;
             case 9:
                 vt100_screen_set_mouse_reporting_press(vt);
                 break;
@@ -3067,6 +3405,9 @@ static void vt100_parser_handle_sm(VT100Screen *vt, char *buf, size_t len)
             case 2004:
                 vt100_screen_set_bracketed_paste(vt);
                 break;
+            case 2026:
+                vt100_screen_set_synchronized_output(vt);
+                break;
             case 12: // blinking cursor
                 // not interested in blinking cursors
             case 1034: // interpret Meta key
@@ -3074,14 +3415,16 @@ static void vt100_parser_handle_sm(VT100Screen *vt, char *buf, size_t len)
                 // what exactly it does. don't think it's important though.
                 break;
             default:
-                fprintf(stderr,
-                    "unknown SM parameter: %c%d\n", modes[i], params[i]);
+                vt100_screen_diagnostic(
+                    vt, VT100_DIAGNOSTIC_UNKNOWN_MODE,
+                    "unknown SM parameter: %c%d", modes[i], params[i]);
                 break;
             }
             break;
         default:
-            fprintf(stderr,
-                "unknown SM parameter: %c%d\n", modes[i], params[i]);
+            vt100_screen_diagnostic(
+                vt, VT100_DIAGNOSTIC_UNKNOWN_MODE,
+                "unknown SM parameter: %c%d", modes[i], params[i]);
             break;
         }
     }
@@ -3093,8 +3436,12 @@ static void vt100_parser_handle_rm(VT100Screen *vt, char *buf, size_t len)
     char modes[VT100_PARSER_CSI_MAX_PARAMS] = { 0 };
 
     DEBUG_TRACE3("RM", buf + 2, len - 3);
-    vt100_parser_extract_sm_params(buf + 2, len - 3, modes, params, &nparams);
+    vt100_parser_extract_sm_params(
+        vt, buf + 2, len - 3, modes, params, &nparams);
     for (i = 0; i < nparams; ++i) {
+        if (vt->events) {
+            vt100_screen_push_mode_event(vt, modes[i], params[i], 0);
+        }
         switch (modes[i]) {
         case 0:
             switch (params[i]) {
@@ -3102,7 +3449,9 @@ static void vt100_parser_handle_rm(VT100Screen *vt, char *buf, size_t len)
                     /* do nothing, no idea what this is even for */
                     break;
                 default:
-                    fprintf(stderr, "unknown RM parameter: %d\n", params[i]);
+                    vt100_screen_diagnostic(
+                        vt, VT100_DIAGNOSTIC_UNKNOWN_MODE,
+                        "unknown RM parameter: %d", params[i]);
                     break;
             }
             break;
@@ -3115,6 +3464,9 @@ static void vt100_parser_handle_rm(VT100Screen *vt, char *buf, size_t len)
                 vt100_screen_reset_origin_mode(vt);
                 vt100_screen_move_to(vt, 0, 0);
                 break;
+            case 69:
+                vt100_screen_reset_left_right_margin_mode(vt);
+                break;
             case 9:
                 vt100_screen_reset_mouse_reporting_press(vt);
                 break;
@@ -3141,6 +3493,9 @@ static void vt100_parser_handle_rm(VT100Screen *vt, char *buf, size_t len)
             case 2004:
                 vt100_screen_reset_bracketed_paste(vt);
                 break;
+            case 2026:
+                vt100_screen_reset_synchronized_output(vt);
+                break;
             case 12: // blinking cursor
                 // not interested in blinking cursors
             case 1034: // interpret Meta key
@@ -3148,14 +3503,16 @@ static void vt100_parser_handle_rm(VT100Screen *vt, char *buf, size_t len)
                 // what exactly it does. don't think it's important though.
                 break;
             default:
-                fprintf(stderr,
-                    "unknown RM parameter: %c%d\n", modes[i], params[i]);
+                vt100_screen_diagnostic(
+                    vt, VT100_DIAGNOSTIC_UNKNOWN_MODE,
+                    "unknown RM parameter: %c%d", modes[i], params[i]);
                 break;
             }
             break;
         default:
-            fprintf(stderr,
-                "unknown RM parameter: %c%d\n", modes[i], params[i]);
+            vt100_screen_diagnostic(
+                vt, VT100_DIAGNOSTIC_UNKNOWN_MODE,
+                "unknown RM parameter: %c%d", modes[i], params[i]);
             break;
         }
     }
@@ -3166,7 +3523,7 @@ static void vt100_parser_handle_sgr(VT100Screen *vt, char *buf, size_t len)
     int params[VT100_PARSER_CSI_MAX_PARAMS] = { 0 }, nparams, i;
 
     DEBUG_TRACE3("SGR", buf + 2, len - 3);
-    vt100_parser_extract_csi_params(buf + 2, len - 3, params, &nparams);
+    vt100_parser_extract_csi_params(vt, buf + 2, len - 3, params, &nparams);
     if (nparams < 1) {
         nparams = 1;
     }
@@ -3206,8 +3563,9 @@ static void vt100_parser_handle_sgr(VT100Screen *vt, char *buf, size_t len)
         case 38: {
             i++;
             if (i >= nparams) {
-                fprintf(stderr,
-                    "unknown SGR parameter: %d (too few parameters)\n",
+                vt100_screen_diagnostic(
+                    vt, VT100_DIAGNOSTIC_UNKNOWN_SGR,
+                    "unknown SGR parameter: %d (too few parameters)",
                     params[i - 1]);
                 break;
             }
@@ -3216,8 +3574,9 @@ static void vt100_parser_handle_sgr(VT100Screen *vt, char *buf, size_t len)
             case 2:
                 i += 3;
                 if (i >= nparams) {
-                    fprintf(stderr,
-                        "unknown SGR parameter: %d;%d (too few parameters)\n",
+                    vt100_screen_diagnostic(
+                        vt, VT100_DIAGNOSTIC_UNKNOWN_SGR,
+                        "unknown SGR parameter: %d;%d (too few parameters)",
                         params[i - 4], params[i - 3]);
                     break;
                 }
@@ -3227,8 +3586,9 @@ static void vt100_parser_handle_sgr(VT100Screen *vt, char *buf, size_t len)
             case 5:
                 i++;
                 if (i >= nparams) {
-                    fprintf(stderr,
-                        "unknown SGR parameter: %d;%d (too few parameters)\n",
+                    vt100_screen_diagnostic(
+                        vt, VT100_DIAGNOSTIC_UNKNOWN_SGR,
+                        "unknown SGR parameter: %d;%d (too few parameters)",
                         params[i - 2], params[i - 1]);
                     break;
                 }
@@ -3236,8 +3596,9 @@ static void vt100_parser_handle_sgr(VT100Screen *vt, char *buf, size_t len)
                 break;
             default:
                 i++;
-                fprintf(stderr,
-                    "unknown SGR parameter: %d;%d\n",
+                vt100_screen_diagnostic(
+                    vt, VT100_DIAGNOSTIC_UNKNOWN_SGR,
+                    "unknown SGR parameter: %d;%d",
                     params[i - 2], params[i - 1]);
                 break;
             }
@@ -3253,8 +3614,9 @@ static void vt100_parser_handle_sgr(VT100Screen *vt, char *buf, size_t len)
         case 48: {
             i++;
             if (i >= nparams) {
-                fprintf(stderr,
-                    "unknown SGR parameter: %d (too few parameters)\n",
+                vt100_screen_diagnostic(
+                    vt, VT100_DIAGNOSTIC_UNKNOWN_SGR,
+                    "unknown SGR parameter: %d (too few parameters)",
                     params[i - 1]);
                 break;
             }
@@ -3263,8 +3625,9 @@ static void vt100_parser_handle_sgr(VT100Screen *vt, char *buf, size_t len)
             case 2:
                 i += 3;
                 if (i >= nparams) {
-                    fprintf(stderr,
-                        "unknown SGR parameter: %d;%d (too few parameters)\n",
+                    vt100_screen_diagnostic(
+                        vt, VT100_DIAGNOSTIC_UNKNOWN_SGR,
+                        "unknown SGR parameter: %d;%d (too few parameters)",
                         params[i - 4], params[i - 3]);
                     break;
                 }
@@ -3274,8 +3637,9 @@ static void vt100_parser_handle_sgr(VT100Screen *vt, char *buf, size_t len)
             case 5:
                 i++;
                 if (i >= nparams) {
-                    fprintf(stderr,
-                        "unknown SGR parameter: %d;%d (too few parameters)\n",
+                    vt100_screen_diagnostic(
+                        vt, VT100_DIAGNOSTIC_UNKNOWN_SGR,
+                        "unknown SGR parameter: %d;%d (too few parameters)",
                         params[i - 2], params[i - 1]);
                     break;
                 }
@@ -3283,8 +3647,9 @@ static void vt100_parser_handle_sgr(VT100Screen *vt, char *buf, size_t len)
                 break;
             default:
                 i++;
-                fprintf(stderr,
-                    "unknown SGR parameter: %d;%d\n",
+                vt100_screen_diagnostic(
+                    vt, VT100_DIAGNOSTIC_UNKNOWN_SGR,
+                    "unknown SGR parameter: %d;%d",
                     params[i - 2], params[i - 1]);
                 break;
             }
@@ -3305,7 +3670,9 @@ static void vt100_parser_handle_sgr(VT100Screen *vt, char *buf, size_t len)
             // blinking terminals are awful
             break;
         default:
-            fprintf(stderr, "unknown SGR parameter: %d\n", params[i]);
+            vt100_screen_diagnostic(
+                vt, VT100_DIAGNOSTIC_UNKNOWN_SGR,
+                "unknown SGR parameter: %d", params[i]);
             break;
         }
     }
@@ -3314,16 +3681,49 @@ static void vt100_parser_handle_sgr(VT100Screen *vt, char *buf, size_t len)
 static void vt100_parser_handle_csr(VT100Screen *vt, char *buf, size_t len)
 {
     int params[VT100_PARSER_CSI_MAX_PARAMS] = {
-        1, vt->grid->max.row, 1, vt->grid->max.col };
+        1, vt->grid->max.row,
+        vt->grid->scroll_left + 1, vt->grid->scroll_right + 1 };
     int nparams;
 
     DEBUG_TRACE3("CSR", buf + 2, len - 3);
-    vt100_parser_extract_csi_params(buf + 2, len - 3, params, &nparams);
+    vt100_parser_extract_csi_params(vt, buf + 2, len - 3, params, &nparams);
+
+    /* the left and right margins can only be changed while DECLRMM is set */
+    if (!vt->left_right_margin_mode) {
+        params[2] = 1;
+        params[3] = vt->grid->max.col;
+    }
 
     vt100_screen_set_scroll_region(
         vt, params[0] - 1, params[1] - 1, params[2] - 1, params[3] - 1);
 }
 
+static void vt100_parser_handle_decslrm(VT100Screen *vt, char *buf, size_t len)
+{
+    int params[VT100_PARSER_CSI_MAX_PARAMS] = { 1, vt->grid->max.col };
+    int nparams;
+
+    /* without DECLRMM, this is the same sequence as SCOSC */
+    if (!vt->left_right_margin_mode) {
+        DEBUG_TRACE1("SCOSC");
+        vt100_screen_save_cursor(vt);
+        return;
+    }
+
+    DEBUG_TRACE3("DECSLRM", buf + 2, len - 3);
+    vt100_parser_extract_csi_params(vt, buf + 2, len - 3, params, &nparams);
+    if (params[0] == 0) {
+        params[0] = 1;
+    }
+    if (params[1] == 0) {
+        params[1] = vt->grid->max.col;
+    }
+
+    vt100_screen_set_scroll_region(
+        vt, vt->grid->scroll_top, vt->grid->scroll_bottom,
+        params[0] - 1, params[1] - 1);
+}
+
 static void vt100_parser_handle_decsed(VT100Screen *vt, char *buf, size_t len)
 {
     /* XXX not quite correct, but i don't think programs really use anything
@@ -3369,23 +3769,33 @@ static void vt100_parser_handle_text(VT100Screen *vt, char *text, size_t len)
     vt100_screen_show_string_utf8(vt, text, len);
 }
 
-/* XXX these are copied from the generated file so that I can add the UNUSED
- * declarations, otherwise we get compilation errors */
+/* the scanner allocates through the screen's allocator. this works even for
+ * the scanner's own state, since yylex_init_extra sets the extra data on a
+ * dummy scanner before allocating the real one. */
 void *vt100_parser_yyalloc(yy_size_t size, yyscan_t yyscanner)
 {
-    UNUSED(yyscanner);
-    return (void *)malloc(size);
+    return vt100_screen_malloc(vt100_parser_yyget_extra(yyscanner), size);
 }
 
 void *vt100_parser_yyrealloc(void *ptr, yy_size_t size, yyscan_t yyscanner)
 {
-    UNUSED(yyscanner);
-    return (void *)realloc((char *)ptr, size);
+    return vt100_screen_realloc(
+        vt100_parser_yyget_extra(yyscanner), ptr, size);
 }
 
 void vt100_parser_yyfree(void *ptr, yyscan_t yyscanner)
 {
-    UNUSED(yyscanner);
-    free((char *) ptr);
+    vt100_screen_free(vt100_parser_yyget_extra(yyscanner), ptr);
+}
+
+/* what the scanner keeps allocated from one buffer to the next (the copy
+ * of the buffer it scans belongs to the screen) */
+size_t vt100_parser_memory_usage(void *yyscanner)
+{
+    struct yyguts_t *yyg = (struct yyguts_t *)yyscanner;
+
+    return sizeof(struct yyguts_t)
+        + yyg->yy_buffer_stack_max * sizeof(YY_BUFFER_STATE)
+        + yyg->yy_start_stack_depth * sizeof(int);
 }
 
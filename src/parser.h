@@ -692,7 +692,7 @@ extern int yylex (yyscan_t yyscanner);
 #undef yyTABLES_NAME
 #endif
 
-#line 253 "src/parser.l"
+#line 280 "src/parser.l"
 
 
 #line 698 "src/parser.h"
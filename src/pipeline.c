@@ -0,0 +1,254 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vt100.h"
+
+#define VT100_PIPELINE_RING_SIZE (1 << 18)
+#define VT100_PIPELINE_INLINE_MAX (VT100_PIPELINE_RING_SIZE / 8)
+#define VT100_PIPELINE_PAD -1
+
+/* each token is stored in the ring as this header followed by its bytes.
+ * tokens too big to comfortably fit in the ring (long runs of text, mostly)
+ * are copied to the heap instead, and freed by the applying thread. */
+struct vt100_pipeline_token {
+    int type;
+    size_t len;
+    char *buf;
+};
+
+#define VT100_PIPELINE_ALIGN _Alignof(struct vt100_pipeline_token)
+
+/* a single-producer single-consumer ring: only the tokenizing thread moves
+ * head and only the applying thread moves tail, so neither side needs a
+ * lock in the common case. the mutex and condition variable are just for
+ * going to sleep when the ring is empty (or full) and being woken up. */
+struct vt100_pipeline {
+    VT100Screen *vt;
+    pthread_t thread;
+
+    char *ring;
+    atomic_size_t head;
+    atomic_size_t tail;
+
+    atomic_int consumer_waiting;
+    atomic_int producer_waiting;
+    atomic_int stop;
+
+    pthread_mutex_t lock;
+    pthread_cond_t produced;
+    pthread_cond_t consumed;
+};
+
+static void *vt100_pipeline_main(void *data);
+static size_t vt100_pipeline_token_size(size_t len);
+static void vt100_pipeline_wait_for_space(
+    struct vt100_pipeline *pipeline, size_t head, size_t size);
+static int vt100_pipeline_wait_for_token(
+    struct vt100_pipeline *pipeline, size_t tail);
+
+void vt100_screen_start_pipeline(VT100Screen *vt)
+{
+    struct vt100_pipeline *pipeline;
+
+    if (vt->pipeline) {
+        return;
+    }
+
+    pipeline = calloc(1, sizeof(struct vt100_pipeline));
+    pipeline->vt = vt;
+    pipeline->ring = malloc(VT100_PIPELINE_RING_SIZE);
+    pthread_mutex_init(&pipeline->lock, NULL);
+    pthread_cond_init(&pipeline->produced, NULL);
+    pthread_cond_init(&pipeline->consumed, NULL);
+
+    vt->pipeline = pipeline;
+    pthread_create(&pipeline->thread, NULL, vt100_pipeline_main, pipeline);
+}
+
+void vt100_screen_wait_pipeline(VT100Screen *vt)
+{
+    struct vt100_pipeline *pipeline = vt->pipeline;
+    size_t head;
+
+    if (!pipeline) {
+        return;
+    }
+
+    head = atomic_load(&pipeline->head);
+    vt100_pipeline_wait_for_space(pipeline, head, VT100_PIPELINE_RING_SIZE);
+}
+
+void vt100_screen_stop_pipeline(VT100Screen *vt)
+{
+    struct vt100_pipeline *pipeline = vt->pipeline;
+
+    if (!pipeline) {
+        return;
+    }
+
+    vt100_screen_wait_pipeline(vt);
+
+    pthread_mutex_lock(&pipeline->lock);
+    atomic_store(&pipeline->stop, 1);
+    pthread_cond_signal(&pipeline->produced);
+    pthread_mutex_unlock(&pipeline->lock);
+    pthread_join(pipeline->thread, NULL);
+
+    vt->pipeline = NULL;
+    pthread_cond_destroy(&pipeline->consumed);
+    pthread_cond_destroy(&pipeline->produced);
+    pthread_mutex_destroy(&pipeline->lock);
+    free(pipeline->ring);
+    free(pipeline);
+}
+
+void vt100_pipeline_push(
+    struct vt100_pipeline *pipeline, int type, char *buf, size_t len)
+{
+    struct vt100_pipeline_token *token;
+    size_t head, offset, room, size;
+    int external = len >= VT100_PIPELINE_INLINE_MAX;
+
+    size = vt100_pipeline_token_size(external ? 0 : len);
+    head = atomic_load_explicit(&pipeline->head, memory_order_relaxed);
+    offset = head % VT100_PIPELINE_RING_SIZE;
+    room = VT100_PIPELINE_RING_SIZE - offset;
+
+    /* tokens are never split across the end of the ring, so if this one
+     * doesn't fit, the rest of the ring is skipped over */
+    if (room < size) {
+        vt100_pipeline_wait_for_space(pipeline, head, room + size);
+        if (room >= sizeof(struct vt100_pipeline_token)) {
+            token = (struct vt100_pipeline_token *)(pipeline->ring + offset);
+            token->type = VT100_PIPELINE_PAD;
+        }
+        head += room;
+        offset = 0;
+    }
+    else {
+        vt100_pipeline_wait_for_space(pipeline, head, size);
+    }
+
+    token = (struct vt100_pipeline_token *)(pipeline->ring + offset);
+    token->type = type;
+    token->len = len;
+    if (external) {
+        token->buf = malloc(len);
+        memcpy(token->buf, buf, len);
+    }
+    else {
+        token->buf = NULL;
+        memcpy(token + 1, buf, len);
+    }
+
+    atomic_store(&pipeline->head, head + size);
+    if (atomic_load(&pipeline->consumer_waiting)) {
+        pthread_mutex_lock(&pipeline->lock);
+        pthread_cond_signal(&pipeline->produced);
+        pthread_mutex_unlock(&pipeline->lock);
+    }
+}
+
+static void *vt100_pipeline_main(void *data)
+{
+    struct vt100_pipeline *pipeline = data;
+    VT100Screen *vt = pipeline->vt;
+    size_t tail = 0;
+
+    while (vt100_pipeline_wait_for_token(pipeline, tail)) {
+        struct vt100_pipeline_token *token;
+        size_t offset, room;
+
+        offset = tail % VT100_PIPELINE_RING_SIZE;
+        room = VT100_PIPELINE_RING_SIZE - offset;
+        token = (struct vt100_pipeline_token *)(pipeline->ring + offset);
+
+        if (room < sizeof(struct vt100_pipeline_token)
+            || token->type == VT100_PIPELINE_PAD) {
+            tail += room;
+        }
+        else if (token->buf) {
+            vt100_parser_apply_token(vt, token->type, token->buf, token->len);
+            free(token->buf);
+            tail += vt100_pipeline_token_size(0);
+        }
+        else {
+            vt100_parser_apply_token(
+                vt, token->type, (char *)(token + 1), token->len);
+            tail += vt100_pipeline_token_size(token->len);
+        }
+
+        /* if we've caught up with the tokenizer, this is a good time to let
+         * readers see what we've done. it has to happen before tail moves,
+         * since vt100_screen_wait_pipeline hands the screen back as soon as
+         * it does. */
+        if (atomic_load(&pipeline->head) == tail) {
+            vt100_screen_check_memory(vt);
+            vt100_screen_update_frame(vt);
+            if (vt->events) {
+                vt100_screen_flush_events(vt);
+            }
+        }
+
+        atomic_store(&pipeline->tail, tail);
+        if (atomic_load(&pipeline->producer_waiting)) {
+            pthread_mutex_lock(&pipeline->lock);
+            pthread_cond_signal(&pipeline->consumed);
+            pthread_mutex_unlock(&pipeline->lock);
+        }
+    }
+
+    return NULL;
+}
+
+static size_t vt100_pipeline_token_size(size_t len)
+{
+    /* rounded up so that the next token's header is aligned */
+    size_t size = sizeof(struct vt100_pipeline_token) + len;
+
+    return (size + VT100_PIPELINE_ALIGN - 1) & ~(VT100_PIPELINE_ALIGN - 1);
+}
+
+static void vt100_pipeline_wait_for_space(
+    struct vt100_pipeline *pipeline, size_t head, size_t size)
+{
+    if (head + size - atomic_load(&pipeline->tail)
+            <= VT100_PIPELINE_RING_SIZE) {
+        return;
+    }
+
+    pthread_mutex_lock(&pipeline->lock);
+    atomic_store(&pipeline->producer_waiting, 1);
+    while (head + size - atomic_load(&pipeline->tail)
+               > VT100_PIPELINE_RING_SIZE) {
+        pthread_cond_wait(&pipeline->consumed, &pipeline->lock);
+    }
+    atomic_store(&pipeline->producer_waiting, 0);
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+static int vt100_pipeline_wait_for_token(
+    struct vt100_pipeline *pipeline, size_t tail)
+{
+    int ret = 1;
+
+    if (atomic_load(&pipeline->head) != tail) {
+        return 1;
+    }
+
+    pthread_mutex_lock(&pipeline->lock);
+    atomic_store(&pipeline->consumer_waiting, 1);
+    while (atomic_load(&pipeline->head) == tail) {
+        if (atomic_load(&pipeline->stop)) {
+            ret = 0;
+            break;
+        }
+        pthread_cond_wait(&pipeline->produced, &pipeline->lock);
+    }
+    atomic_store(&pipeline->consumer_waiting, 0);
+    pthread_mutex_unlock(&pipeline->lock);
+
+    return ret;
+}
@@ -0,0 +1,18 @@
+#ifndef _VT100_PIPELINE_H
+#define _VT100_PIPELINE_H
+
+#include <stddef.h>
+
+struct vt100_pipeline;
+
+/* while a pipeline is running, vt100_screen_process_string only tokenizes
+ * its input, and the tokens are applied to the screen by a separate thread.
+ * the screen itself belongs to that thread until vt100_screen_wait_pipeline
+ * returns (or can be read through published frames in the meantime). */
+void vt100_screen_start_pipeline(VT100Screen *vt);
+void vt100_screen_wait_pipeline(VT100Screen *vt);
+void vt100_screen_stop_pipeline(VT100Screen *vt);
+void vt100_pipeline_push(
+    struct vt100_pipeline *pipeline, int type, char *buf, size_t len);
+
+#endif
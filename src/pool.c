@@ -0,0 +1,295 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+struct vt100_pool_task {
+    vt100_pool_task_fn fn;
+    void *data;
+};
+
+/* each worker owns a deque: the owner pushes and pops at the tail (so the
+ * most recently scheduled work stays hot in its cache), and idle workers
+ * steal from the head */
+struct vt100_pool_deque {
+    pthread_mutex_t lock;
+    struct vt100_pool_task *tasks;
+    size_t head;
+    size_t len;
+    size_t capacity;
+};
+
+struct vt100_pool_worker {
+    struct vt100_pool *pool;
+    struct vt100_pool_deque deque;
+    pthread_t thread;
+    int idx;
+};
+
+struct vt100_pool {
+    struct vt100_pool_worker *workers;
+    int nthreads;
+
+    atomic_uint next_worker;
+    atomic_int queued;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    int shutdown;
+};
+
+static _Thread_local struct vt100_pool_worker *vt100_pool_current_worker;
+
+static void *vt100_pool_worker_main(void *data);
+static int vt100_pool_find_task(
+    struct vt100_pool_worker *worker, struct vt100_pool_task *task);
+static void vt100_pool_deque_push(
+    struct vt100_pool_deque *deque, struct vt100_pool_task *task);
+static void vt100_pool_deque_push_head(
+    struct vt100_pool_deque *deque, struct vt100_pool_task *task);
+static void vt100_pool_deque_grow(struct vt100_pool_deque *deque);
+static int vt100_pool_deque_pop(
+    struct vt100_pool_deque *deque, struct vt100_pool_task *task);
+static int vt100_pool_deque_steal(
+    struct vt100_pool_deque *deque, struct vt100_pool_task *task);
+
+struct vt100_pool *vt100_pool_new(int nthreads)
+{
+    struct vt100_pool *pool;
+    int i;
+
+    if (nthreads <= 0) {
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+        if (nthreads <= 0) {
+            nthreads = 1;
+        }
+    }
+
+    pool = calloc(1, sizeof(struct vt100_pool));
+    pool->nthreads = nthreads;
+    pool->workers = calloc(nthreads, sizeof(struct vt100_pool_worker));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wakeup, NULL);
+
+    for (i = 0; i < nthreads; ++i) {
+        struct vt100_pool_worker *worker = &pool->workers[i];
+
+        worker->pool = pool;
+        worker->idx = i;
+        pthread_mutex_init(&worker->deque.lock, NULL);
+    }
+
+    for (i = 0; i < nthreads; ++i) {
+        struct vt100_pool_worker *worker = &pool->workers[i];
+
+        pthread_create(&worker->thread, NULL, vt100_pool_worker_main, worker);
+    }
+
+    return pool;
+}
+
+int vt100_pool_thread_count(struct vt100_pool *pool)
+{
+    return pool->nthreads;
+}
+
+void vt100_pool_submit(
+    struct vt100_pool *pool, vt100_pool_task_fn fn, void *data)
+{
+    struct vt100_pool_worker *worker = vt100_pool_current_worker;
+    struct vt100_pool_task task = { fn, data };
+
+    /* tasks submitted from outside the pool are spread round robin, tasks
+     * submitted by a worker stay local until somebody steals them */
+    if (!worker || worker->pool != pool) {
+        unsigned int idx = atomic_fetch_add(&pool->next_worker, 1);
+
+        worker = &pool->workers[idx % pool->nthreads];
+    }
+
+    vt100_pool_deque_push(&worker->deque, &task);
+    atomic_fetch_add(&pool->queued, 1);
+
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->wakeup);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* like vt100_pool_submit, but for a task that has just had its turn and
+ * wants another one: a worker puts it at the far end of its own deque, so
+ * that it runs after everything else already waiting there (and is the
+ * first thing an idle worker would steal) instead of straight away */
+void vt100_pool_yield(
+    struct vt100_pool *pool, vt100_pool_task_fn fn, void *data)
+{
+    struct vt100_pool_worker *worker = vt100_pool_current_worker;
+    struct vt100_pool_task task = { fn, data };
+
+    if (!worker || worker->pool != pool) {
+        vt100_pool_submit(pool, fn, data);
+        return;
+    }
+
+    vt100_pool_deque_push_head(&worker->deque, &task);
+    atomic_fetch_add(&pool->queued, 1);
+
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->wakeup);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void vt100_pool_delete(struct vt100_pool *pool)
+{
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->wakeup);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->nthreads; ++i) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+
+    for (i = 0; i < pool->nthreads; ++i) {
+        pthread_mutex_destroy(&pool->workers[i].deque.lock);
+        free(pool->workers[i].deque.tasks);
+    }
+    pthread_cond_destroy(&pool->wakeup);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool);
+}
+
+static void *vt100_pool_worker_main(void *data)
+{
+    struct vt100_pool_worker *worker = data;
+    struct vt100_pool *pool = worker->pool;
+
+    vt100_pool_current_worker = worker;
+
+    for (;;) {
+        struct vt100_pool_task task;
+
+        if (vt100_pool_find_task(worker, &task)) {
+            atomic_fetch_sub(&pool->queued, 1);
+            task.fn(task.data);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        while (atomic_load(&pool->queued) == 0 && !pool->shutdown) {
+            pthread_cond_wait(&pool->wakeup, &pool->lock);
+        }
+        /* queued work is always drained before the pool goes away */
+        if (pool->shutdown && atomic_load(&pool->queued) == 0) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return NULL;
+}
+
+static int vt100_pool_find_task(
+    struct vt100_pool_worker *worker, struct vt100_pool_task *task)
+{
+    struct vt100_pool *pool = worker->pool;
+    int i;
+
+    if (vt100_pool_deque_pop(&worker->deque, task)) {
+        return 1;
+    }
+
+    for (i = 1; i < pool->nthreads; ++i) {
+        struct vt100_pool_worker *victim;
+
+        victim = &pool->workers[(worker->idx + i) % pool->nthreads];
+        if (vt100_pool_deque_steal(&victim->deque, task)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void vt100_pool_deque_push(
+    struct vt100_pool_deque *deque, struct vt100_pool_task *task)
+{
+    pthread_mutex_lock(&deque->lock);
+    if (deque->len == deque->capacity) {
+        vt100_pool_deque_grow(deque);
+    }
+    deque->tasks[(deque->head + deque->len) % deque->capacity] = *task;
+    deque->len++;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+static void vt100_pool_deque_push_head(
+    struct vt100_pool_deque *deque, struct vt100_pool_task *task)
+{
+    pthread_mutex_lock(&deque->lock);
+    if (deque->len == deque->capacity) {
+        vt100_pool_deque_grow(deque);
+    }
+    deque->head = (deque->head + deque->capacity - 1) % deque->capacity;
+    deque->tasks[deque->head] = *task;
+    deque->len++;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+static void vt100_pool_deque_grow(struct vt100_pool_deque *deque)
+{
+    size_t capacity = deque->capacity ? deque->capacity * 2 : 16;
+    struct vt100_pool_task *tasks;
+    size_t i;
+
+    tasks = malloc(capacity * sizeof(struct vt100_pool_task));
+    for (i = 0; i < deque->len; ++i) {
+        tasks[i] = deque->tasks[(deque->head + i) % deque->capacity];
+    }
+    free(deque->tasks);
+    deque->tasks = tasks;
+    deque->head = 0;
+    deque->capacity = capacity;
+}
+
+static int vt100_pool_deque_pop(
+    struct vt100_pool_deque *deque, struct vt100_pool_task *task)
+{
+    int found = 0;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->len) {
+        deque->len--;
+        *task = deque->tasks[(deque->head + deque->len) % deque->capacity];
+        found = 1;
+    }
+    pthread_mutex_unlock(&deque->lock);
+
+    return found;
+}
+
+static int vt100_pool_deque_steal(
+    struct vt100_pool_deque *deque, struct vt100_pool_task *task)
+{
+    int found = 0;
+
+    /* don't queue up behind the owner, there are other victims to try */
+    if (pthread_mutex_trylock(&deque->lock)) {
+        return 0;
+    }
+    if (deque->len) {
+        *task = deque->tasks[deque->head];
+        deque->head = (deque->head + 1) % deque->capacity;
+        deque->len--;
+        found = 1;
+    }
+    pthread_mutex_unlock(&deque->lock);
+
+    return found;
+}
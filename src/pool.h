@@ -0,0 +1,16 @@
+#ifndef _VT100_POOL_H
+#define _VT100_POOL_H
+
+struct vt100_pool;
+
+typedef void (*vt100_pool_task_fn)(void *data);
+
+struct vt100_pool *vt100_pool_new(int nthreads);
+int vt100_pool_thread_count(struct vt100_pool *pool);
+void vt100_pool_submit(
+    struct vt100_pool *pool, vt100_pool_task_fn fn, void *data);
+void vt100_pool_yield(
+    struct vt100_pool *pool, vt100_pool_task_fn fn, void *data);
+void vt100_pool_delete(struct vt100_pool *pool);
+
+#endif
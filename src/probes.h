@@ -0,0 +1,38 @@
+#ifndef _VT100_PROBES_H
+#define _VT100_PROBES_H
+
+/* static tracepoints for perf, bpftrace, systemtap and the like, under the
+ * provider name vt100. they're built in when sys/sdt.h is available (the
+ * Makefile checks for it, or build with -DVT100_HAVE_SDT), and each one is
+ * a single nop until something attaches to it. the first argument is always
+ * the screen.
+ *
+ *   token(vt, type, buf, len)       a token from the scanner, before it's
+ *                                   applied (type is a VT100TokenType)
+ *   text(vt, buf, len)              a run of text being drawn
+ *   scroll__up(vt, count)           the screen or region scrolling
+ *   scroll__down(vt, count)
+ *   resize__start(vt, rows, cols)   around vt100_screen_set_window_size
+ *   resize__done(vt, rows, cols)
+ *   row__alloc(vt, ncells)          a row's cells being allocated
+ *   row__free(vt, count)            and freed
+ *
+ * for example:
+ *   bpftrace -e 'usdt:./libvt100.so:vt100:token { @[arg1] = count(); }' */
+
+#ifdef VT100_HAVE_SDT
+#include <sys/sdt.h>
+
+#define VT100_PROBE2(name, a, b) \
+    DTRACE_PROBE2(vt100, name, a, b)
+#define VT100_PROBE3(name, a, b, c) \
+    DTRACE_PROBE3(vt100, name, a, b, c)
+#define VT100_PROBE4(name, a, b, c, d) \
+    DTRACE_PROBE4(vt100, name, a, b, c, d)
+#else
+#define VT100_PROBE2(name, a, b)
+#define VT100_PROBE3(name, a, b, c)
+#define VT100_PROBE4(name, a, b, c, d)
+#endif
+
+#endif
@@ -0,0 +1,449 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vt100.h"
+
+/* the cells of a whole logical line, with the rows it was wrapped into
+ * joined back together */
+struct vt100_reflow_line {
+    struct vt100_cell *cells;
+    int len;
+    int capacity;
+};
+
+/* rewrapped rows are built up here before they replace the old ones */
+struct vt100_reflow_rows {
+    struct vt100_row *rows;
+    int count;
+    int capacity;
+};
+
+static int vt100_reflow_history(
+    VT100Screen *vt, struct vt100_grid *grid, int max_rows);
+static void vt100_reflow_rewrap(
+    VT100Screen *vt, struct vt100_grid *grid, int first, int last,
+    struct vt100_reflow_rows *out, struct vt100_loc **locs);
+static int vt100_reflow_row_length(struct vt100_grid *grid, int row, int end);
+static void vt100_reflow_emit(
+    VT100Screen *vt, struct vt100_grid *grid, struct vt100_reflow_line *line,
+    struct vt100_reflow_rows *out, struct vt100_loc **locs, int *offsets);
+static struct vt100_row *vt100_reflow_push_row(
+    VT100Screen *vt, struct vt100_reflow_rows *out);
+static void vt100_reflow_splice(
+    VT100Screen *vt, struct vt100_grid *grid, int first, int last,
+    struct vt100_reflow_rows *out);
+static void vt100_reflow_trim(VT100Screen *vt, struct vt100_grid *grid);
+static int vt100_reflow_row_is_blank(struct vt100_row *row);
+static void vt100_reflow_ensure_capacity(
+    VT100Screen *vt, struct vt100_grid *grid, int size);
+
+void vt100_screen_set_reflow(VT100Screen *vt, int reflow)
+{
+    vt->reflow = !!reflow;
+}
+
+int vt100_screen_reflow_scrollback(VT100Screen *vt, int max_rows)
+{
+    struct vt100_grid *grid;
+
+    vt100_screen_wait_pipeline(vt);
+
+    grid = vt->alternate ? vt->alternate : vt->grid;
+    if (!grid->reflow_pending) {
+        return 0;
+    }
+
+    grid->row_top += vt100_reflow_history(vt, grid, max_rows);
+    vt100_reflow_trim(vt, grid);
+
+    return grid->reflow_pending;
+}
+
+void vt100_reflow_resize(VT100Screen *vt)
+{
+    struct vt100_grid *grid = vt->grid;
+    struct vt100_reflow_rows out = { NULL, 0, 0 };
+    struct vt100_loc cur, saved, *locs[2];
+    int first, last, i;
+
+    /* the cursors are tracked as rows in grid->rows until it settles down */
+    cur.row = grid->row_top + grid->cur.row;
+    cur.col = grid->cur.col;
+    saved.row = grid->row_top + grid->saved.row;
+    saved.col = grid->saved.col;
+    locs[0] = &cur;
+    locs[1] = &saved;
+
+    /* the line at the top of the screen can start in the scrollback */
+    first = grid->row_top;
+    while (first > 0 && grid->rows[first - 1].wrapped) {
+        first--;
+    }
+
+    /* blank rows below the cursor are dropped rather than rewrapped, so
+     * that making the screen narrower doesn't push text off the top just
+     * to keep them around */
+    last = grid->row_count;
+    while (last - 1 > cur.row
+           && vt100_reflow_row_is_blank(&grid->rows[last - 1])) {
+        last--;
+    }
+
+    vt100_reflow_rewrap(vt, grid, first, last, &out, locs);
+    vt100_reflow_splice(vt, grid, first, grid->row_count, &out);
+    vt100_screen_free(vt, out.rows);
+
+    /* everything above where the rewrapping started is left for
+     * vt100_screen_reflow_scrollback */
+    grid->reflow_pending = first;
+
+    /* keep the bottom of the text on the screen. if the text got shorter,
+     * the screen can reach up past the rows that were just rewrapped, and
+     * those have to be done now too. */
+    for (;;) {
+        int count;
+
+        grid->row_top = grid->row_count - grid->max.row;
+        if (grid->row_top < 0) {
+            grid->row_top = 0;
+        }
+        if (grid->reflow_pending <= grid->row_top) {
+            break;
+        }
+
+        count = vt100_reflow_history(
+            vt, grid, grid->reflow_pending - grid->row_top);
+        cur.row += count;
+        saved.row += count;
+    }
+    vt100_reflow_ensure_capacity(vt, grid, grid->row_top + grid->max.row);
+    for (i = grid->row_count; i < grid->row_top + grid->max.row; ++i) {
+        memset(&grid->rows[i], 0, sizeof(struct vt100_row));
+    }
+    grid->row_count = grid->row_top + grid->max.row;
+
+    /* like the plain resize, this would rather move the cursor than lose
+     * the text below it if there's too much of that to fit */
+    grid->cur.row = cur.row - grid->row_top;
+    grid->cur.col = cur.col;
+    if (grid->cur.row < 0) {
+        grid->cur.row = 0;
+    }
+    grid->saved.row = saved.row - grid->row_top;
+    grid->saved.col = saved.col;
+    if (grid->saved.row < 0) {
+        grid->saved.row = 0;
+    }
+    if (grid->saved.row >= grid->max.row) {
+        grid->saved.row = grid->max.row - 1;
+    }
+    if (grid->saved.col > grid->max.col) {
+        grid->saved.col = grid->max.col;
+    }
+
+    vt100_reflow_trim(vt, grid);
+
+    /* the undo log can't keep track of the scrollback changing underneath
+     * it later on */
+    if (vt->undo) {
+        vt100_screen_reflow_scrollback(vt, INT_MAX);
+    }
+
+    vt->dirty = 1;
+}
+
+/* rewraps about max_rows more rows of the scrollback, in whole lines
+ * working up from the bottom (since the newest lines are the ones most
+ * likely to be looked at next), and returns how many rows that added */
+static int vt100_reflow_history(
+    VT100Screen *vt, struct vt100_grid *grid, int max_rows)
+{
+    struct vt100_reflow_rows out = { NULL, 0, 0 };
+    int first, last = grid->reflow_pending;
+
+    first = last;
+    while (first > 0 && last - first < max_rows) {
+        first--;
+        while (first > 0 && grid->rows[first - 1].wrapped) {
+            first--;
+        }
+    }
+
+    vt100_reflow_rewrap(vt, grid, first, last, &out, NULL);
+    vt100_reflow_splice(vt, grid, first, last, &out);
+    grid->reflow_pending = first;
+    vt100_screen_free(vt, out.rows);
+
+    return out.count - (last - first);
+}
+
+/* rewraps rows first..last - 1 of grid to grid->max.col, and moves each of
+ * locs (if any) to its new place, relative to first */
+static void vt100_reflow_rewrap(
+    VT100Screen *vt, struct vt100_grid *grid, int first, int last,
+    struct vt100_reflow_rows *out, struct vt100_loc **locs)
+{
+    struct vt100_reflow_line line = { NULL, 0, 0 };
+    int start = first, loc_rows[2] = { -1, -1 }, i;
+
+    /* locs get moved as lines are laid out, so match them up against where
+     * they started */
+    for (i = 0; locs && i < 2; ++i) {
+        loc_rows[i] = locs[i]->row;
+    }
+
+    while (start < last) {
+        int end = start, row, offsets[2] = { -1, -1 };
+
+        while (end < last - 1 && grid->rows[end].wrapped) {
+            end++;
+        }
+
+        line.len = 0;
+        for (row = start; row <= end; ++row) {
+            int len = vt100_reflow_row_length(grid, row, end);
+
+            for (i = 0; i < 2; ++i) {
+                if (loc_rows[i] == row) {
+                    offsets[i] = line.len + locs[i]->col;
+                }
+            }
+
+            if (line.len + len > line.capacity) {
+                line.capacity = (line.len + len) * 2;
+                line.cells = vt100_screen_realloc(
+                    vt, line.cells, line.capacity * sizeof(struct vt100_cell));
+            }
+            if (len) {
+                memcpy(
+                    &line.cells[line.len], grid->rows[row].cells,
+                    len * sizeof(struct vt100_cell));
+            }
+            line.len += len;
+        }
+
+        for (i = 0; locs && i < 2; ++i) {
+            if (offsets[i] != -1) {
+                locs[i]->row = first + out->count;
+            }
+        }
+        vt100_reflow_emit(vt, grid, &line, out, locs, offsets);
+
+        start = end + 1;
+    }
+
+    vt100_screen_free(vt, line.cells);
+}
+
+/* how many of the row's cells belong to its line: trailing blanks are left
+ * off the end of the line, and so is the blank that was left at the end of
+ * a row when a wide character didn't fit there */
+static int vt100_reflow_row_length(struct vt100_grid *grid, int row, int end)
+{
+    static const struct vt100_cell blank;
+    struct vt100_row *grid_row = &grid->rows[row];
+    int len = grid_row->ncells;
+
+    if (!grid_row->cells) {
+        return 0;
+    }
+
+    if (row == end) {
+        while (len > 0
+               && !memcmp(&grid_row->cells[len - 1], &blank, sizeof(blank))) {
+            len--;
+        }
+    }
+    else if (len > 0 && grid->rows[row + 1].cells
+             && grid->rows[row + 1].cells[0].is_wide
+             && !memcmp(&grid_row->cells[len - 1], &blank, sizeof(blank))
+             && !(len > 1 && grid_row->cells[len - 2].is_wide)) {
+        /* the blank left at the end of the row when a wide character
+         * didn't fit, as opposed to the second half of one that did */
+        len--;
+    }
+
+    return len;
+}
+
+/* lays the line out into rows of grid->max.col cells. locs that were on
+ * the line come in with locs[i]->row set to the first new row and
+ * offsets[i] set to how far into the line they were. */
+static void vt100_reflow_emit(
+    VT100Screen *vt, struct vt100_grid *grid, struct vt100_reflow_line *line,
+    struct vt100_reflow_rows *out, struct vt100_loc **locs, int *offsets)
+{
+    struct vt100_row *row;
+    int width = grid->max.col, col = 0, rows = 1, i, j;
+
+    row = vt100_reflow_push_row(vt, out);
+    for (i = 0; i < line->len; ++i) {
+        struct vt100_cell *cell = &line->cells[i];
+
+        /* wide characters can't be split across rows */
+        if (col > 0 && col + (cell->is_wide ? 2 : 1) > width) {
+            row->wrapped = 1;
+            row = vt100_reflow_push_row(vt, out);
+            col = 0;
+            rows++;
+        }
+
+        for (j = 0; locs && j < 2; ++j) {
+            if (offsets[j] == i) {
+                locs[j]->row += rows - 1;
+                locs[j]->col = col;
+            }
+        }
+
+        if (!row->cells) {
+            row->cells = vt100_screen_calloc(
+                vt, width, sizeof(struct vt100_cell));
+            row->ncells = width;
+            grid->cell_count += width;
+        }
+        if (col < width) {
+            row->cells[col] = *cell;
+        }
+        col++;
+    }
+
+    /* a cursor just after the last character stays there even if that's
+     * the end of a row. one further past the end of the text stays the same
+     * distance past it as far as the edge of the screen, since adding rows
+     * for it would change the text. */
+    for (j = 0; locs && j < 2; ++j) {
+        int extra = offsets[j] - line->len;
+
+        if (offsets[j] == -1 || extra < 0) {
+            continue;
+        }
+        locs[j]->row += rows - 1;
+        if (!extra) {
+            locs[j]->col = col;
+        }
+        else {
+            locs[j]->col = col + extra < width ? col + extra : width - 1;
+        }
+    }
+}
+
+static struct vt100_row *vt100_reflow_push_row(
+    VT100Screen *vt, struct vt100_reflow_rows *out)
+{
+    struct vt100_row *row;
+
+    if (out->count == out->capacity) {
+        out->capacity = out->capacity ? out->capacity * 2 : 64;
+        out->rows = vt100_screen_realloc(
+            vt, out->rows, out->capacity * sizeof(struct vt100_row));
+    }
+
+    row = &out->rows[out->count++];
+    memset(row, 0, sizeof(struct vt100_row));
+
+    return row;
+}
+
+/* replaces rows first..last - 1 of the grid with the rewrapped ones */
+static void vt100_reflow_splice(
+    VT100Screen *vt, struct vt100_grid *grid, int first, int last,
+    struct vt100_reflow_rows *out)
+{
+    int i, count = out->count - (last - first);
+
+    for (i = first; i < last; ++i) {
+        grid->cell_count -= grid->rows[i].cells ? grid->rows[i].ncells : 0;
+        vt100_screen_free(vt, grid->rows[i].cells);
+    }
+
+    vt100_reflow_ensure_capacity(vt, grid, grid->row_count + count);
+    memmove(
+        &grid->rows[first + out->count], &grid->rows[last],
+        (grid->row_count - last) * sizeof(struct vt100_row));
+    if (out->count) {
+        memcpy(
+            &grid->rows[first], out->rows,
+            out->count * sizeof(struct vt100_row));
+    }
+    if (count < 0) {
+        memset(
+            &grid->rows[grid->row_count + count], 0,
+            -count * sizeof(struct vt100_row));
+    }
+    grid->row_count += count;
+}
+
+/* lines get longer when the screen gets narrower, so this drops whatever
+ * no longer fits in the scrollback, the same way scrolling does */
+static void vt100_reflow_trim(VT100Screen *vt, struct vt100_grid *grid)
+{
+    int scrollback = vt->scrollback_length, count, i;
+
+    if (grid->row_count <= scrollback + scrollback / 10) {
+        return;
+    }
+
+    count = grid->row_count - scrollback;
+    if (count > grid->row_top) {
+        count = grid->row_top;
+    }
+    if (count <= 0) {
+        return;
+    }
+
+    for (i = 0; i < count; ++i) {
+        grid->cell_count -= grid->rows[i].cells ? grid->rows[i].ncells : 0;
+        vt100_screen_free(vt, grid->rows[i].cells);
+    }
+    memmove(
+        &grid->rows[0], &grid->rows[count],
+        (grid->row_count - count) * sizeof(struct vt100_row));
+    memset(
+        &grid->rows[grid->row_count - count], 0,
+        count * sizeof(struct vt100_row));
+
+    grid->row_count -= count;
+    grid->row_top -= count;
+    grid->reflow_pending = grid->reflow_pending > count
+        ? grid->reflow_pending - count : 0;
+}
+
+static int vt100_reflow_row_is_blank(struct vt100_row *row)
+{
+    static const struct vt100_cell blank;
+    int i;
+
+    if (row->wrapped) {
+        return 0;
+    }
+
+    for (i = 0; row->cells && i < row->ncells; ++i) {
+        if (memcmp(&row->cells[i], &blank, sizeof(blank))) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static void vt100_reflow_ensure_capacity(
+    VT100Screen *vt, struct vt100_grid *grid, int size)
+{
+    int old_capacity = grid->row_capacity;
+
+    if (grid->row_capacity >= size) {
+        return;
+    }
+
+    grid->row_capacity = grid->row_capacity * 3 / 2;
+    if (grid->row_capacity < size) {
+        grid->row_capacity = size;
+    }
+
+    grid->rows = vt100_screen_realloc(
+        vt, grid->rows, grid->row_capacity * sizeof(struct vt100_row));
+    memset(
+        &grid->rows[old_capacity], 0,
+        (grid->row_capacity - old_capacity) * sizeof(struct vt100_row));
+}
@@ -0,0 +1,21 @@
+#ifndef _VT100_REFLOW_H
+#define _VT100_REFLOW_H
+
+/* with reflow turned on, changing the width of the normal screen rewraps
+ * the lines on it to the new width (following the wrapped flags on the
+ * rows) instead of cutting them off, and the cursor stays on the same
+ * character. only the lines that reach the visible screen are rewrapped
+ * during the resize itself. the scrollback above them is left as it was
+ * until vt100_screen_reflow_scrollback gets to it, which works from the
+ * newest lines up, about max_rows rows at a time, and returns how many rows
+ * are still left to do. until then, those rows read the same as they would
+ * without reflow. the alternate screen is never reflowed, since the
+ * programs that use it redraw it themselves. */
+void vt100_screen_set_reflow(VT100Screen *vt, int reflow);
+int vt100_screen_reflow_scrollback(VT100Screen *vt, int max_rows);
+
+/* called by vt100_screen_set_window_size in place of fitting the rows to
+ * the new width, once grid->max has been updated */
+void vt100_reflow_resize(VT100Screen *vt);
+
+#endif
@@ -1,33 +1,93 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <glib.h>
 
 #include "vt100.h"
 #include "parser.h"
+#include "probes.h"
 
 struct vt100_parser_state {
     yyscan_t scanner;
     YY_BUFFER_STATE state;
+    /* the scanner writes to the buffer it's scanning, so the input is
+     * copied here first. it's kept from one buffer to the next (unless it
+     * had to grow past VT100_SCREEN_SCAN_BUFFER_MAX), since allocating a new
+     * one each time costs more than scanning a short buffer does. */
+    char *buf;
+    size_t capacity;
 };
 
+/* rows don't have any cells allocated until something is written to them,
+ * and this is what all of the cells in those rows look like */
+static struct vt100_cell vt100_screen_blank_cell;
+
+static void vt100_screen_resize(VT100Screen *vt, int rows, int cols);
+static size_t vt100_screen_scan(
+    VT100Screen *vt, const char *buf, size_t len);
+static size_t vt100_screen_lex(
+    VT100Screen *vt, const char *buf, size_t len);
+static int vt100_screen_can_fast_forward(VT100Screen *vt);
+static size_t vt100_screen_fast_forward(
+    VT100Screen *vt, const char *buf, size_t len, size_t *endp);
+static size_t vt100_screen_fast_forward_walk(
+    VT100Screen *vt, const char *buf, size_t len, size_t nth, size_t *endp);
+static void vt100_screen_fast_forward_token(
+    VT100Screen *vt, int type, const char *buf, size_t len);
+static size_t vt100_screen_sgr_or_el_length(const char *buf, size_t len);
+static double vt100_screen_now(void);
 static void vt100_screen_get_string(
     VT100Screen *vt, struct vt100_loc *start, struct vt100_loc *end,
     char **strp, size_t *lenp, int formatted);
-static void vt100_screen_push_string(char **strp, size_t *lenp,
-                                     size_t *capacity, char *append,
-                                     size_t append_len);
+static void vt100_screen_push_string(VT100Screen *vt, char **strp,
+                                     size_t *lenp, size_t *capacity,
+                                     char *append, size_t append_len);
 static void vt100_screen_ensure_capacity(VT100Screen *vt, int size);
 static struct vt100_row *vt100_screen_row_at(VT100Screen *vt, int row);
+static struct vt100_cell *vt100_screen_writable_cell_at(
+    VT100Screen *vt, int row, int col);
+static void vt100_screen_allocate_row(VT100Screen *vt, struct vt100_row *row);
+static void vt100_screen_clear_row(VT100Screen *vt, struct vt100_row *row);
+static void vt100_screen_erase_cells(
+    VT100Screen *vt, struct vt100_row *row, int col, int count);
+static void vt100_screen_fill_cells(
+    struct vt100_cell *cells, int count, const struct vt100_cell *cell);
+static void vt100_screen_rotate_rows(
+    VT100Screen *vt, int top, int bottom, int count);
+static void vt100_screen_reverse_rows(struct vt100_row *rows, int count);
+static void vt100_screen_fit_row(
+    VT100Screen *vt, struct vt100_grid *grid, struct vt100_row *row);
+static void vt100_screen_reset_grid(
+    VT100Screen *vt, struct vt100_grid *grid);
+static void vt100_screen_free_grid(VT100Screen *vt, struct vt100_grid *grid);
 static int vt100_screen_scroll_region_is_active(VT100Screen *vt);
-static void vt100_screen_check_wrap(VT100Screen *vt, int width);
+static int vt100_screen_margins_are_active(VT100Screen *vt);
+static void vt100_screen_scroll_columns(
+    VT100Screen *vt, int top, int bottom, int count);
+static void vt100_screen_copy_columns(
+    VT100Screen *vt, struct vt100_row *dst, struct vt100_row *src);
+static int vt100_screen_check_wrap(VT100Screen *vt, int width);
 
 VT100Screen *vt100_screen_new(int rows, int cols)
+{
+    return vt100_screen_new_with_allocator(rows, cols, NULL);
+}
+
+VT100Screen *vt100_screen_new_with_allocator(
+    int rows, int cols, struct vt100_allocator *allocator)
 {
     VT100Screen *vt;
 
-    vt = calloc(1, sizeof(VT100Screen));
+    if (allocator) {
+        vt = allocator->malloc(sizeof(VT100Screen), allocator->data);
+        memset(vt, 0, sizeof(VT100Screen));
+        vt->allocator = *allocator;
+    }
+    else {
+        vt = calloc(1, sizeof(VT100Screen));
+    }
     vt100_screen_init(vt);
     vt100_screen_set_window_size(vt, rows, cols);
 
@@ -36,16 +96,54 @@ VT100Screen *vt100_screen_new(int rows, int cols)
 
 void vt100_screen_init(VT100Screen *vt)
 {
-    vt->grid = calloc(1, sizeof(struct vt100_grid));
-    vt->parser_state = calloc(1, sizeof(struct vt100_parser_state));
+    vt->grid = vt100_screen_calloc(vt, 1, sizeof(struct vt100_grid));
+    vt->parser_state = vt100_screen_calloc(
+        vt, 1, sizeof(struct vt100_parser_state));
     vt100_parser_yylex_init_extra(vt, &vt->parser_state->scanner);
+    vt->frames = vt100_screen_frames_new();
 }
 
 void vt100_screen_set_window_size(VT100Screen *vt, int rows, int cols)
+{
+    unsigned long start = vt->timing ? vt100_stats_clock() : 0;
+
+    struct vt100_loc old_size;
+
+    if (vt->hibernating && !vt100_screen_wake(vt)) {
+        return;
+    }
+    vt100_screen_wait_pipeline(vt);
+
+    old_size = vt->grid->max;
+    VT100_PROBE3(resize__start, vt, rows, cols);
+    vt100_screen_resize(vt, rows, cols);
+    VT100_PROBE3(resize__done, vt, vt->grid->max.row, vt->grid->max.col);
+    if (vt->grid->max.row != old_size.row
+        || vt->grid->max.col != old_size.col) {
+        vt->dirty = 1;
+    }
+
+    /* readers of frames and events find out about the new size straight
+     * away, rather than with whatever output comes next */
+    vt100_screen_check_memory(vt);
+    vt100_screen_update_frame(vt);
+    if (vt->events) {
+        vt100_screen_flush_events(vt);
+    }
+    if (vt->timing) {
+        vt100_stats_add_time(&vt->stats.resize, start);
+    }
+}
+
+static void vt100_screen_resize(VT100Screen *vt, int rows, int cols)
 {
     struct vt100_loc old_size;
     int i;
 
+    if (vt->undo) {
+        vt100_undo_resize(vt, rows, cols);
+    }
+
     old_size.row = vt->grid->max.row;
     old_size.col = vt->grid->max.col;
 
@@ -65,6 +163,15 @@ void vt100_screen_set_window_size(VT100Screen *vt, int rows, int cols)
         return;
     }
 
+    if (vt->reflow && !vt->alternate && vt->grid->max.col != old_size.col) {
+        vt100_reflow_resize(vt);
+        vt->grid->scroll_top    = 0;
+        vt->grid->scroll_bottom = vt->grid->max.row - 1;
+        vt->grid->scroll_left   = 0;
+        vt->grid->scroll_right  = vt->grid->max.col - 1;
+        return;
+    }
+
     if (vt->grid->cur.row >= vt->grid->max.row) {
         vt->grid->cur.row = vt->grid->max.row - 1;
     }
@@ -74,20 +181,9 @@ void vt100_screen_set_window_size(VT100Screen *vt, int rows, int cols)
 
     vt100_screen_ensure_capacity(vt, vt->grid->max.row);
 
-    for (i = 0; i < vt->grid->row_count; ++i) {
-        vt->grid->rows[i].cells = realloc(
-            vt->grid->rows[i].cells,
-            vt->grid->max.col * sizeof(struct vt100_cell));
-        if (old_size.col < vt->grid->max.col) {
-            memset(
-                &vt->grid->rows[i].cells[old_size.col], 0,
-                (vt->grid->max.col - old_size.col) * sizeof(struct vt100_cell));
-        }
-    }
-
     for (i = vt->grid->row_count; i < vt->grid->max.row; ++i) {
-        vt->grid->rows[i].cells = calloc(
-            vt->grid->max.col, sizeof(struct vt100_cell));
+        vt->grid->rows[i].cells = NULL;
+        vt->grid->rows[i].wrapped = 0;
     }
 
     if (vt->grid->row_count < vt->grid->max.row) {
@@ -98,8 +194,15 @@ void vt100_screen_set_window_size(VT100Screen *vt, int rows, int cols)
         vt->grid->row_top = vt->grid->row_count - vt->grid->max.row;
     }
 
+    /* the scrollback is left alone, so this doesn't get slower as it grows */
+    for (i = vt->grid->row_top; i < vt->grid->row_count; ++i) {
+        vt100_screen_fit_row(vt, vt->grid, &vt->grid->rows[i]);
+    }
+
     vt->grid->scroll_top    = 0;
     vt->grid->scroll_bottom = vt->grid->max.row - 1;
+    vt->grid->scroll_left   = 0;
+    vt->grid->scroll_right  = vt->grid->max.col - 1;
 }
 
 void vt100_screen_set_scrollback_length(VT100Screen *vt, int rows)
@@ -108,57 +211,210 @@ void vt100_screen_set_scrollback_length(VT100Screen *vt, int rows)
     vt->custom_scrollback_length = 1;
 }
 
-int vt100_screen_process_string(VT100Screen *vt, char *buf, size_t len)
+void vt100_screen_set_fast_forward(VT100Screen *vt, int fast_forward)
 {
-    struct vt100_parser_state *state = vt->parser_state;
-    int remaining;
+    vt->fast_forward = !!fast_forward;
+}
 
-    state->state = vt100_parser_yy_scan_bytes(buf, len, state->scanner);
-    remaining = vt100_parser_yylex(state->scanner);
-    vt100_parser_yy_delete_buffer(state->state, state->scanner);
-    return len - remaining;
+int vt100_screen_process_string(
+    VT100Screen *vt, const char *buf, size_t len)
+{
+    unsigned long start = vt->timing ? vt100_stats_clock() : 0;
+    size_t parsed;
+
+    if (vt->hibernating && !vt100_screen_wake(vt)) {
+        return 0;
+    }
+    if (vt->undo) {
+        vt100_undo_begin_step(vt);
+    }
+
+    parsed = vt100_screen_scan(vt, buf, len);
+    vt->stats.bytes += parsed;
+    if (parsed < len) {
+        vt->stats.carryovers++;
+    }
+
+    /* once somebody has started publishing frames, keep them current (the
+     * pipeline thread takes care of this itself when it's running) */
+    if (!vt->pipeline) {
+        vt100_screen_check_memory(vt);
+        vt100_screen_update_frame(vt);
+        if (vt->events) {
+            vt100_screen_flush_events(vt);
+        }
+    }
+    if (vt->timing) {
+        vt100_stats_add_time(&vt->stats.process, start);
+    }
+
+    return parsed;
+}
+
+/* the budget is checked after each slice of this many bytes */
+#define VT100_SCREEN_BUDGET_SLICE 4096
+
+/* like vt100_screen_process_string, but stops early once the budget is
+ * spent, so that one very busy screen can't keep the thread it runs on from
+ * getting to anything else for long. the input is scanned a slice at a
+ * time, and a slice only ends between two escape sequences or in the middle
+ * of text, so stopping there is the same as if the input had been split
+ * there. returns how much of buf was consumed: what's left over is either
+ * what the budget didn't cover, or a partial escape sequence at the end, to
+ * be passed in again along with whatever comes after it. */
+size_t vt100_screen_process_string_budgeted(
+    VT100Screen *vt, const char *buf, size_t len, struct vt100_budget *budget)
+{
+    double start = vt100_screen_now(), elapsed = 0;
+    size_t parsed = 0, slice = VT100_SCREEN_BUDGET_SLICE;
+    unsigned long clock = vt->timing ? vt100_stats_clock() : 0;
+
+    if (vt->hibernating && !vt100_screen_wake(vt)) {
+        return 0;
+    }
+    if (vt->undo) {
+        vt100_undo_begin_step(vt);
+    }
+
+    while (parsed < len && !vt100_budget_is_spent(budget)) {
+        size_t size = len - parsed, done;
+
+        if (size > slice) {
+            size = slice;
+        }
+        if (size > budget->bytes && slice == VT100_SCREEN_BUDGET_SLICE) {
+            size = budget->bytes;
+        }
+
+        done = vt100_screen_scan(vt, buf + parsed, size);
+        if (!done) {
+            /* an escape sequence that doesn't fit in the slice (or what's
+             * left of the budget) has to be let through whole */
+            if (parsed + size == len) {
+                vt->stats.carryovers++;
+                break;
+            }
+            slice = size * 2;
+            continue;
+        }
+        slice = VT100_SCREEN_BUDGET_SLICE;
+
+        parsed += done;
+        budget->bytes -= done < budget->bytes ? done : budget->bytes;
+        elapsed = (vt100_screen_now() - start) * 1e6;
+        if (elapsed >= budget->usec) {
+            break;
+        }
+    }
+    budget->usec -= elapsed;
+    vt->stats.bytes += parsed;
+
+    if (!vt->pipeline) {
+        vt100_screen_check_memory(vt);
+        vt100_screen_update_frame(vt);
+        if (vt->events) {
+            vt100_screen_flush_events(vt);
+        }
+    }
+    if (vt->timing) {
+        vt100_stats_add_time(&vt->stats.process, clock);
+    }
+
+    return parsed;
+}
+
+int vt100_budget_is_spent(struct vt100_budget *budget)
+{
+    return budget->bytes == 0 || budget->usec <= 0;
 }
 
 void vt100_screen_get_string_formatted(
     VT100Screen *vt, struct vt100_loc *start, struct vt100_loc *end,
     char **strp, size_t *lenp)
 {
+    unsigned long clock = vt->timing ? vt100_stats_clock() : 0;
+
     vt100_screen_get_string(vt, start, end, strp, lenp, 1);
+    if (vt->timing) {
+        vt100_stats_add_time(&vt->stats.get_string, clock);
+    }
 }
 
 void vt100_screen_get_string_plaintext(
     VT100Screen *vt, struct vt100_loc *start, struct vt100_loc *end,
     char **strp, size_t *lenp)
 {
+    unsigned long clock = vt->timing ? vt100_stats_clock() : 0;
+
     vt100_screen_get_string(vt, start, end, strp, lenp, 0);
+    if (vt->timing) {
+        vt100_stats_add_time(&vt->stats.get_string, clock);
+    }
 }
 
+/* the returned cell is only for reading, since cells in rows that haven't
+ * been written to yet (or past the end of a narrower scrollback row) are
+ * all the same cell */
 struct vt100_cell *vt100_screen_cell_at(VT100Screen *vt, int row, int col)
 {
-    return &vt->grid->rows[row + vt->grid->row_top].cells[col];
+    struct vt100_row *grid_row = vt100_screen_row_at(vt, row);
+
+    if (!grid_row->cells || col >= grid_row->ncells) {
+        return &vt100_screen_blank_cell;
+    }
+
+    return &grid_row->cells[col];
 }
 
 void vt100_screen_audible_bell(VT100Screen *vt)
 {
     vt->audible_bell = 1;
+    if (vt->events) {
+        vt100_screen_push_event(vt, VT100_EVENT_AUDIBLE_BELL, 0);
+    }
 }
 
 void vt100_screen_visual_bell(VT100Screen *vt)
 {
     vt->visual_bell = 1;
+    if (vt->events) {
+        vt100_screen_push_event(vt, VT100_EVENT_VISUAL_BELL, 0);
+    }
 }
 
 void vt100_screen_show_string_ascii(VT100Screen *vt, char *buf, size_t len)
 {
     size_t i;
 
+    /* none of this is going to be seen, so all that matters is where the
+     * cursor ends up */
+    if (vt->fast_forwarding) {
+        vt->dirty = vt->dirty || len;
+        while (len) {
+            size_t n;
+
+            vt100_screen_check_wrap(vt, 1);
+            n = vt->grid->max.col - vt->grid->cur.col;
+            if (n > len) {
+                n = len;
+            }
+            vt->grid->cur.col += n;
+            len -= n;
+        }
+        return;
+    }
+
+    VT100_PROBE3(text, vt, buf, len);
     if (len) {
         vt->dirty = 1;
+        if (vt->undo) {
+            vt100_undo_save_row(vt, vt->grid->cur.row);
+        }
 
         if (vt->grid->cur.col > 0) {
             struct vt100_cell *cell;
 
-            cell = vt100_screen_cell_at(
+            cell = vt100_screen_writable_cell_at(
                 vt, vt->grid->cur.row, vt->grid->cur.col - 1);
             if (cell->is_wide) {
                 cell->len = 0;
@@ -166,18 +422,37 @@ void vt100_screen_show_string_ascii(VT100Screen *vt, char *buf, size_t len)
         }
     }
 
-    for (i = 0; i < len; ++i) {
-        struct vt100_cell *cell;
+    /* everything up to where the text wraps next goes into the same row */
+    i = 0;
+    while (i < len) {
+        struct vt100_row *row;
+        size_t n, j;
+
+        n = vt100_screen_check_wrap(vt, 1) - vt->grid->cur.col;
+        if (n > len - i) {
+            n = len - i;
+        }
 
-        vt100_screen_check_wrap(vt, 1);
-        cell = vt100_screen_cell_at(vt, vt->grid->cur.row, vt->grid->cur.col);
+        row = vt100_screen_row_at(vt, vt->grid->cur.row);
+        if (!row->cells) {
+            vt100_screen_allocate_row(vt, row);
+        }
+        for (j = 0; j < n; ++j) {
+            struct vt100_cell *cell = &row->cells[vt->grid->cur.col + j];
 
-        cell->len = 1;
-        cell->contents[0] = buf[i];
-        cell->attrs = vt->attrs;
-        cell->is_wide = 0;
+            cell->len = 1;
+            cell->contents[0] = buf[i + j];
+            cell->attrs = vt->attrs;
+            cell->is_wide = 0;
+        }
 
-        vt->grid->cur.col++;
+        /* wrapping counts as moving the cursor, until the next character
+         * is checked for wrapping */
+        if (n > 1) {
+            vt->grid->cur_from_text = 1;
+        }
+        vt->grid->cur.col += n;
+        i += n;
     }
 }
 
@@ -185,13 +460,17 @@ void vt100_screen_show_string_utf8(VT100Screen *vt, char *buf, size_t len)
 {
     char *c = buf, *next;
 
+    VT100_PROBE3(text, vt, buf, len);
     if (len) {
         vt->dirty = 1;
+        if (vt->undo) {
+            vt100_undo_save_row(vt, vt->grid->cur.row);
+        }
 
         if (vt->grid->cur.col > 0) {
             struct vt100_cell *cell;
 
-            cell = vt100_screen_cell_at(
+            cell = vt100_screen_writable_cell_at(
                 vt, vt->grid->cur.row, vt->grid->cur.col - 1);
             if (cell->is_wide) {
                 cell->len = 0;
@@ -209,11 +488,14 @@ void vt100_screen_show_string_utf8(VT100Screen *vt, char *buf, size_t len)
 
         if (width == 0) {
             if (vt->grid->cur.col > 0) {
-                cell = vt100_screen_cell_at(
+                cell = vt100_screen_writable_cell_at(
                     vt, vt->grid->cur.row, vt->grid->cur.col - 1);
             }
             else if (vt->grid->cur.row > 0 && vt100_screen_row_at(vt, vt->grid->cur.row - 1)->wrapped) {
-                cell = vt100_screen_cell_at(
+                if (vt->undo) {
+                    vt100_undo_save_row(vt, vt->grid->cur.row - 1);
+                }
+                cell = vt100_screen_writable_cell_at(
                     vt, vt->grid->cur.row - 1, vt->grid->max.col - 1);
             }
 
@@ -235,7 +517,7 @@ void vt100_screen_show_string_utf8(VT100Screen *vt, char *buf, size_t len)
         }
         else {
             vt100_screen_check_wrap(vt, width);
-            cell = vt100_screen_cell_at(
+            cell = vt100_screen_writable_cell_at(
                 vt, vt->grid->cur.row, vt->grid->cur.col);
 
             cell->len = next - c;
@@ -271,18 +553,22 @@ void vt100_screen_move_to(VT100Screen *vt, int row, int col)
 
     vt->grid->cur.row = row;
     vt->grid->cur.col = col;
+    vt->grid->cur_from_text = 0;
 }
 
 void vt100_screen_clear_screen(VT100Screen *vt)
 {
     int r;
 
+    if (vt->undo) {
+        vt100_undo_save_rows(vt, 0, vt->grid->max.row - 1);
+    }
+
     for (r = 0; r < vt->grid->max.row; ++r) {
         struct vt100_row *row;
 
         row = vt100_screen_row_at(vt, r);
-        memset(row->cells, 0, vt->grid->max.col * sizeof(struct vt100_cell));
-        row->wrapped = 0;
+        vt100_screen_clear_row(vt, row);
     }
 
     vt->dirty = 1;
@@ -293,15 +579,17 @@ void vt100_screen_clear_screen_forward(VT100Screen *vt)
     struct vt100_row *row;
     int r;
 
+    if (vt->undo) {
+        vt100_undo_save_rows(vt, vt->grid->cur.row, vt->grid->max.row - 1);
+    }
+
     row = vt100_screen_row_at(vt, vt->grid->cur.row);
-    memset(
-        &row->cells[vt->grid->cur.col], 0,
-        (vt->grid->max.col - vt->grid->cur.col) * sizeof(struct vt100_cell));
+    vt100_screen_erase_cells(
+        vt, row, vt->grid->cur.col, vt->grid->max.col - vt->grid->cur.col);
     row->wrapped = 0;
     for (r = vt->grid->cur.row + 1; r < vt->grid->max.row; ++r) {
         row = vt100_screen_row_at(vt, r);
-        memset(row->cells, 0, vt->grid->max.col * sizeof(struct vt100_cell));
-        row->wrapped = 0;
+        vt100_screen_clear_row(vt, row);
     }
 
     vt->dirty = 1;
@@ -312,13 +600,16 @@ void vt100_screen_clear_screen_backward(VT100Screen *vt)
     struct vt100_row *row;
     int r;
 
+    if (vt->undo) {
+        vt100_undo_save_rows(vt, 0, vt->grid->cur.row);
+    }
+
     for (r = 0; r < vt->grid->cur.row - 1; ++r) {
         row = vt100_screen_row_at(vt, r);
-        memset(row->cells, 0, vt->grid->max.col * sizeof(struct vt100_cell));
-        row->wrapped = 0;
+        vt100_screen_clear_row(vt, row);
     }
     row = vt100_screen_row_at(vt, vt->grid->cur.row);
-    memset(row->cells, 0, vt->grid->cur.col * sizeof(struct vt100_cell));
+    vt100_screen_erase_cells(vt, row, 0, vt->grid->cur.col);
 
     vt->dirty = 1;
 }
@@ -327,9 +618,12 @@ void vt100_screen_kill_line(VT100Screen *vt)
 {
     struct vt100_row *row;
 
+    if (vt->undo) {
+        vt100_undo_save_row(vt, vt->grid->cur.row);
+    }
+
     row = vt100_screen_row_at(vt, vt->grid->cur.row);
-    memset(row->cells, 0, vt->grid->max.col * sizeof(struct vt100_cell));
-    row->wrapped = 0;
+    vt100_screen_clear_row(vt, row);
 
     vt->dirty = 1;
 }
@@ -338,10 +632,13 @@ void vt100_screen_kill_line_forward(VT100Screen *vt)
 {
     struct vt100_row *row;
 
+    if (vt->undo) {
+        vt100_undo_save_row(vt, vt->grid->cur.row);
+    }
+
     row = vt100_screen_row_at(vt, vt->grid->cur.row);
-    memset(
-        &row->cells[vt->grid->cur.col], 0,
-        (vt->grid->max.col - vt->grid->cur.col) * sizeof(struct vt100_cell));
+    vt100_screen_erase_cells(
+        vt, row, vt->grid->cur.col, vt->grid->max.col - vt->grid->cur.col);
     row->wrapped = 0;
 
     vt->dirty = 1;
@@ -351,8 +648,12 @@ void vt100_screen_kill_line_backward(VT100Screen *vt)
 {
     struct vt100_row *row;
 
+    if (vt->undo) {
+        vt100_undo_save_rows(vt, vt->grid->cur.row - 1, vt->grid->cur.row);
+    }
+
     row = vt100_screen_row_at(vt, vt->grid->cur.row);
-    memset(row->cells, 0, vt->grid->cur.col * sizeof(struct vt100_cell));
+    vt100_screen_erase_cells(vt, row, 0, vt->grid->cur.col);
     if (vt->grid->cur.row > 0) {
         row = vt100_screen_row_at(vt, vt->grid->cur.row - 1);
         row->wrapped = 0;
@@ -364,105 +665,124 @@ void vt100_screen_kill_line_backward(VT100Screen *vt)
 void vt100_screen_insert_characters(VT100Screen *vt, int count)
 {
     struct vt100_row *row;
+    int col = vt->grid->cur.col, end = vt->grid->max.col;
 
-    row = vt100_screen_row_at(vt, vt->grid->cur.row);
-    if (count >= vt->grid->max.col - vt->grid->cur.col) {
-        vt100_screen_kill_line_forward(vt);
+    /* with left and right margins, only the part of the line between them
+     * moves */
+    if (vt100_screen_margins_are_active(vt)) {
+        if (col < vt->grid->scroll_left || col > vt->grid->scroll_right) {
+            return;
+        }
+        end = vt->grid->scroll_right + 1;
     }
-    else {
+    if (count > end - col) {
+        count = end - col;
+    }
+
+    if (vt->undo) {
+        vt100_undo_save_row(vt, vt->grid->cur.row);
+    }
+
+    row = vt100_screen_row_at(vt, vt->grid->cur.row);
+    if (row->cells) {
         memmove(
-            &row->cells[vt->grid->cur.col + count],
-            &row->cells[vt->grid->cur.col],
-            (vt->grid->max.col - vt->grid->cur.col - count) * sizeof(struct vt100_cell));
-        memset(
-            &row->cells[vt->grid->cur.col], 0,
-            count * sizeof(struct vt100_cell));
-        row->wrapped = 0;
+            &row->cells[col + count], &row->cells[col],
+            (end - col - count) * sizeof(struct vt100_cell));
     }
+    vt100_screen_erase_cells(vt, row, col, count);
+    row->wrapped = 0;
 
     vt->dirty = 1;
 }
 
 void vt100_screen_insert_lines(VT100Screen *vt, int count)
 {
-    if (count >= vt->grid->max.row - vt->grid->cur.row) {
-        vt100_screen_clear_screen_forward(vt);
-        vt100_screen_kill_line(vt);
+    int top = vt->grid->cur.row, bottom = vt->grid->scroll_bottom;
+
+    /* lines can only be inserted inside the scroll region */
+    if (top < vt->grid->scroll_top || top > bottom) {
+        return;
+    }
+    if (count > bottom - top + 1) {
+        count = bottom - top + 1;
     }
-    else {
-        struct vt100_row *row;
-        int bottom = vt->grid->scroll_bottom + 1;
-        int i;
 
-        for (i = bottom - count; i < bottom; ++i) {
-            row = vt100_screen_row_at(vt, i);
-            free(row->cells);
-        }
-        row = vt100_screen_row_at(vt, vt->grid->cur.row);
-        memmove(
-            row + count, row,
-            (bottom - vt->grid->cur.row - count) * sizeof(struct vt100_row));
-        memset(row, 0, count * sizeof(struct vt100_row));
-        for (i = vt->grid->cur.row; i < vt->grid->cur.row + count; ++i) {
-            row = vt100_screen_row_at(vt, i);
-            row->cells = calloc(vt->grid->max.col, sizeof(struct vt100_cell));
-            row->wrapped = 0;
+    if (vt100_screen_margins_are_active(vt)) {
+        int col = vt->grid->cur.col;
+
+        if (col >= vt->grid->scroll_left && col <= vt->grid->scroll_right) {
+            vt100_screen_scroll_columns(vt, top, bottom, -count);
+            vt->dirty = 1;
         }
+        return;
     }
 
+    if (vt->undo) {
+        vt100_undo_scroll(vt, top, bottom, -count);
+    }
+    vt100_screen_rotate_rows(vt, top, bottom, -count);
+
     vt->dirty = 1;
 }
 
 void vt100_screen_delete_characters(VT100Screen *vt, int count)
 {
-    if (count >= vt->grid->max.col - vt->grid->cur.col) {
-        vt100_screen_kill_line_forward(vt);
+    struct vt100_row *row;
+    int col = vt->grid->cur.col, end = vt->grid->max.col;
+
+    if (vt100_screen_margins_are_active(vt)) {
+        if (col < vt->grid->scroll_left || col > vt->grid->scroll_right) {
+            return;
+        }
+        end = vt->grid->scroll_right + 1;
+    }
+    if (count > end - col) {
+        count = end - col;
     }
-    else {
-        struct vt100_row *row;
 
-        row = vt100_screen_row_at(vt, vt->grid->cur.row);
+    if (vt->undo) {
+        vt100_undo_save_row(vt, vt->grid->cur.row);
+    }
+
+    row = vt100_screen_row_at(vt, vt->grid->cur.row);
+    if (row->cells) {
         memmove(
-            &row->cells[vt->grid->cur.col],
-            &row->cells[vt->grid->cur.col + count],
-            (vt->grid->max.col - vt->grid->cur.col - count) * sizeof(struct vt100_cell));
-        memset(
-            &row->cells[vt->grid->max.col - count], 0,
-            count * sizeof(struct vt100_cell));
-        row->wrapped = 0;
+            &row->cells[col], &row->cells[col + count],
+            (end - col - count) * sizeof(struct vt100_cell));
     }
+    vt100_screen_erase_cells(vt, row, end - count, count);
+    row->wrapped = 0;
 
     vt->dirty = 1;
 }
 
 void vt100_screen_delete_lines(VT100Screen *vt, int count)
 {
-    if (count >= vt->grid->max.row - vt->grid->cur.row) {
-        vt100_screen_clear_screen_forward(vt);
-        vt100_screen_kill_line(vt);
+    int top = vt->grid->cur.row, bottom = vt->grid->scroll_bottom;
+
+    /* lines can only be deleted inside the scroll region */
+    if (top < vt->grid->scroll_top || top > bottom) {
+        return;
+    }
+    if (count > bottom - top + 1) {
+        count = bottom - top + 1;
     }
-    else {
-        struct vt100_row *row;
-        int bottom = vt->grid->scroll_bottom + 1;
-        int i;
 
-        for (i = vt->grid->cur.row; i < vt->grid->cur.row + count; ++i) {
-            row = vt100_screen_row_at(vt, i);
-            free(row->cells);
-        }
-        row = vt100_screen_row_at(vt, vt->grid->cur.row);
-        memmove(
-            row, row + count,
-            (bottom - vt->grid->cur.row - count) * sizeof(struct vt100_row));
-        row = vt100_screen_row_at(vt, bottom - count);
-        memset(row, 0, count * sizeof(struct vt100_row));
-        for (i = bottom - count; i < bottom; ++i) {
-            row = vt100_screen_row_at(vt, i);
-            row->cells = calloc(vt->grid->max.col, sizeof(struct vt100_cell));
-            row->wrapped = 0;
+    if (vt100_screen_margins_are_active(vt)) {
+        int col = vt->grid->cur.col;
+
+        if (col >= vt->grid->scroll_left && col <= vt->grid->scroll_right) {
+            vt100_screen_scroll_columns(vt, top, bottom, count);
+            vt->dirty = 1;
         }
+        return;
     }
 
+    if (vt->undo) {
+        vt100_undo_scroll(vt, top, bottom, count);
+    }
+    vt100_screen_rotate_rows(vt, top, bottom, count);
+
     vt->dirty = 1;
 }
 
@@ -473,15 +793,12 @@ void vt100_screen_erase_characters(VT100Screen *vt, int count)
     }
     else {
         struct vt100_row *row;
-        int i;
-
-        row = vt100_screen_row_at(vt, vt->grid->cur.row);
 
-        for (i = vt->grid->cur.col; i < vt->grid->cur.col + count; ++i) {
-            struct vt100_cell *cell = &row->cells[i];
-
-            cell->len = 0;
+        if (vt->undo) {
+            vt100_undo_save_row(vt, vt->grid->cur.row);
         }
+        row = vt100_screen_row_at(vt, vt->grid->cur.row);
+        vt100_screen_erase_cells(vt, row, vt->grid->cur.col, count);
     }
 
     vt->dirty = 1;
@@ -493,27 +810,24 @@ void vt100_screen_scroll_down(VT100Screen *vt, int count)
     int bottom = vt->grid->scroll_bottom, top = vt->grid->scroll_top;
     int i;
 
-    if (bottom - top + 1 > count) {
-        for (i = 0; i < count; ++i) {
-            row = vt100_screen_row_at(vt, bottom - i);
-            free(row->cells);
-        }
-        row = vt100_screen_row_at(vt, top);
-        memmove(
-            row + count, row,
-            (bottom - top + 1 - count) * sizeof(struct vt100_row));
-        for (i = 0; i < count; ++i) {
-            row = vt100_screen_row_at(vt, top + i);
-            row->cells = calloc(vt->grid->max.col, sizeof(struct vt100_cell));
-            row->wrapped = 0;
+    vt->stats.scrolls += count;
+    VT100_PROBE2(scroll__down, vt, count);
+    if (vt100_screen_margins_are_active(vt)) {
+        vt100_screen_scroll_columns(vt, top, bottom, -count);
+    }
+    else if (bottom - top + 1 > count) {
+        if (vt->undo) {
+            vt100_undo_scroll(vt, top, bottom, -count);
         }
+        vt100_screen_rotate_rows(vt, top, bottom, -count);
     }
     else {
+        if (vt->undo) {
+            vt100_undo_save_rows(vt, top, bottom);
+        }
         for (i = 0; i < bottom - top + 1; ++i) {
             row = vt100_screen_row_at(vt, top + i);
-            memset(
-                row->cells, 0, vt->grid->max.col * sizeof(struct vt100_cell));
-            row->wrapped = 0;
+            vt100_screen_clear_row(vt, row);
         }
     }
 
@@ -525,32 +839,27 @@ void vt100_screen_scroll_up(VT100Screen *vt, int count)
     struct vt100_row *row;
     int i;
 
+    vt->stats.scrolls += count;
+    VT100_PROBE2(scroll__up, vt, count);
     if (vt100_screen_scroll_region_is_active(vt) || vt->alternate) {
         int bottom = vt->grid->scroll_bottom, top = vt->grid->scroll_top;
 
-        if (bottom - top + 1 > count) {
-            for (i = 0; i < count; ++i) {
-                row = vt100_screen_row_at(vt, top + i);
-                free(row->cells);
-            }
-            row = vt100_screen_row_at(vt, top);
-            memmove(
-                row, row + count,
-                (bottom - top + 1 - count) * sizeof(struct vt100_row));
-            for (i = 0; i < count; ++i) {
-                row = vt100_screen_row_at(vt, bottom - i);
-                row->cells = calloc(
-                    vt->grid->max.col, sizeof(struct vt100_cell));
-                row->wrapped = 0;
+        if (vt100_screen_margins_are_active(vt)) {
+            vt100_screen_scroll_columns(vt, top, bottom, count);
+        }
+        else if (bottom - top + 1 > count) {
+            if (vt->undo) {
+                vt100_undo_scroll(vt, top, bottom, count);
             }
+            vt100_screen_rotate_rows(vt, top, bottom, count);
         }
         else {
+            if (vt->undo) {
+                vt100_undo_save_rows(vt, top, bottom);
+            }
             for (i = 0; i < bottom - top + 1; ++i) {
                 row = vt100_screen_row_at(vt, top + i);
-                memset(
-                    row->cells, 0,
-                    vt->grid->max.col * sizeof(struct vt100_cell));
-                row->wrapped = 0;
+                vt100_screen_clear_row(vt, row);
             }
         }
     }
@@ -563,26 +872,41 @@ void vt100_screen_scroll_up(VT100Screen *vt, int count)
         if (overflow > 0) {
             int shift = overflow + slack;
 
+            if (vt->undo) {
+                vt100_undo_trim(vt, shift, count);
+            }
             vt100_screen_ensure_capacity(vt, max_row_buffer_size);
             for (i = 0; i < shift; ++i) {
-                free(vt->grid->rows[i].cells);
+                if (vt->grid->rows[i].cells) {
+                    vt->grid->cell_count -= vt->grid->rows[i].ncells;
+                    vt100_screen_free(vt, vt->grid->rows[i].cells);
+                    vt->stats.rows_freed++;
+                }
             }
+            VT100_PROBE2(row__free, vt, shift);
+            /* row_count is usually max_row_buffer_size here, but can be more
+             * if the scrollback length was just made shorter */
             memmove(
                 &vt->grid->rows[0], &vt->grid->rows[shift],
-                (max_row_buffer_size - shift) * sizeof(struct vt100_row));
+                (vt->grid->row_count - shift) * sizeof(struct vt100_row));
             for (i = scrollback - count; i < scrollback; ++i) {
-                vt->grid->rows[i].cells = calloc(
-                    vt->grid->max.col, sizeof(struct vt100_cell));
+                vt->grid->rows[i].cells = NULL;
+                vt100_screen_clear_row(vt, &vt->grid->rows[i]);
             }
             vt->grid->row_count = scrollback;
             vt->grid->row_top = scrollback - vt->grid->max.row;
+            vt->grid->reflow_pending = vt->grid->reflow_pending > shift
+                ? vt->grid->reflow_pending - shift : 0;
         }
         else {
+            if (vt->undo) {
+                vt100_undo_grow(vt, count);
+            }
             vt100_screen_ensure_capacity(vt, vt->grid->row_count + count);
             for (i = 0; i < count; ++i) {
                 row = vt100_screen_row_at(vt, i + vt->grid->max.row);
-                row->cells = calloc(
-                    vt->grid->max.col, sizeof(struct vt100_cell));
+                row->cells = NULL;
+                vt100_screen_clear_row(vt, row);
             }
             vt->grid->row_count += count;
             vt->grid->row_top += count;
@@ -615,20 +939,29 @@ void vt100_screen_move_up_or_scroll(VT100Screen *vt)
 void vt100_screen_set_scroll_region(
     VT100Screen *vt, int top, int bottom, int left, int right)
 {
-    if (left > 0 || right < vt->grid->max.col - 1) {
-        fprintf(stderr, "vertical scroll regions not yet implemented\n");
-    }
-
-    if (top > bottom) {
-        return;
-    }
-
-    vt->grid->scroll_top = top < 0
+    top = top < 0
         ? 0
         : top;
-    vt->grid->scroll_bottom = bottom >= vt->grid->max.row
+    bottom = bottom >= vt->grid->max.row
         ? vt->grid->max.row - 1
         : bottom;
+    left = left < 0
+        ? 0
+        : left;
+    right = right >= vt->grid->max.col
+        ? vt->grid->max.col - 1
+        : right;
+
+    /* checked after clamping, since a region that starts past the edge of
+     * the screen would otherwise end before it starts */
+    if (top > bottom || left > right) {
+        return;
+    }
+
+    vt->grid->scroll_top = top;
+    vt->grid->scroll_bottom = bottom;
+    vt->grid->scroll_left = left;
+    vt->grid->scroll_right = right;
 }
 
 void vt100_screen_reset_text_attributes(VT100Screen *vt)
@@ -722,33 +1055,50 @@ void vt100_screen_use_alternate_buffer(VT100Screen *vt)
         return;
     }
 
+    if (vt->undo) {
+        vt100_undo_alternate(vt);
+    }
+    if (vt->events) {
+        vt100_screen_push_event(vt, VT100_EVENT_ALTERNATE_SCREEN, 1);
+    }
     vt->alternate = vt->grid;
-    vt->grid = calloc(1, sizeof(struct vt100_grid));
-    vt100_screen_set_window_size(
+    if (vt->spare) {
+        vt->grid = vt->spare;
+        vt->spare = NULL;
+    }
+    else {
+        vt->grid = vt100_screen_calloc(vt, 1, sizeof(struct vt100_grid));
+    }
+    vt100_screen_resize(
         vt, vt->alternate->max.row, vt->alternate->max.col
     );
+    vt100_screen_reset_grid(vt, vt->grid);
 
     vt->dirty = 1;
 }
 
 void vt100_screen_use_normal_buffer(VT100Screen *vt)
 {
-    int i;
-
     if (!vt->alternate) {
         return;
     }
 
-    for (i = 0; i < vt->grid->row_count; ++i) {
-        free(vt->grid->rows[i].cells);
+    if (vt->undo) {
+        vt100_undo_alternate(vt);
     }
-    free(vt->grid->rows);
-    free(vt->grid);
+    if (vt->events) {
+        vt100_screen_push_event(vt, VT100_EVENT_ALTERNATE_SCREEN, 0);
+    }
+    /* programs switch back and forth a lot, so hang on to the alternate
+     * grid rather than allocating a new one every time (there's only
+     * ever one, though) */
+    vt100_screen_free_grid(vt, vt->spare);
+    vt->spare = vt->grid;
 
     vt->grid = vt->alternate;
     vt->alternate = NULL;
 
-    vt100_screen_set_window_size(vt, vt->grid->max.row, vt->grid->max.col);
+    vt100_screen_resize(vt, vt->grid->max.row, vt->grid->max.col);
 
     vt->dirty = 1;
 }
@@ -761,6 +1111,15 @@ void vt100_screen_save_cursor(VT100Screen *vt)
 void vt100_screen_restore_cursor(VT100Screen *vt)
 {
     vt->grid->cur = vt->grid->saved;
+    vt->grid->cur_from_text = 0;
+
+    /* the window can have shrunk since the cursor was saved */
+    if (vt->grid->cur.row >= vt->grid->max.row) {
+        vt->grid->cur.row = vt->grid->max.row - 1;
+    }
+    if (vt->grid->cur.col > vt->grid->max.col) {
+        vt->grid->cur.col = vt->grid->max.col;
+    }
 }
 
 void vt100_screen_show_cursor(VT100Screen *vt)
@@ -894,30 +1253,103 @@ void vt100_screen_reset_origin_mode(VT100Screen *vt)
     vt->origin_mode = 0;
 }
 
+void vt100_screen_set_left_right_margin_mode(VT100Screen *vt)
+{
+    vt->left_right_margin_mode = 1;
+}
+
+/* the margins only exist while the mode is set */
+void vt100_screen_reset_left_right_margin_mode(VT100Screen *vt)
+{
+    vt->left_right_margin_mode = 0;
+    vt->grid->scroll_left = 0;
+    vt->grid->scroll_right = vt->grid->max.col - 1;
+}
+
+/* while a synchronized update (DECSET 2026) is being drawn, frames aren't
+ * published, so readers only ever see the finished update. a program that
+ * never ends its update only holds things up for this long (in seconds). */
+#define VT100_SYNCHRONIZED_OUTPUT_TIMEOUT 0.15
+
+void vt100_screen_set_synchronized_output(VT100Screen *vt)
+{
+    if (vt->synchronized_output) {
+        return;
+    }
+
+    vt->synchronized_output = 1;
+    vt->synchronized_output_start = vt100_screen_now();
+}
+
+void vt100_screen_reset_synchronized_output(VT100Screen *vt)
+{
+    if (!vt->synchronized_output) {
+        return;
+    }
+
+    /* the update is finished, so show it now, before anything after it in
+     * the same buffer starts on the next one */
+    vt->synchronized_output = 0;
+    vt100_screen_update_frame(vt);
+}
+
+/* whether the screen is in a state that's worth showing, which it isn't
+ * partway through a synchronized update that hasn't timed out */
+int vt100_screen_frame_is_complete(VT100Screen *vt)
+{
+    if (!vt->synchronized_output) {
+        return 1;
+    }
+
+    return vt100_screen_now() - vt->synchronized_output_start
+        >= VT100_SYNCHRONIZED_OUTPUT_TIMEOUT;
+}
+
 void vt100_screen_set_window_title(VT100Screen *vt, char *buf, size_t len)
 {
-    free(vt->title);
+    if (vt->undo) {
+        vt100_undo_title(vt);
+    }
+    vt100_screen_free(vt, vt->title);
     vt->title_len = len;
-    vt->title = malloc(vt->title_len);
+    vt->title = vt100_screen_malloc(vt, vt->title_len);
     memcpy(vt->title, buf, vt->title_len);
     vt->update_title = 1;
+    if (vt->events) {
+        vt100_screen_push_string_event(vt, VT100_EVENT_TITLE, buf, len);
+    }
 }
 
 void vt100_screen_set_icon_name(VT100Screen *vt, char *buf, size_t len)
 {
-    free(vt->icon_name);
+    if (vt->undo) {
+        vt100_undo_icon_name(vt);
+    }
+    vt100_screen_free(vt, vt->icon_name);
     vt->icon_name_len = len;
-    vt->icon_name = malloc(vt->icon_name_len);
+    vt->icon_name = vt100_screen_malloc(vt, vt->icon_name_len);
     memcpy(vt->icon_name, buf, vt->icon_name_len);
     vt->update_icon_name = 1;
+    if (vt->events) {
+        vt100_screen_push_string_event(vt, VT100_EVENT_ICON_NAME, buf, len);
+    }
 }
 
 int vt100_screen_row_max_col(VT100Screen *vt, int row)
 {
     struct vt100_cell *cells = vt->grid->rows[row].cells;
-    int i, max = -1;
+    int i, ncells, max = -1;
+
+    if (!cells) {
+        return 0;
+    }
 
-    for (i = 0; i < vt->grid->max.col; ++i) {
+    ncells = vt->grid->rows[row].ncells;
+    if (ncells > vt->grid->max.col) {
+        ncells = vt->grid->max.col;
+    }
+
+    for (i = 0; i < ncells; ++i) {
         if (cells[i].len) {
             max = i;
         }
@@ -1052,29 +1484,47 @@ int vt100_screen_format_mouse_reporting_response(
     }
 }
 
-void vt100_screen_cleanup(VT100Screen *vt)
+size_t vt100_screen_parser_memory_usage(VT100Screen *vt)
 {
-    int i;
+    return sizeof(struct vt100_parser_state)
+        + vt->parser_state->capacity
+        + vt100_parser_memory_usage(vt->parser_state->scanner);
+}
+
+void vt100_screen_free_scan_buffer(VT100Screen *vt)
+{
+    vt100_screen_free(vt, vt->parser_state->buf);
+    vt->parser_state->buf = NULL;
+    vt->parser_state->capacity = 0;
+}
 
+void vt100_screen_cleanup(VT100Screen *vt)
+{
+    vt100_screen_stop_pipeline(vt);
+    vt100_screen_stop_undo_log(vt);
     vt100_screen_use_normal_buffer(vt);
 
-    for (i = 0; i < vt->grid->row_count; ++i) {
-        free(vt->grid->rows[i].cells);
-    }
-    free(vt->grid->rows);
-    free(vt->grid);
+    vt100_screen_free_grid(vt, vt->grid);
+    vt100_screen_free_grid(vt, vt->spare);
+    vt100_screen_forget_memory(vt);
 
-    free(vt->title);
-    free(vt->icon_name);
+    vt100_screen_free(vt, vt->title);
+    vt100_screen_free(vt, vt->icon_name);
+    vt100_screen_discard_events(vt);
+    vt100_screen_free_diagnostics(vt);
 
     vt100_parser_yylex_destroy(vt->parser_state->scanner);
-    free(vt->parser_state);
+    vt100_screen_free_scan_buffer(vt);
+    vt100_screen_free(vt, vt->parser_state);
+
+    vt100_screen_frames_delete(vt);
 }
 
 void vt100_screen_delete(VT100Screen *vt)
 {
     vt100_screen_cleanup(vt);
-    free(vt);
+    /* this reads the allocator out of vt before handing vt to it */
+    vt100_screen_free(vt, vt);
 }
 
 static void vt100_screen_get_string(
@@ -1094,7 +1544,7 @@ static void vt100_screen_get_string(
         return;
     }
 
-    *strp = malloc(capacity);
+    *strp = vt100_screen_malloc(vt, capacity);
 
     for (row = start->row; row <= end->row; ++row) {
         int start_col, end_col, max_col, was_wide = 0;
@@ -1131,7 +1581,8 @@ static void vt100_screen_get_string(
         }
 
         for (col = start_col; col < end_col; ++col) {
-            struct vt100_cell *cell = &grid_row->cells[col];
+            struct vt100_cell *cell = col < grid_row->ncells
+                ? &grid_row->cells[col] : &vt100_screen_blank_cell;
             char *contents = cell->contents;
             size_t len = cell->len;
 
@@ -1180,7 +1631,8 @@ static void vt100_screen_get_string(
                 if (attrs.inverse != cell->attrs.inverse) {
                     attr_codes[5] = cell->attrs.inverse ? 7 : 27;
                 }
-                vt100_screen_push_string(strp, lenp, &capacity, "\033[", 2);
+                vt100_screen_push_string(
+                    vt, strp, lenp, &capacity, "\033[", 2);
                 for (i = 0; i < sizeof(attr_codes) / sizeof(int); ++i) {
                     char buf[3];
 
@@ -1189,15 +1641,16 @@ static void vt100_screen_get_string(
                     }
 
                     if (!first) {
-                        vt100_screen_push_string(strp, lenp, &capacity, ";", 1);
+                        vt100_screen_push_string(
+                            vt, strp, lenp, &capacity, ";", 1);
                     }
                     sprintf(buf, "%d", attr_codes[i]);
-                    vt100_screen_push_string(strp, lenp, &capacity, buf,
-                                             strlen(buf));
+                    vt100_screen_push_string(
+                        vt, strp, lenp, &capacity, buf, strlen(buf));
 
                     first = 0;
                 }
-                vt100_screen_push_string(strp, lenp, &capacity, "m", 1);
+                vt100_screen_push_string(vt, strp, lenp, &capacity, "m", 1);
                 memcpy(&attrs, &cell->attrs, sizeof(struct vt100_cell_attrs));
             }
 
@@ -1207,25 +1660,29 @@ static void vt100_screen_get_string(
                     len = 1;
                 }
 
-                vt100_screen_push_string(strp, lenp, &capacity, contents, len);
+                vt100_screen_push_string(
+                    vt, strp, lenp, &capacity, contents, len);
             }
 
             was_wide = cell->is_wide;
         }
 
         if ((row != end->row || end->col > max_col) && !grid_row->wrapped) {
-            vt100_screen_push_string(strp, lenp, &capacity, "\n", 1);
+            vt100_screen_push_string(vt, strp, lenp, &capacity, "\n", 1);
         }
     }
 }
 
-static void vt100_screen_push_string(char **strp, size_t *lenp,
-                                     size_t *capacity, char *append,
-                                     size_t append_len)
+static void vt100_screen_push_string(VT100Screen *vt, char **strp,
+                                     size_t *lenp, size_t *capacity,
+                                     char *append, size_t append_len)
 {
     if (*lenp + append_len > *capacity) {
-        *capacity *= 1.5;
-        *strp = realloc(*strp, *capacity);
+        /* growing by half isn't always enough while the string is short */
+        while (*lenp + append_len > *capacity) {
+            *capacity *= 1.5;
+        }
+        *strp = vt100_screen_realloc(vt, *strp, *capacity);
     }
     memcpy(*strp + *lenp, append, append_len);
     *lenp += append_len;
@@ -1247,13 +1704,261 @@ static void vt100_screen_ensure_capacity(VT100Screen *vt, int size)
         vt->grid->row_capacity *= 1.5;
     }
 
-    vt->grid->rows = realloc(
-        vt->grid->rows, vt->grid->row_capacity * sizeof(struct vt100_row));
+    vt->grid->rows = vt100_screen_realloc(
+        vt, vt->grid->rows, vt->grid->row_capacity * sizeof(struct vt100_row));
     memset(
         &vt->grid->rows[old_capacity], 0,
         (vt->grid->row_capacity - old_capacity) * sizeof(struct vt100_row));
 }
 
+/* with fast forward on, the buffer is lexed a piece at a time: whatever can
+ * be fast forwarded over, then up to a line feed a bit further on, from
+ * where it's worth looking again. a line feed is always a token of its own,
+ * so lexing the pieces separately is the same as lexing it all at once. */
+#define VT100_SCREEN_FAST_FORWARD_CHUNK 4096
+
+/* the copy of the input that the scanner works on is freed again after a
+ * buffer bigger than this, rather than being kept for the next one */
+#define VT100_SCREEN_SCAN_BUFFER_MAX (1024 * 1024)
+
+static size_t vt100_screen_scan(
+    VT100Screen *vt, const char *buf, size_t len)
+{
+    size_t parsed = 0;
+
+    while (parsed < len && vt100_screen_can_fast_forward(vt)) {
+        size_t end, next;
+        const char *lf;
+
+        next = parsed;
+        parsed += vt100_screen_fast_forward(
+            vt, buf + parsed, len - parsed, &end);
+        next += end;
+
+        if (next < parsed + VT100_SCREEN_FAST_FORWARD_CHUNK) {
+            next = parsed + VT100_SCREEN_FAST_FORWARD_CHUNK;
+        }
+        if (next >= len || !(lf = memchr(buf + next, '\n', len - next))) {
+            break;
+        }
+        next = lf - buf + 1;
+        parsed += vt100_screen_lex(vt, buf + parsed, next - parsed);
+        if (parsed < next) {
+            return parsed;
+        }
+    }
+
+    return parsed + vt100_screen_lex(vt, buf + parsed, len - parsed);
+}
+
+static size_t vt100_screen_lex(
+    VT100Screen *vt, const char *buf, size_t len)
+{
+    struct vt100_parser_state *state = vt->parser_state;
+    int remaining;
+
+    /* the scanner needs two nuls after the input to know where it ends */
+    if (len + 2 > state->capacity) {
+        state->capacity = len + 2;
+        state->buf = vt100_screen_realloc(vt, state->buf, state->capacity);
+    }
+    memcpy(state->buf, buf, len);
+    state->buf[len] = '\0';
+    state->buf[len + 1] = '\0';
+
+    state->state = vt100_parser_yy_scan_buffer(
+        state->buf, len + 2, state->scanner);
+    remaining = vt100_parser_yylex(state->scanner);
+    vt100_parser_yy_delete_buffer(state->state, state->scanner);
+
+    if (state->capacity > VT100_SCREEN_SCAN_BUFFER_MAX) {
+        vt100_screen_free_scan_buffer(vt);
+    }
+
+    return len - remaining;
+}
+
+/* only plain scrolling into the scrollback is simple enough to predict, and
+ * anything that needs to see every change as it happens rules it out. the
+ * pipeline is checked first, since while it's running, the pipeline thread
+ * is writing the bit fields next to fast_forward. */
+static int vt100_screen_can_fast_forward(VT100Screen *vt)
+{
+    return !vt->pipeline
+        && vt->fast_forward
+        && !vt->undo
+        && !vt->deferred
+        && !vt->bytecode
+        && !vt->alternate
+        && !vt100_screen_scroll_region_is_active(vt)
+        && !vt100_screen_margins_are_active(vt);
+}
+
+/* applies as much of buf as can be applied without drawing, and returns how
+ * much that was. that's up to a line feed followed by enough scrolling to
+ * push every row that exists at that point out of the scrollback, which
+ * holds at most scrollback_length rows plus the slack that scroll_up trims
+ * in. *endp is set to where buf stops being simple enough to count scrolls
+ * in. */
+static size_t vt100_screen_fast_forward(
+    VT100Screen *vt, const char *buf, size_t len, size_t *endp)
+{
+    size_t scrolls, limit, skipped;
+
+    limit = vt->scrollback_length + vt->scrollback_length / 10;
+    scrolls = vt100_screen_fast_forward_walk(vt, buf, len, 0, endp);
+    if (scrolls <= limit) {
+        return 0;
+    }
+
+    vt->fast_forwarding = 1;
+    skipped = vt100_screen_fast_forward_walk(
+        vt, buf, len, scrolls - limit, endp);
+    vt->fast_forwarding = 0;
+
+    return skipped;
+}
+
+/* walks through buf up to the first thing that isn't text, a cursor
+ * movement within the line, or an SGR or EL sequence, and counts the line
+ * feeds that scroll the screen. wrapping text is ignored, so the row being
+ * tracked can only be above the real one, which means this never counts a
+ * scroll that doesn't happen. if nth is given, the tokens are applied as
+ * it goes instead (bypassing the scanner, which is where most of the time
+ * would go), and it stops and returns the offset just after the nth
+ * scroll. */
+static size_t vt100_screen_fast_forward_walk(
+    VT100Screen *vt, const char *buf, size_t len, size_t nth, size_t *endp)
+{
+    int row = vt->grid->cur.row, bottom = vt->grid->scroll_bottom;
+    size_t i = 0, scrolls = 0;
+
+    while (i < len) {
+        unsigned char c = buf[i];
+        size_t start = i, seq_len;
+        int type;
+
+        if (c >= ' ' && c < 0x7f) {
+            while (i < len && (unsigned char)buf[i] >= ' '
+                   && (unsigned char)buf[i] < 0x7f) {
+                i++;
+            }
+            if (nth) {
+                vt100_screen_fast_forward_token(
+                    vt, VT100_TOKEN_ASCII, buf + start, i - start);
+            }
+            continue;
+        }
+
+        switch (c) {
+        case '\n':
+        case '\v':
+        case '\f':
+            i++;
+            if (nth) {
+                vt100_screen_fast_forward_token(
+                    vt, VT100_TOKEN_LF, buf + start, 1);
+            }
+            if (row < bottom) {
+                row++;
+            }
+            else if (++scrolls == nth) {
+                return i;
+            }
+            continue;
+        case '\r':
+            type = VT100_TOKEN_CR;
+            break;
+        case '\a':
+            type = VT100_TOKEN_BEL;
+            break;
+        case '\b':
+            type = VT100_TOKEN_BS;
+            break;
+        case '\t':
+            type = VT100_TOKEN_TAB;
+            break;
+        case '\033':
+            seq_len = vt100_screen_sgr_or_el_length(buf + i, len - i);
+            if (!seq_len) {
+                *endp = i;
+                return scrolls;
+            }
+            i += seq_len;
+            if (nth) {
+                vt100_screen_fast_forward_token(
+                    vt, buf[i - 1] == 'm' ? VT100_TOKEN_SGR : VT100_TOKEN_EL,
+                    buf + start, seq_len);
+            }
+            continue;
+        default:
+            *endp = i;
+            return scrolls;
+        }
+
+        i++;
+        if (nth) {
+            vt100_screen_fast_forward_token(vt, type, buf + start, 1);
+        }
+    }
+
+    *endp = i;
+    return scrolls;
+}
+
+/* the same as the scanner handing it the token. applying a token never
+ * writes to it, so the caller's buffer can be passed straight through. */
+static void vt100_screen_fast_forward_token(
+    VT100Screen *vt, int type, const char *buf, size_t len)
+{
+    vt100_screen_count_token(vt, type, len);
+    vt100_parser_apply_token(vt, type, (char *)buf, len);
+}
+
+/* the length of the SGR or EL sequence at the start of buf, if there is a
+ * complete one there, matching what the parser accepts for them */
+static size_t vt100_screen_sgr_or_el_length(const char *buf, size_t len)
+{
+    size_t i = 2, params = 0;
+
+    if (len < 3 || buf[1] != '[') {
+        return 0;
+    }
+
+    for (;;) {
+        size_t start = i;
+
+        while (i < len && buf[i] >= '0' && buf[i] <= '9') {
+            i++;
+        }
+        if (i == len || (i == start && params)) {
+            return 0;
+        }
+        if (buf[i] != ';') {
+            break;
+        }
+        if (i == start) {
+            return 0;
+        }
+        params++;
+        i++;
+    }
+
+    if (buf[i] == 'm' || (buf[i] == 'K' && !params)) {
+        return i + 1;
+    }
+
+    return 0;
+}
+
+static double vt100_screen_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 static struct vt100_row *vt100_screen_row_at(VT100Screen *vt, int row)
 {
     return &vt->grid->rows[row + vt->grid->row_top];
@@ -1262,14 +1967,300 @@ static struct vt100_row *vt100_screen_row_at(VT100Screen *vt, int row)
 static int vt100_screen_scroll_region_is_active(VT100Screen *vt)
 {
     return vt->grid->scroll_top != 0
-        || vt->grid->scroll_bottom != vt->grid->max.row - 1;
+        || vt->grid->scroll_bottom != vt->grid->max.row - 1
+        || vt100_screen_margins_are_active(vt);
+}
+
+static int vt100_screen_margins_are_active(VT100Screen *vt)
+{
+    return vt->grid->scroll_left != 0
+        || vt->grid->scroll_right != vt->grid->max.col - 1;
 }
 
-static void vt100_screen_check_wrap(VT100Screen *vt, int width)
+/* returns the column text wraps at, which is where it would wrap next */
+static int vt100_screen_check_wrap(VT100Screen *vt, int width)
 {
-    if (vt->grid->cur.col + width > vt->grid->max.col) {
-        vt100_screen_row_at(vt, vt->grid->cur.row)->wrapped = 1;
+    int left = 0, right = vt->grid->max.col, margins = 0;
+
+    /* text wraps at the right margin back to the left one, unless the
+     * cursor was moved past the right margin */
+    if (vt100_screen_margins_are_active(vt)
+        && (vt->grid->cur.col <= vt->grid->scroll_right
+            || (vt->grid->cur.col == vt->grid->scroll_right + 1
+                && vt->grid->cur_from_text))) {
+        left = vt->grid->scroll_left;
+        right = vt->grid->scroll_right + 1;
+        margins = 1;
+    }
+    vt->grid->cur_from_text = 1;
+
+    if (vt->grid->cur.col + width > right) {
+        if (vt->undo) {
+            vt100_undo_save_row(vt, vt->grid->cur.row);
+        }
+        /* a line broken at a margin isn't one line of text, so it isn't
+         * marked as wrapped */
+        if (!margins) {
+            vt100_screen_row_at(vt, vt->grid->cur.row)->wrapped = 1;
+        }
         vt100_screen_move_down_or_scroll(vt);
-        vt->grid->cur.col = 0;
+        vt->grid->cur.col = left;
+        if (vt->undo) {
+            vt100_undo_save_row(vt, vt->grid->cur.row);
+        }
+        /* wrapping from past the right margin lands inside the margins */
+        if (!margins && vt100_screen_margins_are_active(vt)) {
+            right = vt->grid->scroll_right + 1;
+        }
+    }
+
+    return right;
+}
+
+static struct vt100_cell *vt100_screen_writable_cell_at(
+    VT100Screen *vt, int row, int col)
+{
+    struct vt100_row *grid_row = vt100_screen_row_at(vt, row);
+
+    if (!grid_row->cells) {
+        vt100_screen_allocate_row(vt, grid_row);
+    }
+
+    return &grid_row->cells[col];
+}
+
+static void vt100_screen_allocate_row(VT100Screen *vt, struct vt100_row *row)
+{
+    row->cells = vt100_screen_calloc(
+        vt, vt->grid->max.col, sizeof(struct vt100_cell));
+    row->ncells = vt->grid->max.col;
+    vt->grid->cell_count += row->ncells;
+    vt->stats.rows_allocated++;
+    VT100_PROBE2(row__alloc, vt, row->ncells);
+}
+
+/* rows are cleared to the current background color (bce), and only need
+ * cells for that if it isn't the default. a row that already has cells
+ * keeps them, so that a screen that is cleared and redrawn over and over
+ * (like the alternate screen under an editor) doesn't have to allocate
+ * them again each time. */
+static void vt100_screen_clear_row(VT100Screen *vt, struct vt100_row *row)
+{
+    vt100_screen_erase_cells(vt, row, 0, vt->grid->max.col);
+    row->wrapped = 0;
+}
+
+/* erases count cells of a row on the screen starting at col, leaving them
+ * with the current background color */
+static void vt100_screen_erase_cells(
+    VT100Screen *vt, struct vt100_row *row, int col, int count)
+{
+    struct vt100_cell blank;
+
+    if (count <= 0) {
+        return;
+    }
+
+    if (vt->attrs.bgcolor.type == VT100_COLOR_DEFAULT) {
+        if (row->cells) {
+            memset(&row->cells[col], 0, count * sizeof(struct vt100_cell));
+        }
+        return;
+    }
+
+    if (!row->cells) {
+        vt100_screen_allocate_row(vt, row);
+    }
+    memset(&blank, 0, sizeof(struct vt100_cell));
+    blank.attrs.bgcolor = vt->attrs.bgcolor;
+    vt100_screen_fill_cells(&row->cells[col], count, &blank);
+}
+
+/* copies cell into each of cells, doubling the part that's filled in each
+ * time, so that it's a handful of large memcpy calls (which the compiler
+ * and libc vectorize) instead of a store per cell */
+static void vt100_screen_fill_cells(
+    struct vt100_cell *cells, int count, const struct vt100_cell *cell)
+{
+    int filled;
+
+    cells[0] = *cell;
+    for (filled = 1; filled < count; filled *= 2) {
+        memcpy(
+            &cells[filled], cells,
+            (filled * 2 > count ? count - filled : filled)
+                * sizeof(struct vt100_cell));
+    }
+}
+
+/* moves rows top..bottom of the screen up by count rows (or down, if count
+ * is negative). the rows that fall off one end of the region come back in
+ * at the other end blanked, so scrolling inside a region just shuffles the
+ * rows around instead of freeing and allocating cells. */
+static void vt100_screen_rotate_rows(
+    VT100Screen *vt, int top, int bottom, int count)
+{
+    struct vt100_row *rows = vt100_screen_row_at(vt, top);
+    int len = bottom - top + 1, shift, first, i;
+
+    /* rotating down by count is the same as rotating up by the rest */
+    if (count > 0) {
+        shift = count;
+        first = len - count;
+    }
+    else {
+        count = -count;
+        shift = len - count;
+        first = 0;
+    }
+
+    vt100_screen_reverse_rows(rows, shift);
+    vt100_screen_reverse_rows(rows + shift, len - shift);
+    vt100_screen_reverse_rows(rows, len);
+
+    for (i = first; i < first + count; ++i) {
+        vt100_screen_clear_row(vt, &rows[i]);
+    }
+}
+
+/* like vt100_screen_rotate_rows, but for when there are left and right
+ * margins: only the cells between the margins move, so the rows can't be
+ * swapped around whole and the span is copied from row to row instead */
+static void vt100_screen_scroll_columns(
+    VT100Screen *vt, int top, int bottom, int count)
+{
+    int left = vt->grid->scroll_left;
+    int width = vt->grid->scroll_right - left + 1;
+    int len = bottom - top + 1, i;
+
+    if (vt->undo) {
+        vt100_undo_save_rows(vt, top, bottom);
+    }
+
+    if (count >= len || -count >= len) {
+        count = 0;
+    }
+    else if (count > 0) {
+        for (i = top; i <= bottom - count; ++i) {
+            vt100_screen_copy_columns(
+                vt, vt100_screen_row_at(vt, i),
+                vt100_screen_row_at(vt, i + count));
+        }
+        top = bottom - count + 1;
+    }
+    else {
+        for (i = bottom; i >= top - count; --i) {
+            vt100_screen_copy_columns(
+                vt, vt100_screen_row_at(vt, i),
+                vt100_screen_row_at(vt, i + count));
+        }
+        bottom = top - count - 1;
+    }
+
+    for (i = top; i <= bottom; ++i) {
+        struct vt100_row *row = vt100_screen_row_at(vt, i);
+
+        vt100_screen_erase_cells(vt, row, left, width);
+        row->wrapped = 0;
+    }
+}
+
+static void vt100_screen_copy_columns(
+    VT100Screen *vt, struct vt100_row *dst, struct vt100_row *src)
+{
+    int left = vt->grid->scroll_left;
+    int width = vt->grid->scroll_right - left + 1;
+
+    if (src->cells) {
+        if (!dst->cells) {
+            vt100_screen_allocate_row(vt, dst);
+        }
+        memcpy(
+            &dst->cells[left], &src->cells[left],
+            width * sizeof(struct vt100_cell));
+    }
+    else if (dst->cells) {
+        memset(&dst->cells[left], 0, width * sizeof(struct vt100_cell));
+    }
+    dst->wrapped = 0;
+}
+
+static void vt100_screen_reverse_rows(struct vt100_row *rows, int count)
+{
+    int i;
+
+    for (i = 0; i < count / 2; ++i) {
+        struct vt100_row tmp = rows[i];
+
+        rows[i] = rows[count - 1 - i];
+        rows[count - 1 - i] = tmp;
+    }
+}
+
+static void vt100_screen_fit_row(
+    VT100Screen *vt, struct vt100_grid *grid, struct vt100_row *row)
+{
+    if (!row->cells || row->ncells == grid->max.col) {
+        return;
+    }
+
+    grid->cell_count += grid->max.col - row->ncells;
+    row->cells = vt100_screen_realloc(
+        vt, row->cells, grid->max.col * sizeof(struct vt100_cell));
+    if (row->ncells < grid->max.col) {
+        memset(
+            &row->cells[row->ncells], 0,
+            (grid->max.col - row->ncells) * sizeof(struct vt100_cell));
+    }
+    row->ncells = grid->max.col;
+}
+
+/* makes a reused alternate grid look like a freshly allocated one. only the
+ * rows that were written to have cells to clear, and they keep them, so
+ * that the next switch doesn't have to allocate them again. */
+static void vt100_screen_reset_grid(
+    VT100Screen *vt, struct vt100_grid *grid)
+{
+    int i;
+
+    for (i = 0; i < grid->row_count; ++i) {
+        struct vt100_row *row = &grid->rows[i];
+
+        if (i >= grid->max.row) {
+            grid->cell_count -= row->cells ? row->ncells : 0;
+            vt100_screen_free(vt, row->cells);
+            row->cells = NULL;
+        }
+        else if (row->cells) {
+            vt100_screen_fit_row(vt, grid, row);
+            memset(row->cells, 0, grid->max.col * sizeof(struct vt100_cell));
+        }
+        row->wrapped = 0;
+    }
+
+    grid->row_count = grid->max.row;
+    grid->row_top = 0;
+    grid->cur.row = 0;
+    grid->cur.col = 0;
+    grid->saved = grid->cur;
+    grid->scroll_top = 0;
+    grid->scroll_bottom = grid->max.row - 1;
+    grid->scroll_left = 0;
+    grid->scroll_right = grid->max.col - 1;
+    grid->cur_from_text = 0;
+}
+
+static void vt100_screen_free_grid(VT100Screen *vt, struct vt100_grid *grid)
+{
+    int i;
+
+    if (!grid) {
+        return;
+    }
+
+    for (i = 0; i < grid->row_count; ++i) {
+        vt100_screen_free(vt, grid->rows[i].cells);
     }
+    vt100_screen_free(vt, grid->rows);
+    vt100_screen_free(vt, grid);
 }
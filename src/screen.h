@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 enum VT100ColorType {
     VT100_COLOR_DEFAULT,
@@ -74,9 +75,14 @@ struct vt100_cell {
     unsigned int is_wide: 1;
 };
 
+/* rows on the screen always have max.col cells (or none), but rows in the
+ * scrollback keep whatever they had when the window was last resized while
+ * they were visible, and are read as if they were cut off or padded out to
+ * max.col */
 struct vt100_row {
     struct vt100_cell *cells;
     unsigned int wrapped: 1;
+    int ncells;
 };
 
 struct vt100_grid {
@@ -86,20 +92,54 @@ struct vt100_grid {
 
     int scroll_top;
     int scroll_bottom;
+    int scroll_left;
+    int scroll_right;
+    /* set when the cursor got where it is by text being written, so that a
+     * cursor just past the right margin knows whether to wrap */
+    int cur_from_text;
 
     int row_count;
     int row_capacity;
     int row_top;
+    /* rows before this one haven't been reflowed to the current width yet */
+    int reflow_pending;
+    /* how many cells the rows have allocated between them */
+    size_t cell_count;
 
     struct vt100_row *rows;
 };
 
 struct vt100_parser_state;
+struct vt100_frame_state;
+struct vt100_pipeline;
+struct vt100_bytecode;
+struct vt100_undo_log;
+struct vt100_event_queue;
+struct vt100_event_batch;
+struct vt100_diagnostic_sink;
 struct vt100_screen {
     struct vt100_grid *grid;
     struct vt100_grid *alternate;
+    /* the alternate screen's grid, kept while the normal screen is active */
+    struct vt100_grid *spare;
 
     struct vt100_parser_state *parser_state;
+    struct vt100_frame_state *frames;
+    struct vt100_pipeline *pipeline;
+    struct vt100_bytecode *bytecode;
+    /* tokens are recorded here instead of being applied (only used on the
+     * stand-in screens that tokenize chunks for a parallel replay) */
+    struct vt100_bytecode *deferred;
+    /* the screen that a stand-in screen is tokenizing for, which is who its
+     * diagnostics are reported as coming from */
+    struct vt100_screen *owner;
+    struct vt100_undo_log *undo;
+    struct vt100_event_queue *events;
+    /* events that haven't been added to the queue yet */
+    struct vt100_event_batch *event_batch;
+    struct vt100_diagnostic_sink *diagnostics;
+    /* malloc is NULL for the C library's own */
+    struct vt100_allocator allocator;
 
     char *title;
     size_t title_len;
@@ -107,6 +147,13 @@ struct vt100_screen {
     size_t icon_name_len;
 
     int scrollback_length;
+    /* see vt100_screen_set_memory_limit. memory_reported is how much this
+     * screen last added to the total for the whole process. */
+    size_t memory_limit;
+    size_t memory_reported;
+    /* when the current synchronized update started, in seconds on the
+     * monotonic clock */
+    double synchronized_output_start;
 
     struct vt100_cell_attrs attrs;
 
@@ -121,6 +168,8 @@ struct vt100_screen {
     unsigned int mouse_reporting_any_motion: 1;
     unsigned int bracketed_paste: 1;
     unsigned int origin_mode: 1;
+    unsigned int left_right_margin_mode: 1;
+    unsigned int synchronized_output: 1;
 
     unsigned int visual_bell: 1;
     unsigned int audible_bell: 1;
@@ -129,13 +178,48 @@ struct vt100_screen {
 
     unsigned int dirty: 1;
     unsigned int custom_scrollback_length: 1;
+    unsigned int reflow: 1;
+    unsigned int fast_forward: 1;
+    unsigned int fast_forwarding: 1;
+
+    /* not a bit field, since it's read while the pipeline thread is
+     * writing the ones above */
+    int timing;
+    /* see vt100_screen_hibernate, which also records where it wrote the
+     * screen's state. this isn't a bit field for the same reason. */
+    int hibernating;
+    int hibernate_fd;
+    off_t hibernate_offset;
+    size_t hibernate_len;
+    struct vt100_stats stats;
+};
+
+/* how much work a call to vt100_screen_process_string_budgeted may do. the
+ * work it does is taken off, so one budget can be spread over several calls,
+ * and it's spent once either part reaches zero. */
+struct vt100_budget {
+    size_t bytes;
+    long usec;
 };
 
 VT100Screen *vt100_screen_new(int rows, int cols);
 void vt100_screen_init(VT100Screen *vt);
 void vt100_screen_set_window_size(VT100Screen *vt, int rows, int cols);
 void vt100_screen_set_scrollback_length(VT100Screen *vt, int rows);
-int vt100_screen_process_string(VT100Screen *vt, char *buf, size_t len);
+/* with fast forward turned on, text that vt100_screen_process_string can
+ * tell will be scrolled out of the scrollback again before the end of the
+ * buffer it was given only moves the cursor, without being drawn. everything
+ * else is processed as usual, so the screen ends up exactly the same, but
+ * output that is mostly plain text and scrolls by far faster than anybody
+ * can read it is processed a lot faster. how far ahead it can see is
+ * limited to the one buffer, so it only helps when that holds more lines
+ * than the scrollback does. */
+void vt100_screen_set_fast_forward(VT100Screen *vt, int fast_forward);
+int vt100_screen_process_string(
+    VT100Screen *vt, const char *buf, size_t len);
+size_t vt100_screen_process_string_budgeted(
+    VT100Screen *vt, const char *buf, size_t len, struct vt100_budget *budget);
+int vt100_budget_is_spent(struct vt100_budget *budget);
 void vt100_screen_get_string_plaintext(
     VT100Screen *vt, struct vt100_loc *start, struct vt100_loc *end,
     char **strp, size_t *lenp);
@@ -211,6 +295,11 @@ void vt100_screen_set_bracketed_paste(VT100Screen *vt);
 void vt100_screen_reset_bracketed_paste(VT100Screen *vt);
 void vt100_screen_set_origin_mode(VT100Screen *vt);
 void vt100_screen_reset_origin_mode(VT100Screen *vt);
+void vt100_screen_set_left_right_margin_mode(VT100Screen *vt);
+void vt100_screen_reset_left_right_margin_mode(VT100Screen *vt);
+void vt100_screen_set_synchronized_output(VT100Screen *vt);
+void vt100_screen_reset_synchronized_output(VT100Screen *vt);
+int vt100_screen_frame_is_complete(VT100Screen *vt);
 void vt100_screen_set_window_title(VT100Screen *vt, char *buf, size_t len);
 void vt100_screen_set_icon_name(VT100Screen *vt, char *buf, size_t len);
 int vt100_screen_row_max_col(VT100Screen *vt, int row);
@@ -0,0 +1,648 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vt100.h"
+
+#define VT100_SNAPSHOT_MAGIC "VT100SNP"
+#define VT100_SNAPSHOT_MAGIC_LEN 8
+#define VT100_SNAPSHOT_VERSION 5
+
+/* the snapshot format is a magic number and version, followed by the screen
+ * state and then each grid (the active one first). integers are LEB128,
+ * signed ones zigzag encoded first, and trailing blank cells in each row
+ * are left out entirely. each cell starts with a byte holding its length
+ * and the flags below, and its attributes are only written out when they
+ * differ from the cell before it. */
+
+#define VT100_SNAPSHOT_CELL_LEN   0x0f
+#define VT100_SNAPSHOT_CELL_WIDE  0x10
+#define VT100_SNAPSHOT_CELL_ATTRS 0x20
+
+struct vt100_snapshot_writer {
+    char *buf;
+    size_t len;
+    size_t capacity;
+};
+
+struct vt100_snapshot_reader {
+    VT100Screen *vt;
+    const char *pos;
+    const char *end;
+    int ok;
+};
+
+enum VT100SnapshotFlag {
+    VT100_SNAPSHOT_HIDE_CURSOR                   = 1 << 0,
+    VT100_SNAPSHOT_APPLICATION_KEYPAD            = 1 << 1,
+    VT100_SNAPSHOT_APPLICATION_CURSOR            = 1 << 2,
+    VT100_SNAPSHOT_MOUSE_REPORTING_PRESS         = 1 << 3,
+    VT100_SNAPSHOT_MOUSE_REPORTING_PRESS_RELEASE = 1 << 4,
+    VT100_SNAPSHOT_MOUSE_REPORTING_BUTTON_MOTION = 1 << 5,
+    VT100_SNAPSHOT_MOUSE_REPORTING_ANY_MOTION    = 1 << 6,
+    VT100_SNAPSHOT_BRACKETED_PASTE               = 1 << 7,
+    VT100_SNAPSHOT_ORIGIN_MODE                   = 1 << 8,
+    VT100_SNAPSHOT_VISUAL_BELL                   = 1 << 9,
+    VT100_SNAPSHOT_AUDIBLE_BELL                  = 1 << 10,
+    VT100_SNAPSHOT_UPDATE_TITLE                  = 1 << 11,
+    VT100_SNAPSHOT_UPDATE_ICON_NAME              = 1 << 12,
+    VT100_SNAPSHOT_DIRTY                         = 1 << 13,
+    VT100_SNAPSHOT_CUSTOM_SCROLLBACK_LENGTH      = 1 << 14,
+    VT100_SNAPSHOT_TITLE                         = 1 << 15,
+    VT100_SNAPSHOT_ICON_NAME                     = 1 << 16,
+    VT100_SNAPSHOT_ALTERNATE                     = 1 << 17,
+    VT100_SNAPSHOT_REFLOW                        = 1 << 18,
+    VT100_SNAPSHOT_LEFT_RIGHT_MARGIN_MODE        = 1 << 19,
+    VT100_SNAPSHOT_SYNCHRONIZED_OUTPUT           = 1 << 20
+};
+
+static void vt100_snapshot_write_grid(
+    struct vt100_snapshot_writer *w, struct vt100_grid *grid);
+static void vt100_snapshot_write_bytes(
+    struct vt100_snapshot_writer *w, const void *buf, size_t len);
+static void vt100_snapshot_write_uint(
+    struct vt100_snapshot_writer *w, unsigned long val);
+static void vt100_snapshot_write_int(
+    struct vt100_snapshot_writer *w, int val);
+static void vt100_snapshot_write_attrs(
+    struct vt100_snapshot_writer *w, struct vt100_cell_attrs *attrs);
+static int vt100_snapshot_restore(
+    VT100Screen *vt, const char *buf, size_t len);
+static struct vt100_grid *vt100_snapshot_read_grid(
+    struct vt100_snapshot_reader *r);
+static void vt100_snapshot_read_bytes(
+    struct vt100_snapshot_reader *r, void *buf, size_t len);
+static unsigned long vt100_snapshot_read_uint(
+    struct vt100_snapshot_reader *r);
+static int vt100_snapshot_read_int(struct vt100_snapshot_reader *r);
+static void vt100_snapshot_read_attrs(
+    struct vt100_snapshot_reader *r, struct vt100_cell_attrs *attrs);
+static char *vt100_snapshot_read_string(
+    struct vt100_snapshot_reader *r, size_t *lenp);
+static void vt100_snapshot_free_grid(
+    VT100Screen *vt, struct vt100_grid *grid);
+
+void vt100_screen_snapshot(VT100Screen *vt, char **strp, size_t *lenp)
+{
+    struct vt100_snapshot_writer w = { NULL, 0, 0 };
+    unsigned long flags = 0;
+
+    vt100_screen_wait_pipeline(vt);
+
+    flags |= vt->hide_cursor ? VT100_SNAPSHOT_HIDE_CURSOR : 0;
+    flags |= vt->application_keypad ? VT100_SNAPSHOT_APPLICATION_KEYPAD : 0;
+    flags |= vt->application_cursor ? VT100_SNAPSHOT_APPLICATION_CURSOR : 0;
+    flags |= vt->mouse_reporting_press
+        ? VT100_SNAPSHOT_MOUSE_REPORTING_PRESS : 0;
+    flags |= vt->mouse_reporting_press_release
+        ? VT100_SNAPSHOT_MOUSE_REPORTING_PRESS_RELEASE : 0;
+    flags |= vt->mouse_reporting_button_motion
+        ? VT100_SNAPSHOT_MOUSE_REPORTING_BUTTON_MOTION : 0;
+    flags |= vt->mouse_reporting_any_motion
+        ? VT100_SNAPSHOT_MOUSE_REPORTING_ANY_MOTION : 0;
+    flags |= vt->bracketed_paste ? VT100_SNAPSHOT_BRACKETED_PASTE : 0;
+    flags |= vt->origin_mode ? VT100_SNAPSHOT_ORIGIN_MODE : 0;
+    flags |= vt->visual_bell ? VT100_SNAPSHOT_VISUAL_BELL : 0;
+    flags |= vt->audible_bell ? VT100_SNAPSHOT_AUDIBLE_BELL : 0;
+    flags |= vt->update_title ? VT100_SNAPSHOT_UPDATE_TITLE : 0;
+    flags |= vt->update_icon_name ? VT100_SNAPSHOT_UPDATE_ICON_NAME : 0;
+    flags |= vt->dirty ? VT100_SNAPSHOT_DIRTY : 0;
+    flags |= vt->custom_scrollback_length
+        ? VT100_SNAPSHOT_CUSTOM_SCROLLBACK_LENGTH : 0;
+    flags |= vt->title ? VT100_SNAPSHOT_TITLE : 0;
+    flags |= vt->icon_name ? VT100_SNAPSHOT_ICON_NAME : 0;
+    flags |= vt->alternate ? VT100_SNAPSHOT_ALTERNATE : 0;
+    flags |= vt->reflow ? VT100_SNAPSHOT_REFLOW : 0;
+    flags |= vt->left_right_margin_mode
+        ? VT100_SNAPSHOT_LEFT_RIGHT_MARGIN_MODE : 0;
+    flags |= vt->synchronized_output ? VT100_SNAPSHOT_SYNCHRONIZED_OUTPUT : 0;
+
+    vt100_snapshot_write_bytes(
+        &w, VT100_SNAPSHOT_MAGIC, VT100_SNAPSHOT_MAGIC_LEN);
+    vt100_snapshot_write_uint(&w, VT100_SNAPSHOT_VERSION);
+    vt100_snapshot_write_uint(&w, flags);
+    vt100_snapshot_write_int(&w, vt->scrollback_length);
+    vt100_snapshot_write_uint(&w, vt->mouse_reporting_mode);
+    vt100_snapshot_write_attrs(&w, &vt->attrs);
+    if (vt->title) {
+        vt100_snapshot_write_uint(&w, vt->title_len);
+        vt100_snapshot_write_bytes(&w, vt->title, vt->title_len);
+    }
+    if (vt->icon_name) {
+        vt100_snapshot_write_uint(&w, vt->icon_name_len);
+        vt100_snapshot_write_bytes(&w, vt->icon_name, vt->icon_name_len);
+    }
+
+    vt100_snapshot_write_grid(&w, vt->grid);
+    if (vt->alternate) {
+        vt100_snapshot_write_grid(&w, vt->alternate);
+    }
+
+    *strp = w.buf;
+    *lenp = w.len;
+}
+
+int vt100_screen_restore(VT100Screen *vt, const char *buf, size_t len)
+{
+    if (!vt100_snapshot_restore(vt, buf, len)) {
+        return 0;
+    }
+
+    /* everything on the screen may have changed, so readers of frames and
+     * events have to be told, the same as after processing output */
+    vt->dirty = 1;
+    vt100_screen_check_memory(vt);
+    vt100_screen_update_frame(vt);
+    if (vt->events) {
+        vt100_screen_flush_events(vt);
+    }
+
+    return 1;
+}
+
+/* waking a screen doesn't change what's on it, so this is the part of
+ * restoring that it shares */
+static int vt100_snapshot_restore(VT100Screen *vt, const char *buf, size_t len)
+{
+    struct vt100_snapshot_reader r = { vt, buf, buf + len, 1 };
+    struct vt100_grid *grid, *alternate = NULL;
+    char magic[VT100_SNAPSHOT_MAGIC_LEN];
+    char *title = NULL, *icon_name = NULL;
+    size_t title_len = 0, icon_name_len = 0;
+    unsigned long flags, mouse_reporting_mode;
+    struct vt100_cell_attrs attrs;
+    int scrollback_length;
+
+    vt100_snapshot_read_bytes(&r, magic, VT100_SNAPSHOT_MAGIC_LEN);
+    if (!r.ok || memcmp(magic, VT100_SNAPSHOT_MAGIC, VT100_SNAPSHOT_MAGIC_LEN)
+        || vt100_snapshot_read_uint(&r) != VT100_SNAPSHOT_VERSION) {
+        return 0;
+    }
+
+    flags = vt100_snapshot_read_uint(&r);
+    scrollback_length = vt100_snapshot_read_int(&r);
+    mouse_reporting_mode = vt100_snapshot_read_uint(&r);
+    vt100_snapshot_read_attrs(&r, &attrs);
+    if (flags & VT100_SNAPSHOT_TITLE) {
+        title = vt100_snapshot_read_string(&r, &title_len);
+    }
+    if (flags & VT100_SNAPSHOT_ICON_NAME) {
+        icon_name = vt100_snapshot_read_string(&r, &icon_name_len);
+    }
+
+    grid = vt100_snapshot_read_grid(&r);
+    if (flags & VT100_SNAPSHOT_ALTERNATE) {
+        alternate = vt100_snapshot_read_grid(&r);
+    }
+
+    if (!r.ok) {
+        vt100_snapshot_free_grid(vt, grid);
+        vt100_snapshot_free_grid(vt, alternate);
+        vt100_screen_free(vt, title);
+        vt100_screen_free(vt, icon_name);
+        return 0;
+    }
+
+    /* everything parsed, so now it's safe to throw away the old state (and
+     * any undo history, which only makes sense for that state) */
+    vt100_screen_wait_pipeline(vt);
+    vt100_screen_clear_undo_log(vt);
+    vt100_snapshot_free_grid(vt, vt->grid);
+    vt100_snapshot_free_grid(vt, vt->alternate);
+    vt100_snapshot_free_grid(vt, vt->spare);
+    vt100_screen_free(vt, vt->title);
+    vt100_screen_free(vt, vt->icon_name);
+
+    vt->grid = grid;
+    vt->alternate = alternate;
+    vt->spare = NULL;
+    vt->title = title;
+    vt->title_len = title_len;
+    vt->icon_name = icon_name;
+    vt->icon_name_len = icon_name_len;
+    vt->scrollback_length = scrollback_length;
+    vt->mouse_reporting_mode = mouse_reporting_mode;
+    vt->attrs = attrs;
+
+    vt->hide_cursor = !!(flags & VT100_SNAPSHOT_HIDE_CURSOR);
+    vt->application_keypad = !!(flags & VT100_SNAPSHOT_APPLICATION_KEYPAD);
+    vt->application_cursor = !!(flags & VT100_SNAPSHOT_APPLICATION_CURSOR);
+    vt->mouse_reporting_press =
+        !!(flags & VT100_SNAPSHOT_MOUSE_REPORTING_PRESS);
+    vt->mouse_reporting_press_release =
+        !!(flags & VT100_SNAPSHOT_MOUSE_REPORTING_PRESS_RELEASE);
+    vt->mouse_reporting_button_motion =
+        !!(flags & VT100_SNAPSHOT_MOUSE_REPORTING_BUTTON_MOTION);
+    vt->mouse_reporting_any_motion =
+        !!(flags & VT100_SNAPSHOT_MOUSE_REPORTING_ANY_MOTION);
+    vt->bracketed_paste = !!(flags & VT100_SNAPSHOT_BRACKETED_PASTE);
+    vt->origin_mode = !!(flags & VT100_SNAPSHOT_ORIGIN_MODE);
+    vt->visual_bell = !!(flags & VT100_SNAPSHOT_VISUAL_BELL);
+    vt->audible_bell = !!(flags & VT100_SNAPSHOT_AUDIBLE_BELL);
+    vt->update_title = !!(flags & VT100_SNAPSHOT_UPDATE_TITLE);
+    vt->update_icon_name = !!(flags & VT100_SNAPSHOT_UPDATE_ICON_NAME);
+    vt->dirty = !!(flags & VT100_SNAPSHOT_DIRTY);
+    vt->custom_scrollback_length =
+        !!(flags & VT100_SNAPSHOT_CUSTOM_SCROLLBACK_LENGTH);
+    vt->reflow = !!(flags & VT100_SNAPSHOT_REFLOW);
+    vt->left_right_margin_mode =
+        !!(flags & VT100_SNAPSHOT_LEFT_RIGHT_MARGIN_MODE);
+    /* the timeout starts over, since the clock it was started on is
+     * meaningless here */
+    vt->synchronized_output = 0;
+    if (flags & VT100_SNAPSHOT_SYNCHRONIZED_OUTPUT) {
+        vt100_screen_set_synchronized_output(vt);
+    }
+
+    return 1;
+}
+
+static void vt100_snapshot_write_grid(
+    struct vt100_snapshot_writer *w, struct vt100_grid *grid)
+{
+    struct vt100_cell blank;
+    int i;
+
+    memset(&blank, 0, sizeof(struct vt100_cell));
+
+    vt100_snapshot_write_int(w, grid->cur.row);
+    vt100_snapshot_write_int(w, grid->cur.col);
+    vt100_snapshot_write_int(w, grid->max.row);
+    vt100_snapshot_write_int(w, grid->max.col);
+    vt100_snapshot_write_int(w, grid->saved.row);
+    vt100_snapshot_write_int(w, grid->saved.col);
+    vt100_snapshot_write_int(w, grid->scroll_top);
+    vt100_snapshot_write_int(w, grid->scroll_bottom);
+    vt100_snapshot_write_int(w, grid->scroll_left);
+    vt100_snapshot_write_int(w, grid->scroll_right);
+    vt100_snapshot_write_uint(w, grid->cur_from_text);
+    vt100_snapshot_write_int(w, grid->row_count);
+    vt100_snapshot_write_int(w, grid->row_top);
+    vt100_snapshot_write_int(w, grid->reflow_pending);
+
+    for (i = 0; i < grid->row_count; ++i) {
+        struct vt100_row *row = &grid->rows[i];
+        int ncells = row->cells ? row->ncells : 0, j;
+        struct vt100_cell_attrs attrs;
+
+        memset(&attrs, 0, sizeof(struct vt100_cell_attrs));
+        while (ncells > 0 && !memcmp(&row->cells[ncells - 1], &blank,
+                                     sizeof(struct vt100_cell))) {
+            ncells--;
+        }
+
+        vt100_snapshot_write_uint(w, row->wrapped);
+        vt100_snapshot_write_uint(w, ncells);
+        for (j = 0; j < ncells; ++j) {
+            struct vt100_cell *cell = &row->cells[j];
+            unsigned char header = cell->len;
+
+            if (cell->is_wide) {
+                header |= VT100_SNAPSHOT_CELL_WIDE;
+            }
+            if (cell->attrs.fgcolor.id != attrs.fgcolor.id
+                || cell->attrs.bgcolor.id != attrs.bgcolor.id
+                || cell->attrs.attrs != attrs.attrs) {
+                header |= VT100_SNAPSHOT_CELL_ATTRS;
+                attrs = cell->attrs;
+            }
+
+            vt100_snapshot_write_bytes(w, &header, 1);
+            vt100_snapshot_write_bytes(w, cell->contents, cell->len);
+            if (header & VT100_SNAPSHOT_CELL_ATTRS) {
+                vt100_snapshot_write_attrs(w, &attrs);
+            }
+        }
+    }
+}
+
+static void vt100_snapshot_write_bytes(
+    struct vt100_snapshot_writer *w, const void *buf, size_t len)
+{
+    if (w->len + len > w->capacity) {
+        if (w->capacity == 0) {
+            w->capacity = 4096;
+        }
+        while (w->len + len > w->capacity) {
+            w->capacity *= 1.5;
+        }
+        w->buf = realloc(w->buf, w->capacity);
+    }
+
+    memcpy(w->buf + w->len, buf, len);
+    w->len += len;
+}
+
+static void vt100_snapshot_write_uint(
+    struct vt100_snapshot_writer *w, unsigned long val)
+{
+    unsigned char buf[10];
+    size_t len = 0;
+
+    while (val >= 0x80) {
+        buf[len++] = (val & 0x7f) | 0x80;
+        val >>= 7;
+    }
+    buf[len++] = val;
+
+    vt100_snapshot_write_bytes(w, buf, len);
+}
+
+static void vt100_snapshot_write_int(
+    struct vt100_snapshot_writer *w, int val)
+{
+    vt100_snapshot_write_uint(
+        w, val < 0 ? ((unsigned long)-(long)val << 1) - 1
+                   : (unsigned long)val << 1);
+}
+
+static void vt100_snapshot_write_attrs(
+    struct vt100_snapshot_writer *w, struct vt100_cell_attrs *attrs)
+{
+    unsigned char buf[9] = {
+        attrs->fgcolor.r, attrs->fgcolor.g, attrs->fgcolor.b,
+        attrs->fgcolor.type,
+        attrs->bgcolor.r, attrs->bgcolor.g, attrs->bgcolor.b,
+        attrs->bgcolor.type,
+        attrs->attrs
+    };
+
+    vt100_snapshot_write_bytes(w, buf, sizeof(buf));
+}
+
+int vt100_screen_hibernate(VT100Screen *vt, int fd)
+{
+    char *buf;
+    size_t len, written = 0;
+    off_t offset;
+
+    if (vt->hibernating) {
+        return 1;
+    }
+
+    offset = lseek(fd, 0, SEEK_CUR);
+    if (offset < 0) {
+        return 0;
+    }
+
+    vt100_screen_snapshot(vt, &buf, &len);
+    while (written < len) {
+        ssize_t n = write(fd, buf + written, len - written);
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            free(buf);
+            return 0;
+        }
+        written += n;
+    }
+    free(buf);
+
+    /* the alternate screen's spare grid is only kept around to save
+     * allocating it again, so it isn't saved */
+    vt100_screen_clear_undo_log(vt);
+    vt100_snapshot_free_grid(vt, vt->grid);
+    vt100_snapshot_free_grid(vt, vt->alternate);
+    vt100_snapshot_free_grid(vt, vt->spare);
+    vt->grid = NULL;
+    vt->alternate = NULL;
+    vt->spare = NULL;
+    vt100_screen_free(vt, vt->title);
+    vt100_screen_free(vt, vt->icon_name);
+    vt->title = NULL;
+    vt->title_len = 0;
+    vt->icon_name = NULL;
+    vt->icon_name_len = 0;
+    vt100_screen_free_scan_buffer(vt);
+    vt100_screen_forget_memory(vt);
+
+    vt->hibernating = 1;
+    vt->hibernate_fd = fd;
+    vt->hibernate_offset = offset;
+    vt->hibernate_len = len;
+
+    return 1;
+}
+
+int vt100_screen_wake(VT100Screen *vt)
+{
+    char *buf;
+    size_t len = vt->hibernate_len, got = 0;
+    int restored;
+
+    if (!vt->hibernating) {
+        return 1;
+    }
+
+    buf = malloc(len);
+    while (got < len) {
+        ssize_t n = pread(
+            vt->hibernate_fd, buf + got, len - got,
+            vt->hibernate_offset + got);
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            free(buf);
+            return 0;
+        }
+        got += n;
+    }
+
+    /* restoring doesn't touch the screen unless the whole thing parses, so
+     * it's still hibernating (and can be woken again) if this fails */
+    restored = vt100_snapshot_restore(vt, buf, len);
+    free(buf);
+    if (!restored) {
+        return 0;
+    }
+    vt->hibernating = 0;
+
+    return 1;
+}
+
+static struct vt100_grid *vt100_snapshot_read_grid(
+    struct vt100_snapshot_reader *r)
+{
+    struct vt100_grid *grid;
+    int i;
+
+    grid = vt100_screen_calloc(r->vt, 1, sizeof(struct vt100_grid));
+    grid->cur.row = vt100_snapshot_read_int(r);
+    grid->cur.col = vt100_snapshot_read_int(r);
+    grid->max.row = vt100_snapshot_read_int(r);
+    grid->max.col = vt100_snapshot_read_int(r);
+    grid->saved.row = vt100_snapshot_read_int(r);
+    grid->saved.col = vt100_snapshot_read_int(r);
+    grid->scroll_top = vt100_snapshot_read_int(r);
+    grid->scroll_bottom = vt100_snapshot_read_int(r);
+    grid->scroll_left = vt100_snapshot_read_int(r);
+    grid->scroll_right = vt100_snapshot_read_int(r);
+    grid->cur_from_text = !!vt100_snapshot_read_uint(r);
+    grid->row_count = vt100_snapshot_read_int(r);
+    grid->row_top = vt100_snapshot_read_int(r);
+    grid->reflow_pending = vt100_snapshot_read_int(r);
+
+    /* the cursor can sit one past the last column, waiting to wrap. the
+     * saved cursor can be anywhere past the edges, since it isn't clamped
+     * to the screen until it's restored. */
+    if (!r->ok || grid->max.row < 1 || grid->max.col < 1
+        || grid->cur.row < 0 || grid->cur.row >= grid->max.row
+        || grid->cur.col < 0 || grid->cur.col > grid->max.col
+        || grid->saved.row < 0 || grid->saved.col < 0
+        || grid->scroll_top < 0 || grid->scroll_top > grid->scroll_bottom
+        || grid->scroll_bottom >= grid->max.row
+        || grid->scroll_left < 0 || grid->scroll_left > grid->scroll_right
+        || grid->scroll_right >= grid->max.col
+        || grid->row_count < grid->max.row || grid->row_top < 0
+        || grid->row_top > grid->row_count - grid->max.row
+        || grid->reflow_pending < 0 || grid->reflow_pending > grid->row_top
+        || (size_t)grid->row_count > (size_t)(r->end - r->pos)) {
+        r->ok = 0;
+        grid->row_count = 0;
+        return grid;
+    }
+
+    grid->row_capacity = grid->row_count;
+    grid->rows = vt100_screen_calloc(
+        r->vt, grid->row_capacity, sizeof(struct vt100_row));
+    for (i = 0; i < grid->row_count; ++i) {
+        struct vt100_row *row = &grid->rows[i];
+        struct vt100_cell_attrs attrs;
+        unsigned long ncells, j;
+
+        memset(&attrs, 0, sizeof(struct vt100_cell_attrs));
+        row->wrapped = vt100_snapshot_read_uint(r);
+        ncells = vt100_snapshot_read_uint(r);
+        /* scrollback rows can be wider than the screen, but every cell
+         * takes up at least a byte */
+        if (ncells > (unsigned long)(r->end - r->pos)) {
+            r->ok = 0;
+        }
+        /* blank rows stay unallocated, like on a fresh screen */
+        if (r->ok && ncells) {
+            row->ncells = ncells > (unsigned long)grid->max.col
+                ? (int)ncells : grid->max.col;
+            row->cells = vt100_screen_calloc(
+                r->vt, row->ncells, sizeof(struct vt100_cell));
+            grid->cell_count += row->ncells;
+        }
+        for (j = 0; r->ok && j < ncells; ++j) {
+            struct vt100_cell *cell = &row->cells[j];
+            unsigned char header = 0;
+
+            vt100_snapshot_read_bytes(r, &header, 1);
+            cell->len = header & VT100_SNAPSHOT_CELL_LEN;
+            if (cell->len > sizeof(cell->contents)) {
+                r->ok = 0;
+                break;
+            }
+            vt100_snapshot_read_bytes(r, cell->contents, cell->len);
+            if (header & VT100_SNAPSHOT_CELL_ATTRS) {
+                vt100_snapshot_read_attrs(r, &attrs);
+            }
+            cell->attrs = attrs;
+            cell->is_wide = !!(header & VT100_SNAPSHOT_CELL_WIDE);
+        }
+    }
+
+    return grid;
+}
+
+static void vt100_snapshot_read_bytes(
+    struct vt100_snapshot_reader *r, void *buf, size_t len)
+{
+    if (!r->ok || (size_t)(r->end - r->pos) < len) {
+        r->ok = 0;
+        memset(buf, 0, len);
+        return;
+    }
+
+    memcpy(buf, r->pos, len);
+    r->pos += len;
+}
+
+static unsigned long vt100_snapshot_read_uint(
+    struct vt100_snapshot_reader *r)
+{
+    unsigned long val = 0;
+    int shift = 0;
+
+    while (r->ok && r->pos < r->end && shift < 64) {
+        unsigned char byte = *r->pos++;
+
+        val |= (unsigned long)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return val;
+        }
+        shift += 7;
+    }
+
+    r->ok = 0;
+    return 0;
+}
+
+static int vt100_snapshot_read_int(struct vt100_snapshot_reader *r)
+{
+    unsigned long val = vt100_snapshot_read_uint(r);
+
+    return val & 1 ? -(long)(val >> 1) - 1 : (long)(val >> 1);
+}
+
+static void vt100_snapshot_read_attrs(
+    struct vt100_snapshot_reader *r, struct vt100_cell_attrs *attrs)
+{
+    unsigned char buf[9];
+
+    vt100_snapshot_read_bytes(r, buf, sizeof(buf));
+    memset(attrs, 0, sizeof(struct vt100_cell_attrs));
+    attrs->fgcolor.r = buf[0];
+    attrs->fgcolor.g = buf[1];
+    attrs->fgcolor.b = buf[2];
+    attrs->fgcolor.type = buf[3];
+    attrs->bgcolor.r = buf[4];
+    attrs->bgcolor.g = buf[5];
+    attrs->bgcolor.b = buf[6];
+    attrs->bgcolor.type = buf[7];
+    attrs->attrs = buf[8];
+}
+
+static char *vt100_snapshot_read_string(
+    struct vt100_snapshot_reader *r, size_t *lenp)
+{
+    unsigned long len;
+    char *str;
+
+    len = vt100_snapshot_read_uint(r);
+    if (!r->ok || len > (unsigned long)(r->end - r->pos)) {
+        r->ok = 0;
+        *lenp = 0;
+        return NULL;
+    }
+
+    str = vt100_screen_malloc(r->vt, len);
+    vt100_snapshot_read_bytes(r, str, len);
+    *lenp = len;
+
+    return str;
+}
+
+static void vt100_snapshot_free_grid(
+    VT100Screen *vt, struct vt100_grid *grid)
+{
+    int i;
+
+    if (!grid) {
+        return;
+    }
+
+    for (i = 0; i < grid->row_count; ++i) {
+        vt100_screen_free(vt, grid->rows[i].cells);
+    }
+    vt100_screen_free(vt, grid->rows);
+    vt100_screen_free(vt, grid);
+}
@@ -0,0 +1,21 @@
+#ifndef _VT100_SNAPSHOT_H
+#define _VT100_SNAPSHOT_H
+
+#include <stddef.h>
+
+void vt100_screen_snapshot(VT100Screen *vt, char **strp, size_t *lenp);
+int vt100_screen_restore(VT100Screen *vt, const char *buf, size_t len);
+/* writes a snapshot of the screen to fd at its current offset (moving the
+ * offset past it, so several screens can be written one after another to
+ * the same file), and then frees its grids, title and undo history. the fd
+ * has to be seekable, and it and what was written have to be left alone
+ * until the screen is woken up again or deleted. processing input or
+ * resizing the screen wakes it up by itself, but anything else that looks
+ * at the screen has to call vt100_screen_wake first. a partial escape
+ * sequence is never held by the screen (it's whatever process_string
+ * didn't consume), so there's nothing else to save. both return 0 on
+ * failure, in which case the screen is left as it was. */
+int vt100_screen_hibernate(VT100Screen *vt, int fd);
+int vt100_screen_wake(VT100Screen *vt);
+
+#endif
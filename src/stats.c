@@ -0,0 +1,141 @@
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vt100.h"
+
+/* long enough for any of the parser's messages, which quote at most one
+ * sequence (and get cut short if it's a long one) */
+#define VT100_DIAGNOSTIC_MESSAGE_MAX 256
+
+struct vt100_diagnostic_sink {
+    vt100_diagnostic_callback_t callback;
+    void *data;
+    int max_per_second;
+
+    /* the rate limit is counted in one second windows. with a pipeline,
+     * the scanner and the pipeline thread can both report things, so this is
+     * locked */
+    pthread_mutex_t lock;
+    time_t window;
+    int sent;
+};
+
+void vt100_screen_set_diagnostic_callback(
+    VT100Screen *vt, vt100_diagnostic_callback_t callback, void *data,
+    int max_per_second)
+{
+    vt100_screen_free_diagnostics(vt);
+    if (!callback) {
+        return;
+    }
+
+    vt->diagnostics = vt100_screen_calloc(
+        vt, 1, sizeof(struct vt100_diagnostic_sink));
+    vt->diagnostics->callback = callback;
+    vt->diagnostics->data = data;
+    vt->diagnostics->max_per_second = max_per_second;
+    pthread_mutex_init(&vt->diagnostics->lock, NULL);
+}
+
+void vt100_screen_reset_stats(VT100Screen *vt)
+{
+    memset(&vt->stats, 0, sizeof(struct vt100_stats));
+}
+
+void vt100_screen_set_timing(VT100Screen *vt, int timing)
+{
+    vt->timing = !!timing;
+}
+
+void vt100_diagnostic_print(
+    VT100Screen *vt, int type, const char *message, void *data)
+{
+    (void)vt;
+    (void)type;
+    (void)data;
+
+    fprintf(stderr, "%s\n", message);
+}
+
+void vt100_screen_diagnostic(VT100Screen *vt, int type, const char *fmt, ...)
+{
+    struct vt100_diagnostic_sink *sink = vt->diagnostics;
+    char message[VT100_DIAGNOSTIC_MESSAGE_MAX];
+    struct timespec ts;
+    va_list ap;
+
+    vt->stats.diagnostics[type]++;
+    if (!sink) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    pthread_mutex_lock(&sink->lock);
+    if (ts.tv_sec != sink->window) {
+        sink->window = ts.tv_sec;
+        sink->sent = 0;
+    }
+    if (sink->sent >= sink->max_per_second) {
+        vt->stats.diagnostics_dropped++;
+        pthread_mutex_unlock(&sink->lock);
+        return;
+    }
+    sink->sent++;
+    pthread_mutex_unlock(&sink->lock);
+
+    va_start(ap, fmt);
+    vsnprintf(message, sizeof(message), fmt, ap);
+    va_end(ap);
+
+    sink->callback(vt->owner ? vt->owner : vt, type, message, sink->data);
+}
+
+void vt100_screen_count_token(VT100Screen *vt, int type, size_t len)
+{
+    vt->stats.tokens[type]++;
+    if (type == VT100_TOKEN_ASCII || type == VT100_TOKEN_TEXT) {
+        vt->stats.text_bytes += len;
+    }
+}
+
+/* the counters are all unsigned longs, so this doesn't have to know which
+ * ones there are */
+void vt100_stats_add(struct vt100_stats *stats, struct vt100_stats *other)
+{
+    unsigned long *to = (unsigned long *)stats;
+    unsigned long *from = (unsigned long *)other;
+    size_t i;
+
+    for (i = 0; i < sizeof(struct vt100_stats) / sizeof(unsigned long); ++i) {
+        to[i] += from[i];
+    }
+}
+
+unsigned long vt100_stats_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+void vt100_stats_add_time(struct vt100_timing *timing, unsigned long start)
+{
+    timing->calls++;
+    timing->nsec += vt100_stats_clock() - start;
+}
+
+void vt100_screen_free_diagnostics(VT100Screen *vt)
+{
+    if (!vt->diagnostics) {
+        return;
+    }
+
+    pthread_mutex_destroy(&vt->diagnostics->lock);
+    vt100_screen_free(vt, vt->diagnostics);
+    vt->diagnostics = NULL;
+}
@@ -0,0 +1,79 @@
+#ifndef _VT100_STATS_H
+#define _VT100_STATS_H
+
+/* the kinds of input the parser doesn't know what to do with */
+enum vt100_diagnostic_type {
+    VT100_DIAGNOSTIC_UNHANDLED_CSI,
+    VT100_DIAGNOSTIC_UNHANDLED_OSC,
+    VT100_DIAGNOSTIC_UNHANDLED_ESCAPE,
+    VT100_DIAGNOSTIC_UNHANDLED_CONTROL,
+    VT100_DIAGNOSTIC_INVALID_UTF8,
+    VT100_DIAGNOSTIC_UNKNOWN_SGR,
+    VT100_DIAGNOSTIC_UNKNOWN_MODE,
+    VT100_DIAGNOSTIC_UNKNOWN_PARAMETER,
+    VT100_DIAGNOSTIC_COUNT
+};
+
+struct vt100_timing {
+    unsigned long calls;
+    unsigned long nsec;
+};
+
+/* all of these only ever go up, until vt100_screen_reset_stats. they're
+ * updated without any locking, so read them from the thread that processes
+ * the screen's input (the grid ones are updated by the pipeline thread
+ * while there is one). */
+struct vt100_stats {
+    unsigned long diagnostics[VT100_DIAGNOSTIC_COUNT];
+    /* diagnostics that the rate limit kept from the callback */
+    unsigned long diagnostics_dropped;
+
+    /* input that was consumed, how it was tokenized, and how many times
+     * a partial escape sequence was left at the end to be passed in again */
+    unsigned long bytes;
+    unsigned long text_bytes;
+    unsigned long tokens[VT100_TOKEN_COUNT];
+    unsigned long carryovers;
+
+    /* rows scrolled off the top of the screen or region (or back onto it),
+     * and rows whose cells were allocated or freed on the screen's grid */
+    unsigned long scrolls;
+    unsigned long rows_allocated;
+    unsigned long rows_freed;
+    /* rows thrown out of the scrollback to stay under a memory limit */
+    unsigned long rows_evicted;
+
+    /* only counted while timing is on */
+    struct vt100_timing process;
+    struct vt100_timing get_string;
+    struct vt100_timing resize;
+};
+
+typedef void (*vt100_diagnostic_callback_t)(
+    VT100Screen *vt, int type, const char *message, void *data);
+
+/* the parser counts everything it can't handle in vt->stats, and only
+ * describes it if there's a diagnostic callback, which gets called at most
+ * max_per_second times a second (the rest are only counted). with a
+ * pipeline running, it can be called from the pipeline thread too, and
+ * vt100_screen_process_parallel calls it from its worker threads.
+ * vt100_diagnostic_print is a callback that writes them to stderr. */
+void vt100_screen_set_diagnostic_callback(
+    VT100Screen *vt, vt100_diagnostic_callback_t callback, void *data,
+    int max_per_second);
+void vt100_screen_reset_stats(VT100Screen *vt);
+/* adds the time spent in process_string (and the other ways of processing
+ * input), get_string and set_window_size to vt->stats. it's off by default
+ * since it reads the clock twice per call. */
+void vt100_screen_set_timing(VT100Screen *vt, int timing);
+void vt100_diagnostic_print(
+    VT100Screen *vt, int type, const char *message, void *data);
+
+void vt100_screen_diagnostic(VT100Screen *vt, int type, const char *fmt, ...);
+void vt100_screen_count_token(VT100Screen *vt, int type, size_t len);
+void vt100_stats_add(struct vt100_stats *stats, struct vt100_stats *other);
+unsigned long vt100_stats_clock(void);
+void vt100_stats_add_time(struct vt100_timing *timing, unsigned long start);
+void vt100_screen_free_diagnostics(VT100Screen *vt);
+
+#endif
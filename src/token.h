@@ -0,0 +1,55 @@
+#ifndef _VT100_TOKEN_H
+#define _VT100_TOKEN_H
+
+#include <stddef.h>
+
+/* one for each kind of sequence the lexer in parser.l hands off to be
+ * applied to the screen */
+enum VT100TokenType {
+    VT100_TOKEN_BEL,
+    VT100_TOKEN_BS,
+    VT100_TOKEN_TAB,
+    VT100_TOKEN_LF,
+    VT100_TOKEN_CR,
+    VT100_TOKEN_DECKPAM,
+    VT100_TOKEN_DECKPNM,
+    VT100_TOKEN_RI,
+    VT100_TOKEN_RIS,
+    VT100_TOKEN_VB,
+    VT100_TOKEN_DECSC,
+    VT100_TOKEN_DECRC,
+    VT100_TOKEN_ICH,
+    VT100_TOKEN_CUU,
+    VT100_TOKEN_CUD,
+    VT100_TOKEN_CUF,
+    VT100_TOKEN_CUB,
+    VT100_TOKEN_CHA,
+    VT100_TOKEN_CUP,
+    VT100_TOKEN_ED,
+    VT100_TOKEN_EL,
+    VT100_TOKEN_IL,
+    VT100_TOKEN_DL,
+    VT100_TOKEN_DCH,
+    VT100_TOKEN_SU,
+    VT100_TOKEN_SD,
+    VT100_TOKEN_ECH,
+    VT100_TOKEN_VPA,
+    VT100_TOKEN_SM,
+    VT100_TOKEN_RM,
+    VT100_TOKEN_SGR,
+    VT100_TOKEN_CSR,
+    VT100_TOKEN_DECSED,
+    VT100_TOKEN_DECSEL,
+    VT100_TOKEN_OSC0,
+    VT100_TOKEN_OSC1,
+    VT100_TOKEN_OSC2,
+    VT100_TOKEN_ASCII,
+    VT100_TOKEN_TEXT,
+    VT100_TOKEN_DECSLRM,
+    VT100_TOKEN_COUNT
+};
+
+void vt100_parser_apply_token(
+    VT100Screen *vt, int type, char *buf, size_t len);
+
+#endif
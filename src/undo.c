@@ -0,0 +1,863 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vt100.h"
+
+enum VT100UndoEntryType {
+    VT100_UNDO_ROW,
+    VT100_UNDO_SCROLL,
+    VT100_UNDO_GROW,
+    VT100_UNDO_TRIM,
+    VT100_UNDO_RESIZE,
+    VT100_UNDO_ALTERNATE_ON,
+    VT100_UNDO_ALTERNATE_OFF,
+    VT100_UNDO_TITLE,
+    VT100_UNDO_ICON_NAME
+};
+
+/* rows are stored as indexes into grid->rows rather than screen rows, since
+ * row_top moves around as the screen scrolls. entries are always undone in
+ * the reverse of the order they were recorded in, so the grid has exactly
+ * the same shape when an entry is undone as it had just after it was made.
+ *
+ * ROW:           rows holds a copy of row `top` before it was changed
+ * SCROLL:        rows top..bottom were scrolled by count (up if positive,
+ *                down if negative), and rows holds the ones scrolled off
+ * GROW:          count blank rows were added to the end of the scrollback
+ * TRIM:          the first `top` rows were dropped from the scrollback
+ *                (saved in rows) and count blank rows were added, when the
+ *                grid used to have row_count rows
+ * RESIZE:        the grid was max and had row_count rows before it was
+ *                resized, and rows holds rows top..row_count - 1, which
+ *                are the ones the resize could have changed. if the lines
+ *                were reflowed, grid is the whole grid from before instead.
+ * ALTERNATE_ON:  the alternate screen was switched on
+ * ALTERNATE_OFF: the alternate screen was switched off, and grid is what
+ *                it contained
+ * TITLE and ICON_NAME: str is the previous value */
+struct vt100_undo_entry {
+    int type;
+    int top;
+    int bottom;
+    int count;
+    int row_count;
+    struct vt100_loc max;
+    struct vt100_undo_row *rows;
+    int nrows;
+    struct vt100_grid *grid;
+    char *str;
+    size_t len;
+};
+
+/* saved rows leave off any blank cells at the end, which is most of them
+ * for typical output */
+struct vt100_undo_row {
+    struct vt100_cell *cells;
+    int ncells;
+    unsigned int wrapped: 1;
+};
+
+struct vt100_undo_cursor {
+    struct vt100_loc cur;
+    struct vt100_loc saved;
+    int scroll_top;
+    int scroll_bottom;
+    int scroll_left;
+    int scroll_right;
+    int cur_from_text;
+};
+
+/* the parts of the screen outside of its grids that a step can change */
+struct vt100_undo_modes {
+    int scrollback_length;
+    double synchronized_output_start;
+    struct vt100_cell_attrs attrs;
+    unsigned char mouse_reporting_mode;
+
+    unsigned int hide_cursor: 1;
+    unsigned int application_keypad: 1;
+    unsigned int application_cursor: 1;
+    unsigned int mouse_reporting_press: 1;
+    unsigned int mouse_reporting_press_release: 1;
+    unsigned int mouse_reporting_button_motion: 1;
+    unsigned int mouse_reporting_any_motion: 1;
+    unsigned int bracketed_paste: 1;
+    unsigned int origin_mode: 1;
+    unsigned int left_right_margin_mode: 1;
+    unsigned int synchronized_output: 1;
+    unsigned int visual_bell: 1;
+    unsigned int audible_bell: 1;
+    unsigned int update_title: 1;
+    unsigned int update_icon_name: 1;
+    unsigned int custom_scrollback_length: 1;
+};
+
+struct vt100_undo_step {
+    struct vt100_undo_modes modes;
+    struct vt100_undo_cursor grid;
+    struct vt100_undo_cursor alternate;
+
+    struct vt100_undo_entry *entries;
+    int nentries;
+    int capacity;
+
+    size_t bytes;
+};
+
+/* steps is a ring, so that dropping the oldest step doesn't have to move
+ * all of the others */
+struct vt100_undo_log {
+    struct vt100_undo_step *steps;
+    int first;
+    int nsteps;
+    int capacity;
+
+    size_t bytes;
+    size_t max_bytes;
+
+    /* a row only needs to be saved the first time it changes in each step,
+     * so this remembers which ones have been. it's reset by bumping
+     * generation, which happens at the start of each step and whenever rows
+     * move around. */
+    unsigned int *seen;
+    int seen_capacity;
+    unsigned int generation;
+};
+
+static struct vt100_undo_step *vt100_undo_step_at(
+    struct vt100_undo_log *log, int i);
+static struct vt100_undo_step *vt100_undo_current_step(VT100Screen *vt);
+static struct vt100_undo_entry *vt100_undo_push_entry(
+    VT100Screen *vt, int type);
+static void vt100_undo_account(
+    VT100Screen *vt, struct vt100_undo_step *step, size_t bytes);
+static void vt100_undo_drop_oldest(VT100Screen *vt);
+static void vt100_undo_free_step(
+    VT100Screen *vt, struct vt100_undo_step *step);
+static void vt100_undo_free_entry(
+    VT100Screen *vt, struct vt100_undo_entry *entry);
+static void vt100_undo_apply_entry(
+    VT100Screen *vt, struct vt100_undo_entry *entry);
+static void vt100_undo_apply_step(
+    VT100Screen *vt, struct vt100_undo_step *step);
+static void vt100_undo_save_modes(
+    struct vt100_undo_modes *modes, VT100Screen *vt);
+static void vt100_undo_restore_modes(
+    struct vt100_undo_modes *modes, VT100Screen *vt);
+static void vt100_undo_save_cursor(
+    struct vt100_undo_cursor *cursor, struct vt100_grid *grid);
+static void vt100_undo_restore_cursor(
+    struct vt100_undo_cursor *cursor, struct vt100_grid *grid);
+static struct vt100_undo_row *vt100_undo_copy_rows(
+    VT100Screen *vt, struct vt100_grid *grid, int first, int count,
+    size_t *bytesp);
+static void vt100_undo_put_rows(
+    VT100Screen *vt, struct vt100_grid *grid, int first,
+    struct vt100_undo_row *rows, int count);
+static void vt100_undo_clear_rows(
+    VT100Screen *vt, struct vt100_grid *grid, int first, int count);
+static struct vt100_grid *vt100_undo_copy_grid(
+    VT100Screen *vt, struct vt100_grid *grid, size_t *bytesp);
+static void vt100_undo_free_grid(VT100Screen *vt, struct vt100_grid *grid);
+
+void vt100_screen_start_undo_log(VT100Screen *vt, size_t max_bytes)
+{
+    if (vt->undo) {
+        vt->undo->max_bytes = max_bytes;
+        return;
+    }
+
+    /* reflowing the rest of the scrollback later on would change rows out
+     * from under the log */
+    vt100_screen_reflow_scrollback(vt, INT_MAX);
+
+    vt->undo = vt100_screen_calloc(vt, 1, sizeof(struct vt100_undo_log));
+    vt->undo->max_bytes = max_bytes;
+    vt->undo->generation = 1;
+}
+
+void vt100_screen_stop_undo_log(VT100Screen *vt)
+{
+    if (!vt->undo) {
+        return;
+    }
+
+    vt100_screen_clear_undo_log(vt);
+    vt100_screen_free(vt, vt->undo->steps);
+    vt100_screen_free(vt, vt->undo->seen);
+    vt100_screen_free(vt, vt->undo);
+    vt->undo = NULL;
+}
+
+void vt100_screen_clear_undo_log(VT100Screen *vt)
+{
+    struct vt100_undo_log *log = vt->undo;
+
+    if (!log) {
+        return;
+    }
+
+    while (log->nsteps) {
+        vt100_undo_drop_oldest(vt);
+    }
+    log->first = 0;
+    log->generation++;
+}
+
+/* returns the number of steps that were actually undone, which is smaller
+ * than `steps` if the log didn't go back that far */
+int vt100_screen_undo(VT100Screen *vt, int steps)
+{
+    struct vt100_undo_log *log = vt->undo;
+    int undone = 0;
+
+    if (!log) {
+        return 0;
+    }
+
+    while (undone < steps && log->nsteps) {
+        struct vt100_undo_step *step;
+
+        step = vt100_undo_step_at(log, log->nsteps - 1);
+        vt100_undo_apply_step(vt, step);
+        log->bytes -= step->bytes;
+        vt100_undo_free_step(vt, step);
+        log->nsteps--;
+        undone++;
+    }
+    log->generation++;
+
+    if (undone) {
+        /* the rows were put back without keeping count of their cells */
+        vt100_screen_count_cells(vt);
+        vt->dirty = 1;
+        vt100_screen_update_frame(vt);
+        if (vt->events) {
+            vt100_screen_flush_events(vt);
+        }
+    }
+
+    return undone;
+}
+
+int vt100_screen_undo_steps(VT100Screen *vt)
+{
+    return vt->undo ? vt->undo->nsteps : 0;
+}
+
+size_t vt100_undo_memory_usage(VT100Screen *vt)
+{
+    struct vt100_undo_log *log = vt->undo;
+
+    if (!log) {
+        return 0;
+    }
+
+    return sizeof(struct vt100_undo_log)
+        + log->capacity * sizeof(struct vt100_undo_step)
+        + log->seen_capacity * sizeof(unsigned int)
+        + log->bytes;
+}
+
+void vt100_undo_begin_step(VT100Screen *vt)
+{
+    struct vt100_undo_log *log = vt->undo;
+    struct vt100_undo_step *step;
+
+    if (log->nsteps == log->capacity) {
+        int old_capacity = log->capacity;
+
+        log->capacity = log->capacity ? log->capacity * 2 : 64;
+        log->steps = vt100_screen_realloc(
+            vt, log->steps, log->capacity * sizeof(struct vt100_undo_step));
+        /* unwrap the part of the ring that wrapped around */
+        if (log->first) {
+            memcpy(
+                &log->steps[old_capacity], log->steps,
+                log->first * sizeof(struct vt100_undo_step));
+        }
+    }
+
+    step = vt100_undo_step_at(log, log->nsteps++);
+    memset(step, 0, sizeof(struct vt100_undo_step));
+    vt100_undo_save_modes(&step->modes, vt);
+    vt100_undo_save_cursor(&step->grid, vt->grid);
+    if (vt->alternate) {
+        vt100_undo_save_cursor(&step->alternate, vt->alternate);
+    }
+
+    log->generation++;
+    vt100_undo_account(vt, step, sizeof(struct vt100_undo_step));
+}
+
+void vt100_undo_save_row(VT100Screen *vt, int row)
+{
+    struct vt100_undo_log *log = vt->undo;
+    struct vt100_undo_entry *entry;
+    size_t bytes = 0;
+    int index = row + vt->grid->row_top;
+
+    if (index < 0 || index >= vt->grid->row_count) {
+        return;
+    }
+
+    if (log->seen_capacity < vt->grid->row_capacity) {
+        int old_capacity = log->seen_capacity;
+
+        log->seen_capacity = vt->grid->row_capacity;
+        log->seen = vt100_screen_realloc(
+            vt, log->seen, log->seen_capacity * sizeof(unsigned int));
+        memset(
+            &log->seen[old_capacity], 0,
+            (log->seen_capacity - old_capacity) * sizeof(unsigned int));
+    }
+    if (log->seen[index] == log->generation) {
+        return;
+    }
+
+    entry = vt100_undo_push_entry(vt, VT100_UNDO_ROW);
+    entry->top = index;
+    entry->rows = vt100_undo_copy_rows(vt, vt->grid, index, 1, &bytes);
+    entry->nrows = 1;
+    log->seen[index] = log->generation;
+    vt100_undo_account(vt, vt100_undo_current_step(vt), bytes);
+}
+
+void vt100_undo_save_rows(VT100Screen *vt, int top, int bottom)
+{
+    int row;
+
+    for (row = top; row <= bottom; ++row) {
+        vt100_undo_save_row(vt, row);
+    }
+}
+
+void vt100_undo_scroll(VT100Screen *vt, int top, int bottom, int count)
+{
+    struct vt100_undo_entry *entry;
+    size_t bytes = 0;
+
+    entry = vt100_undo_push_entry(vt, VT100_UNDO_SCROLL);
+    entry->top = top + vt->grid->row_top;
+    entry->bottom = bottom + vt->grid->row_top;
+    entry->count = count;
+    if (count > 0) {
+        entry->rows = vt100_undo_copy_rows(
+            vt, vt->grid, entry->top, count, &bytes);
+        entry->nrows = count;
+    }
+    else {
+        entry->rows = vt100_undo_copy_rows(
+            vt, vt->grid, entry->bottom + count + 1, -count, &bytes);
+        entry->nrows = -count;
+    }
+    vt100_undo_account(vt, vt100_undo_current_step(vt), bytes);
+}
+
+void vt100_undo_grow(VT100Screen *vt, int count)
+{
+    struct vt100_undo_entry *entry;
+
+    entry = vt100_undo_push_entry(vt, VT100_UNDO_GROW);
+    entry->count = count;
+}
+
+void vt100_undo_trim(VT100Screen *vt, int shift, int count)
+{
+    struct vt100_undo_entry *entry;
+    size_t bytes = 0;
+
+    if (shift > vt->grid->row_count) {
+        shift = vt->grid->row_count;
+    }
+
+    entry = vt100_undo_push_entry(vt, VT100_UNDO_TRIM);
+    entry->top = shift;
+    entry->count = count;
+    entry->row_count = vt->grid->row_count;
+    entry->rows = vt100_undo_copy_rows(vt, vt->grid, 0, shift, &bytes);
+    entry->nrows = shift;
+    vt100_undo_account(vt, vt100_undo_current_step(vt), bytes);
+}
+
+void vt100_undo_resize(VT100Screen *vt, int rows, int cols)
+{
+    struct vt100_undo_entry *entry;
+    size_t bytes = 0;
+    int row_top;
+
+    /* the same adjustments vt100_screen_set_window_size makes */
+    rows = rows ? rows : 1;
+    cols = cols ? cols : 1;
+    if (rows == vt->grid->max.row && cols == vt->grid->max.col) {
+        return;
+    }
+
+    /* a freshly created alternate screen doesn't need saving, since undoing
+     * the switch to it gets rid of it anyway */
+    if (!vt->grid->rows) {
+        return;
+    }
+
+    /* reflowing moves every line on the screen around */
+    if (vt->reflow && !vt->alternate && cols != vt->grid->max.col) {
+        entry = vt100_undo_push_entry(vt, VT100_UNDO_RESIZE);
+        entry->grid = vt100_undo_copy_grid(vt, vt->grid, &bytes);
+        vt100_undo_account(vt, vt100_undo_current_step(vt), bytes);
+        return;
+    }
+
+    /* only the rows that are on the screen before or after the resize get
+     * resized, so those are all that need saving */
+    row_top = vt->grid->row_count > rows ? vt->grid->row_count - rows : 0;
+    if (row_top > vt->grid->row_top) {
+        row_top = vt->grid->row_top;
+    }
+
+    entry = vt100_undo_push_entry(vt, VT100_UNDO_RESIZE);
+    entry->top = row_top;
+    entry->row_count = vt->grid->row_count;
+    entry->max = vt->grid->max;
+    entry->rows = vt100_undo_copy_rows(
+        vt, vt->grid, row_top, vt->grid->row_count - row_top, &bytes);
+    entry->nrows = vt->grid->row_count - row_top;
+    vt100_undo_account(vt, vt100_undo_current_step(vt), bytes);
+}
+
+void vt100_undo_alternate(VT100Screen *vt)
+{
+    struct vt100_undo_entry *entry;
+    size_t bytes = 0;
+
+    if (!vt->alternate) {
+        vt100_undo_push_entry(vt, VT100_UNDO_ALTERNATE_ON);
+        return;
+    }
+
+    entry = vt100_undo_push_entry(vt, VT100_UNDO_ALTERNATE_OFF);
+    entry->grid = vt100_undo_copy_grid(vt, vt->grid, &bytes);
+    vt100_undo_account(vt, vt100_undo_current_step(vt), bytes);
+}
+
+void vt100_undo_title(VT100Screen *vt)
+{
+    struct vt100_undo_entry *entry;
+
+    entry = vt100_undo_push_entry(vt, VT100_UNDO_TITLE);
+    if (vt->title) {
+        entry->len = vt->title_len;
+        entry->str = vt100_screen_malloc(vt, entry->len);
+        memcpy(entry->str, vt->title, entry->len);
+    }
+    vt100_undo_account(vt, vt100_undo_current_step(vt), entry->len);
+}
+
+void vt100_undo_icon_name(VT100Screen *vt)
+{
+    struct vt100_undo_entry *entry;
+
+    entry = vt100_undo_push_entry(vt, VT100_UNDO_ICON_NAME);
+    if (vt->icon_name) {
+        entry->len = vt->icon_name_len;
+        entry->str = vt100_screen_malloc(vt, entry->len);
+        memcpy(entry->str, vt->icon_name, entry->len);
+    }
+    vt100_undo_account(vt, vt100_undo_current_step(vt), entry->len);
+}
+
+static struct vt100_undo_step *vt100_undo_step_at(
+    struct vt100_undo_log *log, int i)
+{
+    return &log->steps[(log->first + i) % log->capacity];
+}
+
+/* changes made outside of vt100_screen_process_string (resizing the window
+ * before anything has been processed, say) still need a step to go in */
+static struct vt100_undo_step *vt100_undo_current_step(VT100Screen *vt)
+{
+    if (!vt->undo->nsteps) {
+        vt100_undo_begin_step(vt);
+    }
+
+    return vt100_undo_step_at(vt->undo, vt->undo->nsteps - 1);
+}
+
+static struct vt100_undo_entry *vt100_undo_push_entry(
+    VT100Screen *vt, int type)
+{
+    struct vt100_undo_step *step;
+    struct vt100_undo_entry *entry;
+
+    step = vt100_undo_current_step(vt);
+    if (step->nentries == step->capacity) {
+        step->capacity = step->capacity ? step->capacity * 2 : 8;
+        step->entries = vt100_screen_realloc(
+            vt, step->entries,
+            step->capacity * sizeof(struct vt100_undo_entry));
+    }
+
+    entry = &step->entries[step->nentries++];
+    memset(entry, 0, sizeof(struct vt100_undo_entry));
+    entry->type = type;
+
+    /* anything other than saving a row can move rows around, so the rows
+     * that were saved before might not be in the same place anymore */
+    if (type != VT100_UNDO_ROW) {
+        vt->undo->generation++;
+    }
+
+    step->bytes += sizeof(struct vt100_undo_entry);
+    vt->undo->bytes += sizeof(struct vt100_undo_entry);
+
+    return entry;
+}
+
+static void vt100_undo_account(
+    VT100Screen *vt, struct vt100_undo_step *step, size_t bytes)
+{
+    struct vt100_undo_log *log = vt->undo;
+
+    step->bytes += bytes;
+    log->bytes += bytes;
+
+    /* the current step is never dropped, even if it's bigger than the whole
+     * budget on its own */
+    while (log->bytes > log->max_bytes && log->nsteps > 1) {
+        vt100_undo_drop_oldest(vt);
+    }
+}
+
+static void vt100_undo_drop_oldest(VT100Screen *vt)
+{
+    struct vt100_undo_log *log = vt->undo;
+    struct vt100_undo_step *step;
+
+    step = vt100_undo_step_at(log, 0);
+    log->bytes -= step->bytes;
+    vt100_undo_free_step(vt, step);
+    log->first = (log->first + 1) % log->capacity;
+    log->nsteps--;
+}
+
+static void vt100_undo_free_step(
+    VT100Screen *vt, struct vt100_undo_step *step)
+{
+    int i;
+
+    for (i = 0; i < step->nentries; ++i) {
+        vt100_undo_free_entry(vt, &step->entries[i]);
+    }
+    vt100_screen_free(vt, step->entries);
+}
+
+static void vt100_undo_free_entry(
+    VT100Screen *vt, struct vt100_undo_entry *entry)
+{
+    int i;
+
+    if (entry->rows) {
+        for (i = 0; i < entry->nrows; ++i) {
+            vt100_screen_free(vt, entry->rows[i].cells);
+        }
+        vt100_screen_free(vt, entry->rows);
+    }
+    if (entry->grid) {
+        vt100_undo_free_grid(vt, entry->grid);
+    }
+    vt100_screen_free(vt, entry->str);
+}
+
+/* grids and strings move back to the screen, so those pointers are cleared
+ * to keep vt100_undo_free_entry from freeing them */
+static void vt100_undo_apply_entry(
+    VT100Screen *vt, struct vt100_undo_entry *entry)
+{
+    struct vt100_grid *grid = vt->grid;
+    int count = entry->count;
+
+    switch (entry->type) {
+    case VT100_UNDO_ROW:
+        vt100_screen_free(vt, grid->rows[entry->top].cells);
+        vt100_undo_put_rows(vt, grid, entry->top, entry->rows, 1);
+        break;
+    case VT100_UNDO_SCROLL:
+        if (count > 0) {
+            vt100_undo_clear_rows(vt, grid, entry->bottom - count + 1, count);
+            memmove(
+                &grid->rows[entry->top + count], &grid->rows[entry->top],
+                (entry->bottom - entry->top + 1 - count)
+                    * sizeof(struct vt100_row));
+            vt100_undo_put_rows(vt, grid, entry->top, entry->rows, count);
+        }
+        else {
+            count = -count;
+            vt100_undo_clear_rows(vt, grid, entry->top, count);
+            memmove(
+                &grid->rows[entry->top], &grid->rows[entry->top + count],
+                (entry->bottom - entry->top + 1 - count)
+                    * sizeof(struct vt100_row));
+            vt100_undo_put_rows(
+                vt, grid, entry->bottom - count + 1, entry->rows, count);
+        }
+        break;
+    case VT100_UNDO_GROW:
+        vt100_undo_clear_rows(vt, grid, grid->row_count - count, count);
+        grid->row_count -= count;
+        grid->row_top -= count;
+        break;
+    case VT100_UNDO_TRIM:
+        vt100_undo_clear_rows(vt, grid, grid->row_count - count, count);
+        memmove(
+            &grid->rows[entry->top], &grid->rows[0],
+            (entry->row_count - entry->top) * sizeof(struct vt100_row));
+        vt100_undo_put_rows(vt, grid, 0, entry->rows, entry->top);
+        grid->row_count = entry->row_count;
+        grid->row_top = grid->row_count - grid->max.row;
+        break;
+    case VT100_UNDO_RESIZE:
+        if (entry->grid) {
+            vt100_undo_free_grid(vt, vt->grid);
+            vt->grid = entry->grid;
+            entry->grid = NULL;
+            break;
+        }
+        vt100_undo_clear_rows(
+            vt, grid, entry->top, grid->row_count - entry->top);
+        grid->max = entry->max;
+        grid->row_count = entry->row_count;
+        grid->row_top = grid->row_count - grid->max.row;
+        vt100_undo_put_rows(vt, grid, entry->top, entry->rows, entry->nrows);
+        break;
+    case VT100_UNDO_ALTERNATE_ON:
+        vt100_undo_free_grid(vt, vt->grid);
+        vt->grid = vt->alternate;
+        vt->alternate = NULL;
+        break;
+    case VT100_UNDO_ALTERNATE_OFF:
+        /* the alternate grid that was kept around for reuse is replaced by
+         * the saved copy */
+        if (vt->spare) {
+            vt100_undo_free_grid(vt, vt->spare);
+            vt->spare = NULL;
+        }
+        vt->alternate = vt->grid;
+        vt->grid = entry->grid;
+        entry->grid = NULL;
+        break;
+    case VT100_UNDO_TITLE:
+        vt100_screen_free(vt, vt->title);
+        vt->title = entry->str;
+        vt->title_len = entry->len;
+        entry->str = NULL;
+        break;
+    case VT100_UNDO_ICON_NAME:
+        vt100_screen_free(vt, vt->icon_name);
+        vt->icon_name = entry->str;
+        vt->icon_name_len = entry->len;
+        entry->str = NULL;
+        break;
+    }
+}
+
+static void vt100_undo_apply_step(
+    VT100Screen *vt, struct vt100_undo_step *step)
+{
+    int i;
+
+    for (i = step->nentries - 1; i >= 0; --i) {
+        vt100_undo_apply_entry(vt, &step->entries[i]);
+    }
+
+    vt100_undo_restore_cursor(&step->grid, vt->grid);
+    if (vt->alternate) {
+        vt100_undo_restore_cursor(&step->alternate, vt->alternate);
+    }
+
+    vt100_undo_restore_modes(&step->modes, vt);
+}
+
+static void vt100_undo_save_modes(
+    struct vt100_undo_modes *modes, VT100Screen *vt)
+{
+    modes->scrollback_length = vt->scrollback_length;
+    modes->synchronized_output_start = vt->synchronized_output_start;
+    modes->attrs = vt->attrs;
+    modes->mouse_reporting_mode = vt->mouse_reporting_mode;
+    modes->hide_cursor = vt->hide_cursor;
+    modes->application_keypad = vt->application_keypad;
+    modes->application_cursor = vt->application_cursor;
+    modes->mouse_reporting_press = vt->mouse_reporting_press;
+    modes->mouse_reporting_press_release = vt->mouse_reporting_press_release;
+    modes->mouse_reporting_button_motion = vt->mouse_reporting_button_motion;
+    modes->mouse_reporting_any_motion = vt->mouse_reporting_any_motion;
+    modes->bracketed_paste = vt->bracketed_paste;
+    modes->origin_mode = vt->origin_mode;
+    modes->left_right_margin_mode = vt->left_right_margin_mode;
+    modes->synchronized_output = vt->synchronized_output;
+    modes->visual_bell = vt->visual_bell;
+    modes->audible_bell = vt->audible_bell;
+    modes->update_title = vt->update_title;
+    modes->update_icon_name = vt->update_icon_name;
+    modes->custom_scrollback_length = vt->custom_scrollback_length;
+}
+
+static void vt100_undo_restore_modes(
+    struct vt100_undo_modes *modes, VT100Screen *vt)
+{
+    vt->scrollback_length = modes->scrollback_length;
+    vt->synchronized_output_start = modes->synchronized_output_start;
+    vt->attrs = modes->attrs;
+    vt->mouse_reporting_mode = modes->mouse_reporting_mode;
+    vt->hide_cursor = modes->hide_cursor;
+    vt->application_keypad = modes->application_keypad;
+    vt->application_cursor = modes->application_cursor;
+    vt->mouse_reporting_press = modes->mouse_reporting_press;
+    vt->mouse_reporting_press_release = modes->mouse_reporting_press_release;
+    vt->mouse_reporting_button_motion = modes->mouse_reporting_button_motion;
+    vt->mouse_reporting_any_motion = modes->mouse_reporting_any_motion;
+    vt->bracketed_paste = modes->bracketed_paste;
+    vt->origin_mode = modes->origin_mode;
+    vt->left_right_margin_mode = modes->left_right_margin_mode;
+    vt->synchronized_output = modes->synchronized_output;
+    vt->visual_bell = modes->visual_bell;
+    vt->audible_bell = modes->audible_bell;
+    vt->update_title = modes->update_title;
+    vt->update_icon_name = modes->update_icon_name;
+    vt->custom_scrollback_length = modes->custom_scrollback_length;
+}
+
+static void vt100_undo_save_cursor(
+    struct vt100_undo_cursor *cursor, struct vt100_grid *grid)
+{
+    cursor->cur = grid->cur;
+    cursor->saved = grid->saved;
+    cursor->scroll_top = grid->scroll_top;
+    cursor->scroll_bottom = grid->scroll_bottom;
+    cursor->scroll_left = grid->scroll_left;
+    cursor->scroll_right = grid->scroll_right;
+    cursor->cur_from_text = grid->cur_from_text;
+}
+
+static void vt100_undo_restore_cursor(
+    struct vt100_undo_cursor *cursor, struct vt100_grid *grid)
+{
+    grid->cur = cursor->cur;
+    grid->saved = cursor->saved;
+    grid->scroll_top = cursor->scroll_top;
+    grid->scroll_bottom = cursor->scroll_bottom;
+    grid->scroll_left = cursor->scroll_left;
+    grid->scroll_right = cursor->scroll_right;
+    grid->cur_from_text = cursor->cur_from_text;
+}
+
+static struct vt100_undo_row *vt100_undo_copy_rows(
+    VT100Screen *vt, struct vt100_grid *grid, int first, int count,
+    size_t *bytesp)
+{
+    static const struct vt100_cell blank;
+    struct vt100_undo_row *rows;
+    int i;
+
+    rows = vt100_screen_malloc(vt, count * sizeof(struct vt100_undo_row));
+    for (i = 0; i < count; ++i) {
+        struct vt100_row *row = &grid->rows[first + i];
+        int ncells = row->cells ? row->ncells : 0;
+
+        while (ncells > 0
+            && !memcmp(&row->cells[ncells - 1], &blank, sizeof(blank))) {
+            ncells--;
+        }
+
+        rows[i].ncells = ncells;
+        rows[i].cells = NULL;
+        if (ncells) {
+            rows[i].cells = vt100_screen_malloc(
+                vt, ncells * sizeof(struct vt100_cell));
+            memcpy(
+                rows[i].cells, row->cells,
+                ncells * sizeof(struct vt100_cell));
+        }
+        rows[i].wrapped = row->wrapped;
+        *bytesp += ncells * sizeof(struct vt100_cell);
+    }
+    *bytesp += count * sizeof(struct vt100_undo_row);
+
+    return rows;
+}
+
+/* whatever was in those slots before is just overwritten, since it's
+ * either been freed or moved somewhere else */
+static void vt100_undo_put_rows(
+    VT100Screen *vt, struct vt100_grid *grid, int first,
+    struct vt100_undo_row *rows, int count)
+{
+    int i;
+
+    for (i = 0; i < count; ++i) {
+        struct vt100_row *row = &grid->rows[first + i];
+
+        row->cells = NULL;
+        if (rows[i].ncells) {
+            row->ncells = rows[i].ncells > grid->max.col
+                ? rows[i].ncells : grid->max.col;
+            row->cells = vt100_screen_calloc(
+                vt, row->ncells, sizeof(struct vt100_cell));
+            memcpy(
+                row->cells, rows[i].cells,
+                rows[i].ncells * sizeof(struct vt100_cell));
+        }
+        row->wrapped = rows[i].wrapped;
+    }
+}
+
+static void vt100_undo_clear_rows(
+    VT100Screen *vt, struct vt100_grid *grid, int first, int count)
+{
+    int i;
+
+    for (i = 0; i < count; ++i) {
+        vt100_screen_free(vt, grid->rows[first + i].cells);
+        grid->rows[first + i].cells = NULL;
+        grid->rows[first + i].wrapped = 0;
+    }
+}
+
+static struct vt100_grid *vt100_undo_copy_grid(
+    VT100Screen *vt, struct vt100_grid *grid, size_t *bytesp)
+{
+    struct vt100_grid *copy;
+    int i;
+
+    copy = vt100_screen_malloc(vt, sizeof(struct vt100_grid));
+    *copy = *grid;
+    copy->rows = vt100_screen_calloc(
+        vt, grid->row_capacity, sizeof(struct vt100_row));
+    *bytesp += sizeof(struct vt100_grid)
+        + grid->row_capacity * sizeof(struct vt100_row);
+    for (i = 0; i < grid->row_count; ++i) {
+        size_t row_size = grid->rows[i].ncells * sizeof(struct vt100_cell);
+
+        copy->rows[i].wrapped = grid->rows[i].wrapped;
+        if (!grid->rows[i].cells) {
+            continue;
+        }
+        copy->rows[i].cells = vt100_screen_malloc(vt, row_size);
+        copy->rows[i].ncells = grid->rows[i].ncells;
+        memcpy(copy->rows[i].cells, grid->rows[i].cells, row_size);
+        *bytesp += row_size;
+    }
+
+    return copy;
+}
+
+static void vt100_undo_free_grid(VT100Screen *vt, struct vt100_grid *grid)
+{
+    int i;
+
+    for (i = 0; i < grid->row_count; ++i) {
+        vt100_screen_free(vt, grid->rows[i].cells);
+    }
+    vt100_screen_free(vt, grid->rows);
+    vt100_screen_free(vt, grid);
+}
@@ -0,0 +1,34 @@
+#ifndef _VT100_UNDO_H
+#define _VT100_UNDO_H
+
+#include <stddef.h>
+
+struct vt100_undo_log;
+
+/* while the undo log is running, every call to vt100_screen_process_string
+ * starts a new step, and everything it changes is recorded (the previous
+ * contents of the rows it touched, the rows it scrolled away, and so on) so
+ * that vt100_screen_undo can put the screen back the way it was. the oldest
+ * steps are discarded once the log grows past max_bytes. this only works
+ * when tokens are applied synchronously, not through a pipeline. */
+void vt100_screen_start_undo_log(VT100Screen *vt, size_t max_bytes);
+void vt100_screen_stop_undo_log(VT100Screen *vt);
+void vt100_screen_clear_undo_log(VT100Screen *vt);
+int vt100_screen_undo(VT100Screen *vt, int steps);
+int vt100_screen_undo_steps(VT100Screen *vt);
+size_t vt100_undo_memory_usage(VT100Screen *vt);
+
+/* these are called by the screen functions before they change anything.
+ * rows are screen rows, like everywhere else. */
+void vt100_undo_begin_step(VT100Screen *vt);
+void vt100_undo_save_row(VT100Screen *vt, int row);
+void vt100_undo_save_rows(VT100Screen *vt, int top, int bottom);
+void vt100_undo_scroll(VT100Screen *vt, int top, int bottom, int count);
+void vt100_undo_grow(VT100Screen *vt, int count);
+void vt100_undo_trim(VT100Screen *vt, int shift, int count);
+void vt100_undo_resize(VT100Screen *vt, int rows, int cols);
+void vt100_undo_alternate(VT100Screen *vt);
+void vt100_undo_title(VT100Screen *vt);
+void vt100_undo_icon_name(VT100Screen *vt);
+
+#endif
@@ -2,10 +2,28 @@
 #define _VT100_H
 
 struct vt100_screen;
+struct vt100_engine;
+struct vt100_session;
 
 typedef struct vt100_screen VT100Screen;
+typedef struct vt100_engine VT100Engine;
+typedef struct vt100_session VT100Session;
 
+#include "token.h"
+#include "stats.h"
+#include "memory.h"
 #include "screen.h"
+#include "frame.h"
+#include "pipeline.h"
+#include "bytecode.h"
+#include "parallel.h"
+#include "file.h"
+#include "snapshot.h"
+#include "index.h"
+#include "undo.h"
+#include "reflow.h"
+#include "engine.h"
+#include "event.h"
 #include "unicode-extra.h"
 
 #endif